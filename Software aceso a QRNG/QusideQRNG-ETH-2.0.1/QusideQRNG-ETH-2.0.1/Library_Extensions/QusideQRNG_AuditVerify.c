@@ -0,0 +1,97 @@
+/*
+ ============================================================================
+ Name        : QusideQRNG_AuditVerify.c
+ Author      : Alvaro Velasco Garcia, Heriberto J. Diaz
+ Created on  : 18 oct. 2022
+ Version     : 0.1
+ Copyright   : Copyright (C) 2022 QUSIDE TECHNOLOGIES - All Rights Reserved.
+               Unauthorized copying of this file, via any medium is
+               strictly prohibited.
+ Description : Verifies an audit log written with audit_open, and that it was
+               not cut before the head of a head file kept out of the host.
+               Returns 0 if the log is right, 1 if it is wrong and -1 if it
+               can not be read.
+ ============================================================================
+ */
+
+#include "quside_QRNG_audit.h"
+#include "quside_QRNG_sha256.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <getopt.h>
+
+static void _usage(const char* name) {
+
+	printf("Usage: %s [options] -f file\n", name);
+	puts("  -f file     Audit log to verify.");
+	puts("  -t threads  Worker threads (default one per core).");
+	puts("  -a file     Head file (headPath of auditOptions) the log has to contain.");
+}
+
+int main(int argc, char** argv) {
+
+	auditReport report;
+	auditHead anchor;
+	char* file = NULL;
+	char* anchorFile = NULL;
+	int threads = 0;
+	int opt;
+
+	while((opt = getopt(argc, argv, "f:t:a:")) != -1) {
+		switch(opt) {
+		case 'f': file = optarg; break;
+		case 't': threads = atoi(optarg); break;
+		case 'a': anchorFile = optarg; break;
+		default: _usage(argv[0]); return -1;
+		}
+	}
+
+	if(file == NULL) {
+		_usage(argv[0]);
+		return -1;
+	}
+
+	if(anchorFile != NULL && audit_load_head(anchorFile, &anchor) != 0) {
+		puts("Wrong head file.");
+		return -1;
+	}
+
+	const int ret = audit_verify_anchor(file, threads, anchorFile != NULL ? &anchor : NULL, &report);
+	if(ret < 0) {
+		puts("Some error occurs");
+		return -1;
+	}
+
+	if(report.badHeader) {
+		puts("Wrong header.");
+		return 1;
+	}
+
+	printf("Records          : %llu\n", (unsigned long long)report.records);
+	printf("Bytes            : %llu\n", (unsigned long long)report.bytes);
+	printf("Wrong links      : %llu\n", (unsigned long long)report.badLinks);
+	printf("Wrong sequence   : %llu\n", (unsigned long long)report.badSequence);
+	printf("Wrong ranges     : %llu\n", (unsigned long long)report.badRanges);
+	printf("Duplicated blocks: %llu\n", (unsigned long long)report.duplicates);
+	if(report.truncated) {
+		puts("The log ends with an incomplete record.");
+	}
+	if(report.unclosed) {
+		puts("The log was not closed: it was cut or its process did not end.");
+	}
+	if(report.badAnchor) {
+		printf("The log does not contain the head of record %llu.\n", (unsigned long long)anchor.records);
+	}
+	printf("Head             : %llu ", (unsigned long long)report.head.records);
+	for(int i = 0; i < AUDIT_HASH_SIZE; ++i) {
+		printf("%02x", report.head.chainHash[i]);
+	}
+	putchar('\n');
+	if(report.firstBad >= 0) {
+		printf("First wrong record: %lld\n", (long long)report.firstBad);
+	}
+	printf("SHA extensions   : %s\n", sha256_accelerated() ? "yes" : "no");
+	puts(ret == 0 ? "The log is right." : "The log is WRONG.");
+
+	return ret;
+}
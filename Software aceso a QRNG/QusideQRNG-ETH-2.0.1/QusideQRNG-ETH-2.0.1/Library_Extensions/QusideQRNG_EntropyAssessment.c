@@ -0,0 +1,127 @@
+/*
+ ============================================================================
+ Name        : QusideQRNG_EntropyAssessment.c
+ Author      : Alvaro Velasco Garcia, Heriberto J. Diaz
+ Created on  : 18 oct. 2022
+ Version     : 0.1
+ Copyright   : Copyright (C) 2022 QUSIDE TECHNOLOGIES - All Rights Reserved.
+               Unauthorized copying of this file, via any medium is
+               strictly prohibited.
+ Description : Runs the SP 800-90B non-IID estimators over a file of raw
+               data or over raw data captured from a QRNG.
+ ============================================================================
+ */
+
+#include "quside_QRNG_entropy.h"
+#include "quside_QRNG_combiner.h"
+#include <quside_QRNG_user.h>
+#include <getopt.h>
+
+static void _usage(const char* name) {
+
+	printf("Usage: %s [options] (-f file | -s serverIP)\n", name);
+	puts("  -f file     Assess a file of raw data, one sample per byte.");
+	puts("  -s ip       Capture raw data from the QRNG with this IP.");
+	puts("  -n bytes    Bytes to capture from the QRNG (default 1000000).");
+	puts("  -d index    Index of the device (default 0).");
+	puts("  -b bits     Bits per sample (default 8).");
+	puts("  -l samples  Samples per block (default 1000000).");
+	puts("  -t threads  Worker threads (default one per core).");
+	puts("  -v          Print the result of each block.");
+}
+
+static void _format(char* buf, const size_t size, const double h) {
+
+	if(h == ENTROPY_NA) {
+		snprintf(buf, size, "N/A");
+	} else {
+		snprintf(buf, size, "%f", h);
+	}
+}
+
+static void _print_result(const entropyResult* r) {
+
+	char samples[32], bitstring[32];
+
+	printf("  %-18s  %-12s%s\n", "", "Samples", "Bitstring");
+	for(int e = 0; e < ENTROPY_ESTIMATORS; ++e) {
+		_format(samples, sizeof(samples), r->h[e]);
+		_format(bitstring, sizeof(bitstring), r->hBits[e]);
+		printf("  %-18s: %-12s%s\n", entropy_estimator_name((entropyEstimator)e), samples, bitstring);
+	}
+	printf("  H_original        : %f\n", r->hOriginal);
+	printf("  H_bitstring       : %f\n", r->hBitstring);
+	printf("  Min-entropy       : %f\n", r->hAssessed);
+}
+
+static void _block_done(void* ctx, const uint64_t block, const entropyResult* r) {
+
+	if(*(int*)ctx) {
+		printf("Block %llu (%llu samples):\n", (unsigned long long)block,
+				(unsigned long long)r->samples);
+		_print_result(r);
+	}
+}
+
+int main(int argc, char** argv) {
+
+	entropyOptions options = { 8, ENTROPY_DEFAULT_BLOCK, 0 };
+	entropyResult result;
+	char* file = NULL;
+	char* serverIP = NULL;
+	unsigned long long nBytes = 1000000;
+	int devIndex = 0;
+	int verbose = 0;
+	int opt, ret;
+
+	while((opt = getopt(argc, argv, "f:s:n:d:b:l:t:v")) != -1) {
+		switch(opt) {
+		case 'f': file = optarg; break;
+		case 's': serverIP = optarg; break;
+		case 'n': nBytes = strtoull(optarg, NULL, 10); break;
+		case 'd': devIndex = atoi(optarg); break;
+		case 'b': options.bitsPerSample = atoi(optarg); break;
+		case 'l': options.blockSamples = strtoull(optarg, NULL, 10); break;
+		case 't': options.threads = atoi(optarg); break;
+		case 'v': verbose = 1; break;
+		default: _usage(argv[0]); return -1;
+		}
+	}
+
+	if((file == NULL) == (serverIP == NULL)) {
+		_usage(argv[0]);
+		return -1;
+	}
+
+	if(file != NULL) {
+		ret = entropy_assess_file(file, &options, _block_done, &verbose, &result);
+
+	} else {
+		if(connectToServer(serverIP) != 0) {
+			puts("Error connect.");
+			return -1;
+		}
+		if(combiner_init(0) != 0) {
+			puts("Some error occurs");
+			disconnectServer();
+			return -1;
+		}
+
+		ret = entropy_assess_device((uint16_t)devIndex, nBytes, &options, _block_done,
+				&verbose, &result);
+
+		combiner_release();
+		disconnectServer();
+	}
+
+	if(ret != 0) {
+		puts("Some error occurs");
+		return -1;
+	}
+
+	printf("Assessed %llu samples in %llu blocks (minimum over the blocks):\n",
+			(unsigned long long)result.samples, (unsigned long long)result.blocks);
+	_print_result(&result);
+
+	return 0;
+}
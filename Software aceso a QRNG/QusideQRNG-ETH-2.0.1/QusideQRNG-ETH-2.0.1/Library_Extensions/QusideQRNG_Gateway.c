@@ -0,0 +1,938 @@
+/*
+ ============================================================================
+ Name        : QusideQRNG_Gateway.c
+ Author      : Alvaro Velasco Garcia, Heriberto J. Diaz
+ Created on  : 18 oct. 2022
+ Version     : 0.1
+ Copyright   : Copyright (C) 2022 QUSIDE TECHNOLOGIES - All Rights Reserved.
+               Unauthorized copying of this file, via any medium is
+               strictly prohibited.
+ Description : Entropy gateway. It keeps a fixed number of sessions with one
+               or more QRNGs through the window engine, buffers extracted
+               random numbers in memory and serves them to many clients
+               with the protocol of quside_QRNG_gateway.h.
+
+               A refill thread fills a ring buffer. The main thread serves
+               all the clients with epoll and shares the buffer between the
+               clients with pending requests by deficit round robin: each
+               turn adds a quantum to the deficit of the client, and the
+               client is served while its deficit lasts, across its queued
+               requests, limited by the quota of each client. So a client
+               with many small requests gets the same bytes as a client with
+               big ones. Every byte of the buffer is delivered once and wiped.
+
+               The work of each wakeup only depends on the clients with
+               events or able to take bytes: the round robin only visits
+               the clients that can take bytes now, the clients waiting for
+               their quota sleep in a heap ordered by the time they can
+               continue, and only the clients touched in the wakeup are
+               swept.
+ ============================================================================
+ */
+
+#define _GNU_SOURCE
+
+#include "quside_QRNG_gateway.h"
+#include "quside_QRNG_window.h"
+#include <quside_QRNG_user.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <signal.h>
+#include <errno.h>
+#include <getopt.h>
+#include <stdatomic.h>
+
+#define GW_MAX_SERVERS			16
+#define GW_QUANTUM				65536
+#define GW_IN_CAP				(GW_HEADER_SIZE * 64)
+#define GW_OUT_CAP				(GW_QUANTUM + GW_HEADER_SIZE * 64)
+#define GW_REFILL_CHUNK			((size_t)4 << 20)
+#define GW_MAX_EVENTS			256
+#define GW_ACCEPT_BACKOFF_NS	100000000ULL
+#define GW_STATS_PERIOD_NS		10000000000ULL
+
+/* Connection with a client. All the clients form a circular list. The clients
+ * that can take bytes now also form the circular active list, that is the
+ * round robin order of the scheduler, and the clients waiting only for their
+ * quota are in the timer heap. */
+typedef struct gwClient {
+	int fd;
+	uint8_t in[GW_IN_CAP];
+	size_t inLen;
+	uint8_t out[GW_OUT_CAP];
+	size_t outLen;
+	size_t outOff;
+	bool serving;
+	uint32_t remaining;
+	bool closing;
+	uint32_t events;
+	double tokens;
+	uint64_t tokensNs;			/* Time of the last update of tokens. */
+	uint64_t served;
+	size_t deficit;				/* Bytes the client can still take in this round. */
+	bool active;
+	size_t timer;				/* Position in the timer heap plus one, 0 if not in it. */
+	uint64_t readyNs;			/* Time at which the quota allows a quantum. */
+	bool dirty;
+	struct gwClient* prev;
+	struct gwClient* next;
+	struct gwClient* activePrev;
+	struct gwClient* activeNext;
+	struct gwClient* nextDirty;
+} gwClient;
+
+static volatile sig_atomic_t running = 1;
+
+static uint8_t* ring = NULL;
+static size_t ringSize = 0;
+static atomic_uint_fast64_t ringHead;		/* Bytes taken by the clients. */
+static atomic_uint_fast64_t ringTail;		/* Bytes captured. */
+static pthread_mutex_t refillMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t refillCond = PTHREAD_COND_INITIALIZER;
+static int refillEvent = -1;
+static uint16_t devIndex = 0;
+static atomic_uint_fast64_t refillErrors;
+
+static int epollFd = -1;
+static gwClient* clients = NULL;			/* All the clients. */
+static gwClient* active = NULL;				/* Next client of the round robin. */
+static gwClient** timers = NULL;			/* Min heap of readyNs. */
+static size_t numTimers = 0;
+static gwClient* dirty = NULL;				/* Clients to sweep in this wakeup. */
+static int numClients = 0;
+static int maxClients = 4096;
+static double quotaRate = 0.0;				/* Bytes per second, 0 without quota. */
+static double quotaBurst = 0.0;
+static uint64_t servedBytes = 0;
+static int reserveFd = -1;					/* Spare descriptor for the accepts without descriptors. */
+static uint64_t listenPausedUntil = 0;
+static uint64_t rejectedClients = 0;
+
+static void _on_signal(int sig) {
+	(void)sig;
+	running = 0;
+}
+
+static uint64_t _now_ns(void) {
+
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/******************************************************************************
+** Ring buffer. One producer (refill thread) and one consumer (main thread).
+******************************************************************************/
+
+static void* _refill_thread(void* arg) {
+
+	(void)arg;
+
+	while(running) {
+
+		pthread_mutex_lock(&refillMutex);
+		while(running && ringSize - (atomic_load(&ringTail) - atomic_load(&ringHead)) < GW_REFILL_CHUNK) {
+			pthread_cond_wait(&refillCond, &refillMutex);
+		}
+		pthread_mutex_unlock(&refillMutex);
+
+		if(!running) {
+			break;
+		}
+
+		/* ringSize is a multiple of the chunk, so the chunk is contiguous. */
+		const uint64_t tail = atomic_load(&ringTail);
+		uint8_t* dst = ring + tail % ringSize;
+
+		if(window_get_random((uint32_t*)dst, GW_REFILL_CHUNK, devIndex) != 0) {
+			atomic_fetch_add(&refillErrors, 1);
+			usleep(100000);
+			continue;
+		}
+
+		atomic_store(&ringTail, tail + GW_REFILL_CHUNK);
+
+		const uint64_t one = 1;
+		if(write(refillEvent, &one, sizeof(one)) < 0) {
+			/* The main thread also polls with a timeout. */
+		}
+	}
+
+	return NULL;
+}
+
+static size_t _ring_available(void) {
+	return (size_t)(atomic_load(&ringTail) - atomic_load(&ringHead));
+}
+
+/* Moves n bytes of the ring to dst and wipes them. */
+static void _ring_take(uint8_t* dst, const size_t n) {
+
+	const uint64_t head = atomic_load(&ringHead);
+	const size_t idx = head % ringSize;
+	const size_t first = n < ringSize - idx ? n : ringSize - idx;
+
+	memcpy(dst, ring + idx, first);
+	memset(ring + idx, 0, first);
+	if(first < n) {
+		memcpy(dst + first, ring, n - first);
+		memset(ring, 0, n - first);
+	}
+
+	atomic_store(&ringHead, head + n);
+
+	pthread_mutex_lock(&refillMutex);
+	pthread_cond_signal(&refillCond);
+	pthread_mutex_unlock(&refillMutex);
+}
+
+/******************************************************************************
+** Clients.
+******************************************************************************/
+
+static void _update_events(gwClient* c) {
+
+	uint32_t events = 0;
+
+	if(c->inLen < GW_IN_CAP && !c->closing) {
+		events |= EPOLLIN;
+	}
+	if(c->outLen > c->outOff) {
+		events |= EPOLLOUT;
+	}
+
+	if(events != c->events) {
+		struct epoll_event ev;
+		ev.events = events;
+		ev.data.ptr = c;
+		epoll_ctl(epollFd, EPOLL_CTL_MOD, c->fd, &ev);
+		c->events = events;
+	}
+}
+
+static void _active_add(gwClient* c) {
+
+	if(active == NULL) {
+		c->activePrev = c;
+		c->activeNext = c;
+		active = c;
+	} else {
+		/* At the end of the current round. */
+		c->activeNext = active;
+		c->activePrev = active->activePrev;
+		active->activePrev->activeNext = c;
+		active->activePrev = c;
+	}
+	c->active = true;
+}
+
+static void _active_remove(gwClient* c) {
+
+	if(!c->active) {
+		return;
+	}
+
+	if(c->activeNext == c) {
+		active = NULL;
+	} else {
+		c->activePrev->activeNext = c->activeNext;
+		c->activeNext->activePrev = c->activePrev;
+		if(active == c) {
+			active = c->activeNext;
+		}
+	}
+	c->active = false;
+}
+
+static void _timer_swap(const size_t i, const size_t j) {
+
+	gwClient* t = timers[i];
+	timers[i] = timers[j];
+	timers[j] = t;
+	timers[i]->timer = i + 1;
+	timers[j]->timer = j + 1;
+}
+
+static void _timer_up(size_t i) {
+
+	while(i > 0 && timers[(i - 1) / 2]->readyNs > timers[i]->readyNs) {
+		_timer_swap(i, (i - 1) / 2);
+		i = (i - 1) / 2;
+	}
+}
+
+static void _timer_down(size_t i) {
+
+	for(;;) {
+		const size_t l = 2 * i + 1;
+		const size_t r = l + 1;
+		size_t m = i;
+
+		if(l < numTimers && timers[l]->readyNs < timers[m]->readyNs) {
+			m = l;
+		}
+		if(r < numTimers && timers[r]->readyNs < timers[m]->readyNs) {
+			m = r;
+		}
+		if(m == i) {
+			break;
+		}
+		_timer_swap(i, m);
+		i = m;
+	}
+}
+
+/* The heap has room for maxClients, so it never grows. */
+static void _timer_add(gwClient* c, const uint64_t readyNs) {
+
+	c->readyNs = readyNs;
+	timers[numTimers] = c;
+	c->timer = ++numTimers;
+	_timer_up(numTimers - 1);
+}
+
+static void _timer_remove(gwClient* c) {
+
+	if(c->timer == 0) {
+		return;
+	}
+
+	const size_t i = c->timer - 1;
+	c->timer = 0;
+
+	if(i < --numTimers) {
+		gwClient* last = timers[numTimers];
+		timers[i] = last;
+		last->timer = i + 1;
+		_timer_up(i);
+		_timer_down(last->timer - 1);
+	}
+}
+
+/* Puts the client in the active list if it can take bytes now and takes it
+ * out of the active list and of the timer heap if it can not. */
+static void _update_state(gwClient* c) {
+
+	if(c->serving && !c->closing && c->outLen < GW_OUT_CAP) {
+		if(!c->active && c->timer == 0) {
+			_active_add(c);
+		}
+	} else {
+		_active_remove(c);
+		_timer_remove(c);
+	}
+}
+
+/* The client is swept at the end of the wakeup. */
+static void _mark(gwClient* c) {
+
+	if(!c->dirty) {
+		c->dirty = true;
+		c->nextDirty = dirty;
+		dirty = c;
+	}
+}
+
+static void _refill_tokens(gwClient* c, const uint64_t now) {
+
+	c->tokens += quotaRate * (double)(now - c->tokensNs) / 1e9;
+	if(c->tokens > quotaBurst) {
+		c->tokens = quotaBurst;
+	}
+	c->tokensNs = now;
+}
+
+static void _close_client(gwClient* c) {
+
+	epoll_ctl(epollFd, EPOLL_CTL_DEL, c->fd, NULL);
+	close(c->fd);
+
+	_active_remove(c);
+	_timer_remove(c);
+
+	if(c->next == c) {
+		clients = NULL;
+	} else {
+		c->prev->next = c->next;
+		c->next->prev = c->prev;
+		if(clients == c) {
+			clients = c->next;
+		}
+	}
+
+	/* The output buffer may contain random numbers. */
+	memset(c->out, 0, sizeof(c->out));
+	free(c);
+	--numClients;
+}
+
+/* Returns -1 if the client has to be closed. */
+static int _flush(gwClient* c) {
+
+	while(c->outOff < c->outLen) {
+		const ssize_t n = send(c->fd, c->out + c->outOff, c->outLen - c->outOff, MSG_NOSIGNAL);
+		if(n < 0 && errno == EINTR) {
+			continue;
+		}
+		if(n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+			break;
+		}
+		if(n <= 0) {
+			return -1;
+		}
+		memset(c->out + c->outOff, 0, (size_t)n);
+		c->outOff += (size_t)n;
+	}
+
+	if(c->outOff == c->outLen) {
+		c->outOff = 0;
+		c->outLen = 0;
+	} else if(c->outOff > GW_OUT_CAP / 2) {
+		memmove(c->out, c->out + c->outOff, c->outLen - c->outOff);
+		memset(c->out + c->outLen - c->outOff, 0, c->outOff);
+		c->outLen -= c->outOff;
+		c->outOff = 0;
+	}
+
+	return 0;
+}
+
+static void _respond(gwClient* c, const int32_t status, const uint32_t nBytes) {
+
+	gatewayResponse res = { status, nBytes };
+	gw_encode_response(c->out + c->outLen, &res);
+	c->outLen += GW_HEADER_SIZE;
+}
+
+/* Starts the requests queued in the input buffer while there is room. */
+static void _next_requests(gwClient* c) {
+
+	size_t pos = 0;
+
+	while(!c->serving && !c->closing && c->inLen - pos >= GW_HEADER_SIZE
+			&& GW_OUT_CAP - c->outLen >= GW_HEADER_SIZE) {
+
+		gatewayRequest req;
+
+		if(gw_decode_request(c->in + pos, &req) != 0) {
+			c->closing = true;
+			break;
+		}
+		pos += GW_HEADER_SIZE;
+
+		switch(req.op) {
+		case GW_OP_RANDOM:
+			if(req.nBytes > GW_MAX_REQUEST) {
+				_respond(c, GW_STATUS_TOO_BIG, 0);
+			} else {
+				_respond(c, GW_STATUS_OK, req.nBytes);
+				c->serving = req.nBytes > 0;
+				c->remaining = req.nBytes;
+			}
+			break;
+		case GW_OP_DISCONNECT:
+			c->closing = true;
+			break;
+		default:
+			/* Raw data is not shared between clients. */
+			_respond(c, GW_STATUS_UNSUPPORTED, 0);
+			break;
+		}
+	}
+
+	if(pos > 0) {
+		memmove(c->in, c->in + pos, c->inLen - pos);
+		c->inLen -= pos;
+	}
+}
+
+/* The listen fd leaves epoll for GW_ACCEPT_BACKOFF_NS. */
+static void _pause_listen(const int listenFd, const uint64_t now) {
+
+	epoll_ctl(epollFd, EPOLL_CTL_DEL, listenFd, NULL);
+	listenPausedUntil = now + GW_ACCEPT_BACKOFF_NS;
+}
+
+/******************************************************************************
+** _accept_clients
+**
+** Accepts all the pending connections. The listen fd is level triggered, so a
+** connection that can not be accepted for lack of descriptors (EMFILE,
+** ENFILE) would wake up epoll again at once. The reserve descriptor is freed
+** to accept and close that connection. If there is no reserve, or the accept
+** still fails, the listen fd leaves epoll for a while.
+******************************************************************************/
+static void _accept_clients(const int listenFd, const uint64_t now) {
+
+	for(;;) {
+		const int fd = accept4(listenFd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+		if(fd < 0 && (errno == EINTR || errno == ECONNABORTED)) {
+			continue;
+		}
+		if(fd < 0 && (errno == EMFILE || errno == ENFILE)) {
+			int drop = -1;
+			int dropErrno = errno;
+
+			if(reserveFd >= 0) {
+				close(reserveFd);
+				drop = accept(listenFd, NULL, NULL);
+				dropErrno = errno;
+				if(drop >= 0) {
+					close(drop);
+					++rejectedClients;
+				}
+				reserveFd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+			}
+
+			if(reserveFd < 0 || (drop < 0 && dropErrno != EAGAIN && dropErrno != EWOULDBLOCK)) {
+				_pause_listen(listenFd, now);
+				break;
+			}
+			if(drop >= 0) {
+				continue;
+			}
+		}
+		if(fd < 0) {
+			break;
+		}
+
+		if(numClients >= maxClients) {
+			close(fd);
+			++rejectedClients;
+			continue;
+		}
+
+		gwClient* c = (gwClient*)calloc(1, sizeof(gwClient));
+		if(c == NULL) {
+			close(fd);
+			++rejectedClients;
+			continue;
+		}
+
+		const int one = 1;
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+		c->fd = fd;
+		c->tokens = quotaBurst;
+		c->tokensNs = now;
+		c->events = EPOLLIN;
+
+		struct epoll_event ev;
+		ev.events = EPOLLIN;
+		ev.data.ptr = c;
+		if(epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+			close(fd);
+			free(c);
+			continue;
+		}
+
+		if(clients == NULL) {
+			c->prev = c;
+			c->next = c;
+			clients = c;
+		} else {
+			c->next = clients;
+			c->prev = clients->prev;
+			clients->prev->next = c;
+			clients->prev = c;
+		}
+		++numClients;
+	}
+}
+
+static void _read_client(gwClient* c) {
+
+	while(c->inLen < GW_IN_CAP) {
+		const ssize_t n = recv(c->fd, c->in + c->inLen, GW_IN_CAP - c->inLen, 0);
+		if(n < 0 && errno == EINTR) {
+			continue;
+		}
+		if(n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+			break;
+		}
+		if(n <= 0) {
+			c->closing = true;
+			break;
+		}
+		c->inLen += (size_t)n;
+	}
+
+	_next_requests(c);
+}
+
+/******************************************************************************
+** _schedule
+**
+** Deficit round robin over the active list, the clients with a request in
+** progress and room in the output buffer. Each turn adds GW_QUANTUM to the
+** deficit of the client, and its requests are served in order while the
+** deficit lasts. A request bigger than the deficit is served in pieces, one
+** per turn. A client that can not take a byte for its quota goes to the
+** timer heap until the quota allows a quantum, and comes back at the end of
+** the round.
+******************************************************************************/
+static void _schedule(const uint64_t now) {
+
+	while(numTimers > 0 && timers[0]->readyNs <= now) {
+		gwClient* c = timers[0];
+		_timer_remove(c);
+		_active_add(c);
+	}
+
+	while(active != NULL && _ring_available() > 0) {
+
+		gwClient* c = active;
+		active = c->activeNext;
+
+		if(quotaRate > 0.0) {
+			_refill_tokens(c, now);
+			if(c->tokens < 1.0) {
+				const size_t quantum = c->remaining < GW_QUANTUM ? c->remaining : GW_QUANTUM;
+				_active_remove(c);
+				_timer_add(c, now + (uint64_t)(((double)quantum - c->tokens) / quotaRate * 1e9) + 1);
+				continue;
+			}
+		}
+
+		c->deficit += GW_QUANTUM;
+
+		while(c->serving && !c->closing && c->deficit > 0) {
+			const size_t space = GW_OUT_CAP - c->outLen;
+			const size_t available = _ring_available();
+			size_t grant = c->remaining < c->deficit ? c->remaining : c->deficit;
+
+			if(grant > space) {
+				grant = space;
+			}
+			if(grant > available) {
+				grant = available;
+			}
+			if(quotaRate > 0.0 && grant > (size_t)c->tokens) {
+				grant = (size_t)c->tokens;
+			}
+			if(grant == 0) {
+				break;
+			}
+
+			_ring_take(c->out + c->outLen, grant);
+			c->outLen += grant;
+			c->remaining -= (uint32_t)grant;
+			c->deficit -= grant;
+			c->tokens -= (double)grant;
+			c->served += grant;
+			servedBytes += grant;
+
+			if(c->remaining == 0) {
+				c->serving = false;
+				_next_requests(c);
+			}
+
+			if(_flush(c) != 0) {
+				c->closing = true;
+			}
+		}
+
+		/* An idle client starts the next round without deficit, and a client
+		 * with a full output buffer keeps one quantum at most, so it does not
+		 * pile up the turns it could not use. */
+		if(!c->serving) {
+			c->deficit = 0;
+		} else if(c->deficit > GW_QUANTUM) {
+			c->deficit = GW_QUANTUM;
+		}
+
+		_update_state(c);
+		_mark(c);
+	}
+}
+
+/* Closes the finished clients and updates the events of the rest, only for
+ * the clients touched in this wakeup. */
+static void _sweep_clients(void) {
+
+	while(dirty != NULL) {
+		gwClient* c = dirty;
+		dirty = c->nextDirty;
+		c->dirty = false;
+
+		if(c->closing && (c->outLen == c->outOff || _flush(c) != 0 || c->outLen == c->outOff)) {
+			_close_client(c);
+		} else {
+			_update_events(c);
+			_update_state(c);
+		}
+	}
+}
+
+/* Timeout of epoll_wait: the first timer of the heap or the end of the pause
+ * of the listen fd, at most one second. */
+static int _wait_ms(const uint64_t now) {
+
+	uint64_t until = now + 1000000000ULL;
+
+	if(numTimers > 0 && timers[0]->readyNs < until) {
+		until = timers[0]->readyNs;
+	}
+	if(listenPausedUntil != 0 && listenPausedUntil < until) {
+		until = listenPausedUntil;
+	}
+
+	return until > now ? (int)((until - now + 999999) / 1000000) : 0;
+}
+
+static int _listen(const int port) {
+
+	struct sockaddr_in addr;
+	const int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	const int one = 1;
+
+	if(fd < 0) {
+		return -1;
+	}
+
+	setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_ANY);
+	addr.sin_port = htons((uint16_t)port);
+
+	if(bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(fd, 1024) != 0) {
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+static void _usage(const char* name) {
+
+	printf("Usage: %s -s serverIP [-s serverIP ...] [options]\n", name);
+	puts("  -s ip       IP of a QRNG. It can be repeated.");
+	puts("  -S streams  Sessions with each QRNG (default 4).");
+	puts("  -p port     Port of the gateway (default 7733).");
+	puts("  -d index    Index of the device (default 0).");
+	puts("  -b MB       Size of the buffer of random numbers (default 64).");
+	puts("  -q bytes    Quota of each client in bytes/s (default no quota).");
+	puts("  -m clients  Maximum number of clients (default 4096).");
+	puts("  -u          Run even if the buffer can not be locked in memory.");
+	puts("  -v          Print statistics every 10 seconds.");
+}
+
+int main(int argc, char** argv) {
+
+	char* servers[GW_MAX_SERVERS];
+	int numServers = 0;
+	int port = GW_DEFAULT_PORT;
+	size_t bufferMB = 64;
+	bool verbose = false;
+	bool allowUnlocked = false;
+	windowOptions options = { 0, 0, 0, 0.0, false, 0, 0, NULL };
+	int opt;
+
+	while((opt = getopt(argc, argv, "s:S:p:d:b:q:m:uv")) != -1) {
+		switch(opt) {
+		case 's':
+			if(numServers < GW_MAX_SERVERS) {
+				servers[numServers++] = optarg;
+			}
+			break;
+		case 'S': options.streamsPerServer = atoi(optarg); break;
+		case 'p': port = atoi(optarg); break;
+		case 'd': devIndex = (uint16_t)atoi(optarg); break;
+		case 'b': bufferMB = strtoull(optarg, NULL, 10); break;
+		case 'q': quotaRate = strtod(optarg, NULL); break;
+		case 'm': maxClients = atoi(optarg); break;
+		case 'u': allowUnlocked = true; break;
+		case 'v': verbose = true; break;
+		default: _usage(argv[0]); return -1;
+		}
+	}
+
+	if(numServers == 0 || maxClients <= 0) {
+		_usage(argv[0]);
+		return -1;
+	}
+
+	/* One second of quota can be accumulated. */
+	quotaBurst = quotaRate > GW_QUANTUM ? quotaRate : GW_QUANTUM;
+
+	/* The worker processes are created before any thread. */
+	if(window_init(servers, numServers, &options) != 0) {
+		puts("Error connect.");
+		return -1;
+	}
+
+	ringSize = (bufferMB << 20) / GW_REFILL_CHUNK * GW_REFILL_CHUNK;
+	if(ringSize < 2 * GW_REFILL_CHUNK) {
+		ringSize = 2 * GW_REFILL_CHUNK;
+	}
+
+	/* The random numbers of the buffer can not go to swap. If the buffer is
+	 * over the limit of locked memory, it is halved down to two chunks. */
+	const size_t requestedSize = ringSize;
+	bool locked = false;
+	int lockErrno = 0;
+
+	for(;;) {
+		ring = (uint8_t*)calloc(ringSize, 1);
+		if(ring == NULL) {
+			break;
+		}
+		if(mlock(ring, ringSize) == 0) {
+			locked = true;
+			break;
+		}
+		lockErrno = errno;
+		if(ringSize == 2 * GW_REFILL_CHUNK) {
+			break;
+		}
+		free(ring);
+		ringSize = ringSize / 2 / GW_REFILL_CHUNK * GW_REFILL_CHUNK;
+		if(ringSize < 2 * GW_REFILL_CHUNK) {
+			ringSize = 2 * GW_REFILL_CHUNK;
+		}
+	}
+
+	if(ring != NULL && !locked) {
+		if(!allowUnlocked) {
+			printf("The buffer can not be locked in memory (%s). Raise the limit with ulimit -l or use -u.\n",
+					strerror(lockErrno));
+			free(ring);
+			window_release();
+			return -1;
+		}
+		puts("Warning: the buffer is not locked in memory, it can go to swap.");
+	} else if(ring != NULL && ringSize < requestedSize) {
+		printf("Buffer reduced to %zu MB by the limit of locked memory.\n", ringSize >> 20);
+	}
+
+	atomic_init(&ringHead, 0);
+	atomic_init(&ringTail, 0);
+	atomic_init(&refillErrors, 0);
+
+	timers = (gwClient**)calloc((size_t)maxClients, sizeof(gwClient*));
+	reserveFd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+	const int listenFd = _listen(port);
+	refillEvent = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	epollFd = epoll_create1(EPOLL_CLOEXEC);
+
+	if(ring == NULL || timers == NULL || reserveFd < 0 || listenFd < 0 || refillEvent < 0 || epollFd < 0) {
+		puts("Some error occurs");
+		window_release();
+		return -1;
+	}
+
+	struct epoll_event ev;
+	ev.events = EPOLLIN;
+	ev.data.ptr = NULL;
+	epoll_ctl(epollFd, EPOLL_CTL_ADD, listenFd, &ev);
+	ev.data.ptr = &refillEvent;
+	epoll_ctl(epollFd, EPOLL_CTL_ADD, refillEvent, &ev);
+
+	struct sigaction sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = _on_signal;
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+
+	pthread_t refill;
+	if(pthread_create(&refill, NULL, _refill_thread, NULL) != 0) {
+		puts("Some error occurs");
+		window_release();
+		return -1;
+	}
+
+	printf("Gateway listening on port %d\n", port);
+
+	struct epoll_event events[GW_MAX_EVENTS];
+	uint64_t lastStats = _now_ns();
+
+	while(running) {
+
+		const int n = epoll_wait(epollFd, events, GW_MAX_EVENTS, _wait_ms(_now_ns()));
+		const uint64_t now = _now_ns();
+
+		if(listenPausedUntil != 0 && now >= listenPausedUntil) {
+			ev.events = EPOLLIN;
+			ev.data.ptr = NULL;
+			epoll_ctl(epollFd, EPOLL_CTL_ADD, listenFd, &ev);
+			listenPausedUntil = 0;
+		}
+
+		for(int i = 0; i < n; ++i) {
+			if(events[i].data.ptr == NULL) {
+				if(listenPausedUntil == 0) {
+					_accept_clients(listenFd, now);
+				}
+			} else if(events[i].data.ptr == &refillEvent) {
+				uint64_t count;
+				if(read(refillEvent, &count, sizeof(count)) < 0) {
+					/* Nothing to read. */
+				}
+			} else {
+				gwClient* c = (gwClient*)events[i].data.ptr;
+
+				if(events[i].events & (EPOLLERR | EPOLLHUP)) {
+					c->closing = true;
+					c->outOff = c->outLen;
+				}
+				if(events[i].events & EPOLLIN) {
+					_read_client(c);
+				}
+				if((events[i].events & EPOLLOUT) && _flush(c) != 0) {
+					c->closing = true;
+					c->outOff = c->outLen;
+				}
+				_next_requests(c);
+				_update_state(c);
+				_mark(c);
+			}
+		}
+
+		_schedule(now);
+		_sweep_clients();
+
+		if(verbose && now - lastStats > GW_STATS_PERIOD_NS) {
+			windowStats ws;
+			windowTuning wt;
+			window_get_stats(&ws);
+			window_get_tuning(&wt);
+			printf("Clients %d (%llu rejected), served %llu bytes, buffer %zu/%zu, sessions %d (%d in use), "
+					"chunk %zu, %.1f MB/s upstream, refill errors %llu, last tuning %s\n",
+					numClients, (unsigned long long)rejectedClients, (unsigned long long)servedBytes,
+					_ring_available(), ringSize,
+					ws.streams, wt.activeStreams, wt.chunkBytes, ws.bandwidth / 1e6,
+					(unsigned long long)atomic_load(&refillErrors), window_tune_decision_name(wt.lastDecision));
+			lastStats = now;
+		}
+	}
+
+	puts("Stopping gateway");
+
+	pthread_mutex_lock(&refillMutex);
+	pthread_cond_signal(&refillCond);
+	pthread_mutex_unlock(&refillMutex);
+	pthread_join(refill, NULL);
+
+	while(clients != NULL) {
+		_close_client(clients);
+	}
+	free(timers);
+	close(reserveFd);
+	close(listenFd);
+	close(epollFd);
+	close(refillEvent);
+
+	memset(ring, 0, ringSize);
+	munlock(ring, ringSize);
+	free(ring);
+
+	window_release();
+
+	return 0;
+}
@@ -0,0 +1,131 @@
+/*
+ ============================================================================
+ Name        : QusideQRNG_MockAdmin.c
+ Author      : Alvaro Velasco Garcia, Heriberto J. Diaz
+ Created on  : 18 oct. 2022
+ Version     : 0.1
+ Copyright   : Copyright (C) 2022 QUSIDE TECHNOLOGIES - All Rights Reserved.
+               Unauthorized copying of this file, via any medium is
+               strictly prohibited.
+ Description : Mock of the admin mode functions used by the tests. It is
+               built with QusideQRNG_MockUser.c as the admin mode library.
+
+               The server "calib:ms" simulates a QRNG whose set_calibration
+               takes ms milliseconds. After a calibration the status is
+               CALIBRATING for the first polls and then CALIB_SUCCED, and a
+               process that did not calibrate sees CALIB_SUCCED, as a QRNG
+               that finished the calibration of another session. The
+               thresholds of the server "checkfail" are out of range.
+
+               The monitors return fixed values: MOCK_TEMPERATURE, and
+               MOCK_CHANNELS channels of the array monitors with the value
+               of the channel index.
+ ============================================================================
+ */
+
+#include <quside_QRNG_admin.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define MOCK_CALIBRATING_POLLS		3
+#define MOCK_TEMPERATURE			31.25f
+#define MOCK_CHANNELS				2
+
+/* Server of the last connectToServer, set by the user mode mock. */
+extern char mockServer[64];
+
+static bool mockCalibrating = false;
+static int mockPolls = 0;
+
+int set_calibration(const uint16_t devInd) {
+
+	const long ms = strncmp(mockServer, "calib:", 6) == 0 ? strtol(mockServer + 6, NULL, 10) : 0;
+	const struct timespec t = { ms / 1000, (ms % 1000) * 1000000L };
+
+	(void)devInd;
+	nanosleep(&t, NULL);
+	mockCalibrating = true;
+	mockPolls = 0;
+	return 0;
+}
+
+int set_calibration_with_fixed_VTC(const uint16_t devInd) {
+	return set_calibration(devInd);
+}
+
+int get_calibration_status(const uint16_t devInd, calibrationStatus* status) {
+
+	(void)devInd;
+	if(mockCalibrating && ++mockPolls <= MOCK_CALIBRATING_POLLS) {
+		*status = CALIBRATING;
+	} else {
+		mockCalibrating = false;
+		*status = CALIB_SUCCED;
+	}
+	return 0;
+}
+
+int update_thresholds(const uint16_t devInd) {
+
+	(void)devInd;
+	return 0;
+}
+
+int check_thresholds(const uint16_t devInd) {
+
+	(void)devInd;
+	return strcmp(mockServer, "checkfail") == 0 ? -1 : 0;
+}
+
+/* Array of a monitor, freed by the caller as the library ones. */
+static int _mock_array(float** values, int* n) {
+
+	*values = (float*)malloc(MOCK_CHANNELS * sizeof(float));
+	if(*values == NULL) {
+		return -1;
+	}
+	for(int i = 0; i < MOCK_CHANNELS; ++i) {
+		(*values)[i] = (float)i;
+	}
+	*n = MOCK_CHANNELS;
+	return 0;
+}
+
+int monitor_read_temperature(const uint16_t devInd, float* temp) {
+
+	(void)devInd;
+	*temp = MOCK_TEMPERATURE;
+	return 0;
+}
+
+int monitor_read_optical_power(const uint16_t devInd, float** opPwr, int* nOpPwrs) {
+
+	(void)devInd;
+	return _mock_array(opPwr, nOpPwrs);
+}
+
+int monitor_read_bias_monitor(const uint16_t devInd, float** bias, int* nBias) {
+
+	(void)devInd;
+	return _mock_array(bias, nBias);
+}
+
+int get_laser_temperatures(const uint16_t devInd, float** temp, int* nTemps) {
+
+	(void)devInd;
+	return _mock_array(temp, nTemps);
+}
+
+int get_Vcomp(const uint16_t devInd, float* vComp) {
+
+	(void)devInd;
+	*vComp = 1.0f;
+	return 0;
+}
+
+int quality_Qfactor(const uint16_t devInd, float* qFactor) {
+
+	(void)devInd;
+	*qFactor = 1.0f;
+	return 0;
+}
@@ -0,0 +1,100 @@
+/*
+ ============================================================================
+ Name        : QusideQRNG_MockUser.c
+ Author      : Alvaro Velasco Garcia, Heriberto J. Diaz
+ Created on  : 18 oct. 2022
+ Version     : 0.1
+ Copyright   : Copyright (C) 2022 QUSIDE TECHNOLOGIES - All Rights Reserved.
+               Unauthorized copying of this file, via any medium is
+               strictly prohibited.
+ Description : Mock of the user mode library used by the tests, so they run
+               without a QRNG. The captures are filled with a xorshift
+               generator, a different sequence for each thread.
+
+               The server "stall:ms" simulates a QRNG that answers late:
+               every capture of the process connected to it takes ms
+               milliseconds. The server "down" can not be connected, and
+               every capture of the server "fail" fails.
+
+               mockLastSlot and mockLastBytes keep the buffer of the last
+               capture, so a test can check that it was wiped, and
+               mockServer the argument of the last connectToServer, for the
+               mock of the admin mode library.
+ ============================================================================
+ */
+
+#include <quside_QRNG_user.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+
+static uint16_t mockDevices[2] = { 101, 202 };
+static uint64_t mockSeed = 1;
+static __thread uint64_t mockState = 0;
+static long mockStallMs = 0;
+static bool mockFail = false;
+
+uint8_t* mockLastSlot = NULL;
+size_t mockLastBytes = 0;
+char mockServer[64] = "";
+
+int connectToServer(char* serverIP) {
+
+	if(serverIP != NULL && strcmp(serverIP, "down") == 0) {
+		return -1;
+	}
+	strncpy(mockServer, serverIP != NULL ? serverIP : "", sizeof(mockServer) - 1);
+	mockStallMs = serverIP != NULL && strncmp(serverIP, "stall:", 6) == 0 ? strtol(serverIP + 6, NULL, 10) : 0;
+	mockFail = serverIP != NULL && strcmp(serverIP, "fail") == 0;
+	return 0;
+}
+
+void disconnectServer(void) {
+}
+
+void reset(void) {
+}
+
+uint16_t find_boards(void) {
+	return 2;
+}
+
+void get_boards(uint16_t** devIDs, uint16_t* numDevs) {
+	*devIDs = mockDevices;
+	*numDevs = 2;
+}
+
+int find_device(const uint16_t devID) {
+	return devID == mockDevices[0] ? 0 : devID == mockDevices[1] ? 1 : -1;
+}
+
+int get_random(uint32_t* mem_slot, const size_t Nuint32, const uint16_t devInd) {
+
+	uint8_t* bytes = (uint8_t*)mem_slot;
+
+	(void)devInd;
+	mockLastSlot = bytes;
+	mockLastBytes = Nuint32;
+	if(mockFail) {
+		return -1;
+	}
+	if(mockStallMs > 0) {
+		const struct timespec stall = { mockStallMs / 1000, (mockStallMs % 1000) * 1000000L };
+		nanosleep(&stall, NULL);
+	}
+	if(mockState == 0) {
+		mockState = __atomic_fetch_add(&mockSeed, 1, __ATOMIC_RELAXED) * 0x9E3779B97F4A7C15ULL;
+	}
+
+	for(size_t i = 0; i < Nuint32; ++i) {
+		mockState ^= mockState << 13;
+		mockState ^= mockState >> 7;
+		mockState ^= mockState << 17;
+		bytes[i] = (uint8_t)mockState;
+	}
+	return 0;
+}
+
+int get_raw(uint32_t* mem_slot, const size_t Nuint32, const uint16_t devInd) {
+	return get_random(mem_slot, Nuint32, devInd);
+}
@@ -0,0 +1,470 @@
+/*
+ ============================================================================
+ Name        : QusideQRNG_TestAudit.c
+ Author      : Alvaro Velasco Garcia, Heriberto J. Diaz
+ Created on  : 18 oct. 2022
+ Version     : 0.1
+ Copyright   : Copyright (C) 2022 QUSIDE TECHNOLOGIES - All Rights Reserved.
+               Unauthorized copying of this file, via any medium is
+               strictly prohibited.
+ Description : Checks audit_verify with logs written by several threads and
+               with altered copies of them: a changed byte, logs cut at a
+               record boundary (also sealed again, only found with the head
+               file), an incomplete record and blocks recorded twice, also
+               several blocks with the same prefix of the hash. Then the
+               batches that can not be written (a limit of the file size),
+               the throughput of the captures with and without the audit,
+               and the speed of the verifier. Returns 0 if all the checks
+               pass.
+ ============================================================================
+ */
+
+#include "quside_QRNG_audit.h"
+#include "quside_QRNG_sha256.h"
+#include "quside_QRNG_combiner.h"
+#include <quside_QRNG_user.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <endian.h>
+#include <math.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+
+#define THREADS				4
+#define BLOCKS				250			/* Blocks recorded by each thread. */
+#define BLOCK_BYTES			512
+#define RECORDS				(THREADS * BLOCKS)
+#define CUT					600			/* Records kept by the cut logs. */
+#define SPEED_BLOCK			16384		/* Bytes of each capture, 1 ms each. */
+#define SPEED_CAPTURES		200
+#define SPEED_ROUNDS		3
+#define SPEED_OVERHEAD		0.05		/* Throughput that the audit can cost. */
+#define VERIFY_RECORDS		100000
+
+static int failures = 0;
+static char dir[] = "/tmp/qaudit.XXXXXX";
+
+static void _check(const bool ok, const char* what) {
+
+	printf("%s %s\n", ok ? "PASS" : "FAIL", what);
+	if(!ok) {
+		++failures;
+	}
+}
+
+static void _path(char* out, const char* name) {
+	snprintf(out, 256, "%s/%s", dir, name);
+}
+
+static double _seconds_since(const struct timespec* t0) {
+
+	struct timespec t1;
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	return (double)(t1.tv_sec - t0->tv_sec) + (double)(t1.tv_nsec - t0->tv_nsec) / 1e9;
+}
+
+/* Records a block with a text, so no two blocks are the same. */
+static int _record_text(const char* text, const int i) {
+
+	uint8_t block[64];
+
+	memset(block, 0, sizeof(block));
+	snprintf((char*)block, sizeof(block), "%s %d", text, i);
+	return audit_record(block, sizeof(block), 0, false);
+}
+
+/* Seconds of SPEED_CAPTURES captures, through the audit or not. */
+static double _capture_time(const bool audited) {
+
+	static uint32_t buf[SPEED_BLOCK / 4];
+	struct timespec t0;
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for(int i = 0; i < SPEED_CAPTURES; ++i) {
+		if(audited) {
+			audit_get_random(buf, SPEED_BLOCK, 0);
+		} else {
+			combiner_get_random(buf, SPEED_BLOCK, 0);
+		}
+	}
+	return _seconds_since(&t0);
+}
+
+/* Size of a log with the records of its head. The writer can be trying the
+ * batch again, so it is looked at a few times. */
+static bool _cut_to_head(const char* path) {
+
+	struct stat st;
+	auditHead h;
+
+	for(int tries = 0; tries < 10; ++tries) {
+		audit_get_head(&h);
+		if(stat(path, &st) == 0 && (uint64_t)st.st_size == AUDIT_HEADER_SIZE + h.records * AUDIT_RECORD_SIZE) {
+			return true;
+		}
+		usleep(1000);
+	}
+	return false;
+}
+
+/* Limit of the size of the files written, in records of a log. */
+static void _limit_records(const double records) {
+
+	struct rlimit limit;
+
+	getrlimit(RLIMIT_FSIZE, &limit);
+	limit.rlim_cur = records > 0.0 ? (rlim_t)(AUDIT_HEADER_SIZE + records * AUDIT_RECORD_SIZE) : limit.rlim_max;
+	setrlimit(RLIMIT_FSIZE, &limit);
+}
+
+/* Reads a whole file. */
+static uint8_t* _load(const char* path, size_t* size) {
+
+	FILE* f = fopen(path, "rb");
+	if(f == NULL) {
+		return NULL;
+	}
+	fseek(f, 0, SEEK_END);
+	*size = (size_t)ftell(f);
+	fseek(f, 0, SEEK_SET);
+	uint8_t* data = (uint8_t*)malloc(*size + 1);
+	if(data != NULL && fread(data, 1, *size, f) != *size) {
+		free(data);
+		data = NULL;
+	}
+	fclose(f);
+	return data;
+}
+
+static void _save(const char* path, const uint8_t* data, const size_t size) {
+
+	FILE* f = fopen(path, "wb");
+	fwrite(data, 1, size, f);
+	fclose(f);
+}
+
+/* Verifies a file, with the head file given or without anchor. */
+static int _verify(const char* path, const char* headFile, auditReport* report) {
+
+	auditHead anchor;
+
+	if(headFile == NULL) {
+		return audit_verify(path, 3, report);
+	}
+	if(audit_load_head(headFile, &anchor) != 0) {
+		return -1;
+	}
+	return audit_verify_anchor(path, 3, &anchor, report);
+}
+
+/* Chains the record i of a log to the previous one, as the writer does. */
+static void _link(uint8_t* log, const uint64_t i) {
+
+	uint8_t* rec = log + AUDIT_HEADER_SIZE + i * AUDIT_RECORD_SIZE;
+	uint8_t prev[SHA256_DIGEST_SIZE];
+	sha256Ctx ctx;
+
+	if(i == 0) {
+		sha256(log, AUDIT_HEADER_SIZE, prev);
+	} else {
+		memcpy(prev, rec - AUDIT_RECORD_SIZE + 72, SHA256_DIGEST_SIZE);
+	}
+	sha256_init(&ctx);
+	sha256_update(&ctx, prev, SHA256_DIGEST_SIZE);
+	sha256_update(&ctx, rec, 72);
+	sha256_final(&ctx, rec + 72);
+}
+
+/* Writes the record i of a log with the fields the verifier checks. */
+static void _craft(uint8_t* log, const uint64_t i, const uint64_t offset, const uint32_t length,
+		const uint16_t flags, const uint8_t* dataHash) {
+
+	uint8_t* rec = log + AUDIT_HEADER_SIZE + i * AUDIT_RECORD_SIZE;
+	const uint64_t seq = htole64(i);
+	const uint64_t off = htole64(offset);
+	const uint32_t len = htole32(length);
+	const uint16_t fl = htole16(flags);
+
+	memset(rec, 0, AUDIT_RECORD_SIZE);
+	memcpy(rec, &seq, 8);
+	memcpy(rec + 16, &off, 8);
+	memcpy(rec + 24, &len, 4);
+	memcpy(rec + 30, &fl, 2);
+	if(dataHash != NULL) {
+		memcpy(rec + 40, dataHash, SHA256_DIGEST_SIZE);
+	}
+	_link(log, i);
+}
+
+static void* _producer(void* arg) {
+
+	const int id = (int)(intptr_t)arg;
+	uint8_t block[BLOCK_BYTES];
+
+	for(int b = 0; b < BLOCKS; ++b) {
+		memset(block, 0, sizeof(block));
+		snprintf((char*)block, sizeof(block), "thread %d block %d", id, b);
+		audit_record(block, sizeof(block), 0, false);
+	}
+	return NULL;
+}
+
+int main(void) {
+
+	char logPath[256], headPath[256], midHead[256], copy[256];
+	auditOptions options;
+	auditReport report;
+	auditHead head, loaded;
+	pthread_t threads[THREADS];
+	size_t size, headSize;
+
+	if(mkdtemp(dir) == NULL) {
+		puts("FAIL mkdtemp");
+		return 1;
+	}
+	_path(logPath, "qrng.audit");
+	_path(headPath, "qrng.head");
+	_path(midHead, "mid.head");
+	_path(copy, "copy.audit");
+
+	memset(&options, 0, sizeof(options));
+	options.serverIP = "127.0.0.1";
+	options.serverVersion = "2.0.1";
+	options.batchRecords = 64;
+	options.headPath = headPath;
+
+	if(audit_open(logPath, &options) != 0) {
+		puts("FAIL audit_open");
+		return 1;
+	}
+	for(int t = 0; t < THREADS; ++t) {
+		pthread_create(&threads[t], NULL, _producer, (void*)(intptr_t)t);
+	}
+	for(int t = 0; t < THREADS; ++t) {
+		pthread_join(threads[t], NULL);
+	}
+
+	/* Head exported in the middle of the log, when some batches are written. */
+	uint8_t* mid = NULL;
+	for(int tries = 0; tries < 100 && mid == NULL; ++tries) {
+		audit_get_head(&head);
+		if(head.records > 0) {
+			mid = _load(headPath, &headSize);
+		} else {
+			usleep(10000);
+		}
+	}
+	if(mid != NULL) {
+		_save(midHead, mid, headSize);
+		free(mid);
+	}
+
+	audit_close();
+	audit_get_head(&head);
+
+	int ret = _verify(logPath, NULL, &report);
+	_check(ret == 0 && report.records == RECORDS + 1 && report.bytes == (uint64_t)RECORDS * BLOCK_BYTES
+			&& !report.unclosed, "log written by several threads");
+	_check(audit_load_head(headPath, &loaded) == 0 && loaded.records == head.records
+			&& memcmp(loaded.chainHash, head.chainHash, AUDIT_HASH_SIZE) == 0
+			&& memcmp(report.head.chainHash, head.chainHash, AUDIT_HASH_SIZE) == 0, "head file of the closed log");
+	_check(_verify(logPath, headPath, &report) == 0 && _verify(logPath, midHead, &report) == 0,
+			"log with the final head and with a head of the middle");
+
+	uint8_t* log = _load(logPath, &size);
+	if(log == NULL) {
+		puts("FAIL read log");
+		return 1;
+	}
+	uint8_t* work = (uint8_t*)malloc(size + AUDIT_RECORD_SIZE);
+
+	/* A changed byte of the length of record 500. */
+	memcpy(work, log, size);
+	work[AUDIT_HEADER_SIZE + 500 * AUDIT_RECORD_SIZE + 24] ^= 0x01;
+	_save(copy, work, size);
+	ret = _verify(copy, NULL, &report);
+	_check(ret == 1 && report.badLinks == 1 && report.firstBad == 500, "changed byte");
+
+	/* Cut at a record boundary, without the record of audit_close. */
+	const size_t cutSize = AUDIT_HEADER_SIZE + CUT * AUDIT_RECORD_SIZE;
+	_save(copy, log, cutSize);
+	ret = _verify(copy, NULL, &report);
+	_check(ret == 1 && report.unclosed && report.badLinks == 0 && !report.truncated, "log cut at a record boundary");
+
+	/* Cut and sealed again: the chain is right, only the head finds it. */
+	memcpy(work, log, cutSize);
+	const uint64_t lastOffset = le64toh(*(const uint64_t*)(log + AUDIT_HEADER_SIZE + (CUT - 1) * AUDIT_RECORD_SIZE + 16));
+	_craft(work, CUT, lastOffset + BLOCK_BYTES, 0, AUDIT_FLAG_CLOSE, NULL);
+	_save(copy, work, cutSize + AUDIT_RECORD_SIZE);
+	_check(_verify(copy, NULL, &report) == 0, "log cut and sealed again without head");
+	ret = _verify(copy, headPath, &report);
+	_check(ret == 1 && report.badAnchor, "log cut and sealed again with the head file");
+
+	/* An incomplete record at the end. */
+	_save(copy, log, size - 40);
+	ret = _verify(copy, NULL, &report);
+	_check(ret == 1 && report.truncated, "incomplete record");
+
+	free(work);
+	free(log);
+
+	/* The same block recorded twice. */
+	_path(logPath, "dup.audit");
+	options.headPath = NULL;
+	uint8_t block[BLOCK_BYTES];
+	memset(block, 0x5A, sizeof(block));
+	audit_open(logPath, &options);
+	audit_record(block, sizeof(block), 0, false);
+	block[0] = 0;
+	audit_record(block, sizeof(block), 0, false);
+	block[0] = 0x5A;
+	audit_record(block, sizeof(block), 0, false);
+	audit_close();
+	ret = _verify(logPath, NULL, &report);
+	_check(ret == 1 && report.duplicates == 1 && report.firstBad == 2, "block recorded twice");
+
+	/* Hashes A, B, C, A with the same prefix: A is found twice although B and
+	 * C are between them in the run. */
+	log = _load(logPath, &size);
+	work = (uint8_t*)calloc(1, AUDIT_HEADER_SIZE + 5 * AUDIT_RECORD_SIZE);
+	memcpy(work, log, AUDIT_HEADER_SIZE);
+	uint8_t hashes[3][SHA256_DIGEST_SIZE];
+	for(int h = 0; h < 3; ++h) {
+		memset(hashes[h], 0xC3, SHA256_DIGEST_SIZE);
+		hashes[h][SHA256_DIGEST_SIZE - 1] = (uint8_t)h;
+	}
+	_craft(work, 0, 0, BLOCK_BYTES, 0, hashes[0]);
+	_craft(work, 1, BLOCK_BYTES, BLOCK_BYTES, 0, hashes[1]);
+	_craft(work, 2, 2 * BLOCK_BYTES, BLOCK_BYTES, 0, hashes[2]);
+	_craft(work, 3, 3 * BLOCK_BYTES, BLOCK_BYTES, 0, hashes[0]);
+	_craft(work, 4, 4 * BLOCK_BYTES, 0, AUDIT_FLAG_CLOSE, NULL);
+	_path(copy, "prefix.audit");
+	_save(copy, work, AUDIT_HEADER_SIZE + 5 * AUDIT_RECORD_SIZE);
+	ret = _verify(copy, NULL, &report);
+	_check(ret == 1 && report.duplicates == 1 && report.firstBad == 3 && report.badLinks == 0,
+			"duplicate inside a run of the same prefix");
+
+	free(work);
+	free(log);
+
+	/* A batch that goes over the limit of the file size is written in part:
+	 * the log is cut back to its head, the new blocks are refused and the
+	 * batch is written again when there is room. */
+	auditStats st;
+	int accepted = 0, refused = 0;
+	signal(SIGXFSZ, SIG_IGN);
+	_path(logPath, "efbig.audit");
+	options.flushMs = 10;
+	audit_open(logPath, &options);
+	_limit_records(100.5);
+	for(int i = 0; i < 5000 && refused == 0; ++i) {
+		if(_record_text("efbig", i) == 0) {
+			++accepted;
+		} else {
+			++refused;
+		}
+		if(i % 16 == 15) {
+			usleep(2000);
+		}
+	}
+	usleep(50000);
+	audit_get_stats(&st);
+	_check(refused == 1 && st.writeErrors >= 2 && _cut_to_head(logPath) && _record_text("refused", 0) == -1,
+			"failed batch cut from the log and tried again");
+
+	_limit_records(0.0);
+	int again = -1;
+	for(int tries = 0; tries < 100 && again != 0; ++tries) {
+		usleep(10000);
+		again = _record_text("after", tries);
+	}
+	accepted += again == 0;
+	audit_close();
+	audit_get_stats(&st);
+	ret = _verify(logPath, NULL, &report);
+	printf("     %d blocks accepted, %llu write errors\n", accepted, (unsigned long long)st.writeErrors);
+	_check(again == 0 && st.lostRecords == 0 && ret == 0 && report.records == (uint64_t)accepted + 1,
+			"records of the failed batch written when there is room");
+
+	/* The limit stays until the log is closed: the queued records are lost
+	 * and the log is not sealed, but its chain is right. */
+	_path(logPath, "lost.audit");
+	audit_open(logPath, &options);
+	_limit_records(10.5);
+	for(int i = 0; i < 8; ++i) {
+		_record_text("kept", i);
+	}
+	usleep(50000);
+	for(int i = 0; i < 64; ++i) {
+		_record_text("lost", i);
+	}
+	usleep(50000);
+	audit_close();
+	_limit_records(0.0);
+	audit_get_stats(&st);
+	ret = _verify(logPath, NULL, &report);
+	_check(st.lostRecords == 64 && ret == 1 && report.unclosed && report.records == 8 && report.badLinks == 0
+			&& !report.truncated, "records lost at audit_close");
+
+	/* Throughput of captures of a QRNG that gives SPEED_BLOCK bytes per ms,
+	 * the best of alternate rounds with and without the audit. */
+	double plain = INFINITY, audited = INFINITY;
+	connectToServer("stall:1");
+	combiner_init(SPEED_BLOCK);
+	_path(logPath, "speed.audit");
+	options.flushMs = 0;
+	audit_open(logPath, &options);
+	for(int r = 0; r < SPEED_ROUNDS; ++r) {
+		plain = fmin(plain, _capture_time(false));
+		audited = fmin(audited, _capture_time(true));
+	}
+	audit_close();
+	combiner_release();
+	const double mb = (double)SPEED_CAPTURES * SPEED_BLOCK / 1e6;
+	printf("     %.1f MB/s without audit, %.1f MB/s audited (%.1f%% less)\n", mb / plain, mb / audited,
+			100.0 * (1.0 - plain / audited));
+	_check(audited < plain * (1.0 + SPEED_OVERHEAD), "audit costs less than 5% of the throughput");
+
+	/* Speed of the verifier, with one thread and with all the CPUs. */
+	_path(logPath, "verify.audit");
+	audit_open(logPath, &options);
+	for(int i = 0; i < VERIFY_RECORDS; ++i) {
+		_record_text("verify", i);
+	}
+	audit_close();
+	struct timespec t0;
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	ret = audit_verify(logPath, 1, &report);
+	const double one = _seconds_since(&t0);
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	const int retAll = audit_verify(logPath, 0, &report);
+	const double all = _seconds_since(&t0);
+	const long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	printf("     %.2f M records/s with 1 thread, %.2f M records/s with %ld CPUs\n", VERIFY_RECORDS / one / 1e6,
+			VERIFY_RECORDS / all / 1e6, cpus);
+	_check(ret == 0 && retAll == 0 && report.records == VERIFY_RECORDS + 1, "verify of a long log");
+	if(cpus >= 4) {
+		_check(all < 0.6 * one, "verifier faster with all the CPUs");
+	} else {
+		puts("SKIP verifier faster with all the CPUs (less than 4 CPUs)");
+	}
+
+	/* The files are removed only if all the checks pass. */
+	if(failures == 0) {
+		const char* names[] = { "qrng.audit", "qrng.head", "mid.head", "copy.audit", "dup.audit", "prefix.audit",
+				"efbig.audit", "lost.audit", "speed.audit", "verify.audit" };
+		char path[256];
+		for(size_t i = 0; i < sizeof(names) / sizeof(names[0]); ++i) {
+			_path(path, names[i]);
+			unlink(path);
+		}
+		rmdir(dir);
+	}
+
+	return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,117 @@
+/*
+ ============================================================================
+ Name        : QusideQRNG_TestCalibration.c
+ Author      : Alvaro Velasco Garcia, Heriberto J. Diaz
+ Created on  : 18 oct. 2022
+ Version     : 0.1
+ Copyright   : Copyright (C) 2022 QUSIDE TECHNOLOGIES - All Rights Reserved.
+               Unauthorized copying of this file, via any medium is
+               strictly prohibited.
+ Description : Checks the calibration of the devices with the mock of the
+               admin mode library: a calibration that succeeds, and one
+               that takes longer than its timeout. That device stays out of
+               rotation while the captures go on, and it only comes back
+               with calibration_recover when the thresholds are checked.
+               Returns 0 if all the checks pass.
+ ============================================================================
+ */
+
+#include "quside_QRNG_calibration.h"
+#include "quside_QRNG_window.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define CAPTURE_BYTES		65536
+#define SLOW_CALIBRATION_MS	3000		/* Calibration of the second QRNG. */
+
+static int failures = 0;
+static uint8_t buffer[CAPTURE_BYTES];
+
+static void _check(const bool ok, const char* what) {
+
+	printf("%s %s\n", ok ? "PASS" : "FAIL", what);
+	if(!ok) {
+		++failures;
+	}
+}
+
+static double _ms_since(const struct timespec* t0) {
+
+	struct timespec t1;
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	return (double)(t1.tv_sec - t0->tv_sec) * 1e3 + (double)(t1.tv_nsec - t0->tv_nsec) / 1e6;
+}
+
+static int _devices(void) {
+
+	windowStats ws;
+	window_get_stats(&ws);
+	return ws.devices;
+}
+
+/* Calibration sessions again, with the second QRNG named second. */
+static int _restart_calibration(char* second) {
+
+	char* servers[2] = { "calib:50", second };
+
+	calibration_release();
+	return calibration_init(servers, 2);
+}
+
+int main(void) {
+
+	char slow[32];
+	char* servers[2] = { "calib:50", slow };
+	windowOptions options;
+	calibrationOptions quick = { false, 5, 20 };
+	calibrationOptions strict = { false, 1, 20 };
+	struct timespec t0;
+
+	snprintf(slow, sizeof(slow), "calib:%d", SLOW_CALIBRATION_MS);
+	memset(&options, 0, sizeof(options));
+	options.streamsPerServer = 1;
+	options.chunkBytes = 16384;
+
+	if(window_init(servers, 2, &options) != 0 || calibration_init(servers, 2) != 0) {
+		puts("FAIL init");
+		return 1;
+	}
+	const int devices = _devices();
+
+	_check(calibration_start(0, 0, &quick) == 0 && calibration_wait(0) == 0
+			&& calibration_get_state(0, 0) == CALIB_STATE_ACTIVE && _devices() == devices,
+			"calibration that succeeds goes back to rotation");
+
+	/* The calibration takes longer than its timeout: the worker is stopped. */
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	const int started = calibration_start(1, 1, &strict);
+	const bool captures = window_get_random((uint32_t*)buffer, sizeof(buffer), 1) == 0;
+	const int waited = calibration_wait(1);
+	const double ms = _ms_since(&t0);
+
+	printf("     timeout found in %.0f ms\n", ms);
+	_check(started == 0 && waited == -1 && ms < SLOW_CALIBRATION_MS, "timeout of the calibration");
+	_check(calibration_get_state(1, 1) == CALIB_STATE_FAILED && _devices() == devices - 1,
+			"device of the timeout out of rotation");
+	_check(captures && window_get_random((uint32_t*)buffer, sizeof(buffer), 1) == 0,
+			"captures go on with the other devices");
+	_check(calibration_start(1, 0, &quick) == -1 && calibration_recover(1, 1) == -1,
+			"QRNG without worker not calibrated nor recovered");
+
+	/* A new worker whose thresholds are out of range does not bring it back. */
+	_check(_restart_calibration("checkfail") == 0 && calibration_get_state(1, 1) == CALIB_STATE_FAILED
+			&& calibration_recover(1, 1) == -1 && calibration_get_state(1, 1) == CALIB_STATE_FAILED
+			&& _devices() == devices - 1, "recover refused when the thresholds fail");
+
+	_check(_restart_calibration("calib:0") == 0 && calibration_recover(1, 1) == 0
+			&& calibration_get_state(1, 1) == CALIB_STATE_ACTIVE && _devices() == devices,
+			"recover after the status and the thresholds are checked");
+	_check(calibration_recover(1, 1) == -1, "recover only for failed devices");
+
+	calibration_release();
+	window_release();
+
+	return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,154 @@
+/*
+ ============================================================================
+ Name        : QusideQRNG_TestCombiner.c
+ Author      : Alvaro Velasco Garcia, Heriberto J. Diaz
+ Created on  : 18 oct. 2022
+ Version     : 0.1
+ Copyright   : Copyright (C) 2022 QUSIDE TECHNOLOGIES - All Rights Reserved.
+               Unauthorized copying of this file, via any medium is
+               strictly prohibited.
+ Description : Checks the combiner with many threads against a QRNG that
+               takes 1 ms per capture, so the requests are merged: each
+               caller receives exactly its bytes, no two callers receive the
+               same bytes, the merged buffer is wiped, a failed capture does
+               not write the callers, and the statistics count the merges.
+               Returns 0 if all the checks pass.
+ ============================================================================
+ */
+
+#include "quside_QRNG_combiner.h"
+#include <quside_QRNG_user.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define THREADS				8
+#define REQUESTS			40			/* Requests of each thread. */
+#define MAX_REQUEST			1000
+#define GUARD				16			/* Bytes after each request that can not change. */
+#define BATCH				8192
+#define SENTINEL			0xA5
+#define PREFIX				16			/* Bytes compared to find repeated data. */
+
+/* Buffer of the last capture of the mock. */
+extern uint8_t* mockLastSlot;
+extern size_t mockLastBytes;
+
+typedef struct {
+	uint8_t prefix[PREFIX];
+} slicePrefix;
+
+static int failures = 0;
+static slicePrefix prefixes[THREADS * REQUESTS];
+static uint64_t requestedBytes = 0;
+static bool overflow = false;
+static bool unfilled = false;
+static bool callErrors = false;
+static pthread_mutex_t resultMutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void _check(const bool ok, const char* what) {
+
+	printf("%s %s\n", ok ? "PASS" : "FAIL", what);
+	if(!ok) {
+		++failures;
+	}
+}
+
+static int _cmp_prefix(const void* a, const void* b) {
+	return memcmp(a, b, PREFIX);
+}
+
+static void* _caller(void* arg) {
+
+	const int id = (int)(intptr_t)arg;
+	uint8_t buf[MAX_REQUEST + GUARD];
+	unsigned int seed = (unsigned int)id + 1;
+
+	for(int r = 0; r < REQUESTS; ++r) {
+		/* Sizes that are not multiple of 4 check the end of each slice. */
+		const size_t n = PREFIX + (size_t)rand_r(&seed) % (MAX_REQUEST - PREFIX);
+		memset(buf, SENTINEL, sizeof(buf));
+
+		const int ret = combiner_get_random((uint32_t*)buf, n, 0);
+
+		bool guardOk = true, filled = false;
+		for(size_t i = n; i < n + GUARD; ++i) {
+			guardOk = guardOk && buf[i] == SENTINEL;
+		}
+		/* A slice of random bytes is never the sentinel in all its bytes. */
+		for(size_t i = 0; i < n && !filled; ++i) {
+			filled = buf[i] != SENTINEL;
+		}
+
+		pthread_mutex_lock(&resultMutex);
+		memcpy(prefixes[id * REQUESTS + r].prefix, buf, PREFIX);
+		requestedBytes += n;
+		overflow = overflow || !guardOk;
+		unfilled = unfilled || !filled;
+		callErrors = callErrors || ret != 0;
+		pthread_mutex_unlock(&resultMutex);
+	}
+	return NULL;
+}
+
+int main(void) {
+
+	pthread_t threads[THREADS];
+	combinerStats stats;
+	uint8_t buf[256];
+
+	connectToServer("stall:1");
+	if(combiner_init(BATCH) != 0) {
+		puts("FAIL combiner_init");
+		return 1;
+	}
+
+	for(int t = 0; t < THREADS; ++t) {
+		pthread_create(&threads[t], NULL, _caller, (void*)(intptr_t)t);
+	}
+	for(int t = 0; t < THREADS; ++t) {
+		pthread_join(threads[t], NULL);
+	}
+
+	combiner_get_stats(&stats);
+	_check(!callErrors && !unfilled, "every request served");
+	_check(!overflow, "no byte written after the slice of a caller");
+
+	qsort(prefixes, THREADS * REQUESTS, sizeof(slicePrefix), _cmp_prefix);
+	bool distinct = true;
+	for(int i = 1; i < THREADS * REQUESTS; ++i) {
+		distinct = distinct && memcmp(prefixes[i - 1].prefix, prefixes[i].prefix, PREFIX) != 0;
+	}
+	_check(distinct, "no two callers receive the same bytes");
+
+	printf("     %llu requests in %llu captures, at most %llu merged\n", (unsigned long long)stats.requests,
+			(unsigned long long)stats.captures, (unsigned long long)stats.maxMerged);
+	_check(stats.requests == THREADS * REQUESTS && stats.bytes == requestedBytes && stats.errors == 0,
+			"requests and bytes counted");
+	_check(stats.maxMerged > 1 && stats.maxMerged <= THREADS && stats.captures < stats.requests,
+			"concurrent requests merged");
+
+	/* Alone, the caller is the combiner: the merged buffer is wiped when it returns. */
+	combiner_get_random((uint32_t*)buf, sizeof(buf), 0);
+	bool wiped = mockLastSlot != NULL && mockLastBytes == sizeof(buf) && (uint8_t*)buf != mockLastSlot;
+	for(size_t i = 0; i < mockLastBytes && wiped; ++i) {
+		wiped = mockLastSlot[i] == 0;
+	}
+	_check(wiped, "merged buffer wiped");
+
+	/* A failed capture leaves the buffer of the caller as it was. */
+	connectToServer("fail");
+	memset(buf, SENTINEL, sizeof(buf));
+	const int ret = combiner_get_random((uint32_t*)buf, sizeof(buf), 0);
+	bool untouched = true;
+	for(size_t i = 0; i < sizeof(buf); ++i) {
+		untouched = untouched && buf[i] == SENTINEL;
+	}
+	combiner_get_stats(&stats);
+	_check(ret == -1 && untouched && stats.errors == 1, "failed capture returns -1 without data");
+
+	combiner_release();
+
+	return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,869 @@
+/*
+ ============================================================================
+ Name        : QusideQRNG_TestEntropy.c
+ Author      : Alvaro Velasco Garcia, Heriberto J. Diaz
+ Created on  : 18 oct. 2022
+ Version     : 0.1
+ Copyright   : Copyright (C) 2022 QUSIDE TECHNOLOGIES - All Rights Reserved.
+               Unauthorized copying of this file, via any medium is
+               strictly prohibited.
+ Description : Known answer checks of quside_QRNG_entropy.
+
+               - The example of the Most Common Value estimate of
+                 SP 800-90B section 6.3.1.
+               - Every estimator against a reference that follows the steps
+                 of SP 800-90B section 6.3 literally, over binary samples,
+                 over 2 bit samples and over their bitstring, and the ones
+                 that accept them over 8 bit samples. The references
+                 are slow but have nothing in common with the optimized
+                 code (suffix array, popcount, dictionaries of positions).
+               - Constant data and the blocks of a stream.
+
+               Returns 0 if all the checks pass.
+ ============================================================================
+ */
+
+#include "quside_QRNG_entropy.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+
+/* Difference allowed between the library and the references. */
+#define TOLERANCE		1e-6
+
+static int failures = 0;
+static uint64_t rngState = 0x9E3779B97F4A7C15ULL;
+
+static void _check(const bool ok, const char* what) {
+
+	printf("%s %s\n", ok ? "PASS" : "FAIL", what);
+	if(!ok) {
+		++failures;
+	}
+}
+
+static void _check_value(const double got, const double expected, const double tolerance,
+		const char* what) {
+
+	const bool ok = (got == ENTROPY_NA && expected == ENTROPY_NA)
+			|| (got != ENTROPY_NA && expected != ENTROPY_NA && fabs(got - expected) <= tolerance);
+
+	printf("%s %-40s %.9f (expected %.9f)\n", ok ? "PASS" : "FAIL", what, got, expected);
+	if(!ok) {
+		++failures;
+	}
+}
+
+static double _uniform(void) {
+
+	rngState ^= rngState << 13;
+	rngState ^= rngState >> 7;
+	rngState ^= rngState << 17;
+	return (double)(rngState >> 11) / 9007199254740992.0;
+}
+
+/******************************************************************************
+** References of SP 800-90B section 6.3. The indexes are 0 based, i - 1 of
+** the standard.
+******************************************************************************/
+
+static double _ref_upper(const double p, const size_t n) {
+
+	const double pu = p + 2.576 * sqrt(p * (1.0 - p) / (double)(n - 1));
+	return pu < 1.0 ? pu : 1.0;
+}
+
+/* Steps common to the predictors (6.3.7 to 6.3.10). */
+static double _ref_predictor(const size_t n, const size_t correct, const size_t run, const int k) {
+
+	const double pGlobal = correct == 0 ? 1.0 - pow(0.01, 1.0 / (double)n)
+			: _ref_upper((double)correct / (double)n, n);
+	const double r = (double)run + 1.0;
+	double lo = 0.0, hi = 1.0;
+
+	/* 0.99 = (1 - px) / ((r + 1 - rx) q) * 1 / x^(n+1), with x the root of
+	 * 1 - x + q p^r x^(r+1) = 0. The right side decreases with p. */
+	while(hi - lo > 1e-15) {
+		const double p = (lo + hi) / 2.0, q = 1.0 - p;
+		double x = 1.0;
+
+		for(int i = 0; i < 10; ++i) {
+			x = 1.0 + q * pow(p, r) * pow(x, r + 1.0);
+		}
+		const double local = (1.0 - p * x) / ((r + 1.0 - r * x) * q) / pow(x, (double)n + 1.0);
+
+		if(local > 0.99) {
+			lo = p;
+		} else {
+			hi = p;
+		}
+	}
+
+	double p = pGlobal > lo ? pGlobal : lo;
+	if(p < 1.0 / k) {
+		p = 1.0 / k;
+	}
+	return -log2(p);
+}
+
+/* 6.3.1 */
+static double _ref_most_common(const uint8_t* s, const size_t n) {
+
+	size_t count[256] = { 0 }, max = 0;
+
+	for(size_t i = 0; i < n; ++i) {
+		if(++count[s[i]] > max) {
+			max = count[s[i]];
+		}
+	}
+	return -log2(_ref_upper((double)max / (double)n, n));
+}
+
+/* 6.3.2, binary data. */
+static double _ref_collision(const uint8_t* s, const size_t n) {
+
+	size_t* t = (size_t*)malloc(n * sizeof(size_t));
+	size_t v = 0, i = 0;
+
+	while(i + 1 < n) {
+		if(s[i] == s[i + 1]) {
+			t[v++] = 2;
+		} else if(i + 2 < n) {
+			t[v++] = 3;
+		} else {
+			break;
+		}
+		i += t[v - 1];
+	}
+
+	double mean = 0.0, var = 0.0;
+	for(size_t j = 0; j < v; ++j) {
+		mean += (double)t[j];
+	}
+	mean /= (double)v;
+	for(size_t j = 0; j < v; ++j) {
+		var += ((double)t[j] - mean) * ((double)t[j] - mean);
+	}
+	free(t);
+
+	const double bound = mean - 2.576 * sqrt(var / (double)(v - 1)) / sqrt((double)v);
+
+	/* Step 7: p q^-2 (1 + (1/p - 1/q) / 2) F(q) - p q^-1 (1/p - 1/q) / 2,
+	 * with F(1/z) = Gamma(3, z) z^-3 e^z = 2 / z^3 + 2 / z^2 + 1 / z. */
+	double lo = 0.5, hi = 1.0;
+	if(bound >= 2.5) {
+		hi = 0.5;
+	} else if(bound <= 2.0) {
+		lo = 1.0;
+	} else {
+		while(hi - lo > 1e-15) {
+			const double p = (lo + hi) / 2.0, q = 1.0 - p;
+			const double f = 2.0 * q * q * q + 2.0 * q * q + q;
+			const double e = p / (q * q) * (1.0 + (1.0 / p - 1.0 / q) / 2.0) * f
+					- p / q * (1.0 / p - 1.0 / q) / 2.0;
+			if(e > bound) {
+				lo = p;
+			} else {
+				hi = p;
+			}
+		}
+	}
+	return -log2((lo + hi) / 2.0);
+}
+
+/* 6.3.3, binary data. */
+static double _ref_markov(const uint8_t* s, const size_t n) {
+
+	double c[2][2] = { { 0.0, 0.0 }, { 0.0, 0.0 } };
+	double ones = 0.0;
+
+	for(size_t i = 0; i < n; ++i) {
+		ones += s[i];
+		if(i + 1 < n) {
+			c[s[i]][s[i + 1]] += 1.0;
+		}
+	}
+
+	const double p1 = ones / (double)n, p0 = 1.0 - p1;
+	const double p00 = c[0][0] / (c[0][0] + c[0][1]), p01 = c[0][1] / (c[0][0] + c[0][1]);
+	const double p10 = c[1][0] / (c[1][0] + c[1][1]), p11 = c[1][1] / (c[1][0] + c[1][1]);
+	const double seq[6] = {
+		p0 * pow(p00, 127),
+		p0 * pow(p01, 64) * pow(p10, 63),
+		p0 * p01 * pow(p11, 126),
+		p1 * p10 * pow(p00, 126),
+		p1 * pow(p10, 64) * pow(p01, 63),
+		p1 * pow(p11, 127)
+	};
+
+	double pMax = 0.0;
+	for(int i = 0; i < 6; ++i) {
+		if(seq[i] > pMax) {
+			pMax = seq[i];
+		}
+	}
+	const double h = -log2(pMax) / 128.0;
+	return h < 1.0 ? h : 1.0;
+}
+
+/* G(z) of 6.3.4 step 7, the inner sum is kept while t grows. */
+static double _ref_compression_g(const double z, const size_t nBlocks, const size_t d) {
+
+	double total = 0.0, inner = 0.0, power = 1.0;
+
+	for(size_t t = 1; t <= nBlocks; ++t) {
+		/* power = (1 - z)^(t - 1), inner = sum_{u < t} log2(u) z^2 (1 - z)^(u - 1). */
+		if(t > d) {
+			total += inner + log2((double)t) * z * power;
+		}
+		inner += log2((double)t) * z * z * power;
+		power *= 1.0 - z;
+	}
+	return total / (double)(nBlocks - d);
+}
+
+/* 6.3.4, binary data. */
+static double _ref_compression(const uint8_t* s, const size_t n) {
+
+	const size_t b = 6, d = 1000, nBlocks = n / b;
+	const double alphabet = 64.0;
+	size_t dict[64] = { 0 };
+	double sum = 0.0, sum2 = 0.0;
+
+	for(size_t i = 1; i <= nBlocks; ++i) {
+		size_t value = 0;
+		for(size_t j = 0; j < b; ++j) {
+			value = value << 1 | s[(i - 1) * b + j];
+		}
+		if(i > d) {
+			const double a = log2((double)(dict[value] != 0 ? i - dict[value] : i));
+			sum += a;
+			sum2 += a * a;
+		}
+		dict[value] = i;
+	}
+
+	const double v = (double)(nBlocks - d);
+	const double mean = sum / v;
+	const double sigma = 0.5907 * sqrt(sum2 / (v - 1.0) - mean * mean);
+	const double bound = mean - 2.576 * sigma / sqrt(v);
+
+	double lo = 1.0 / alphabet, hi = 1.0;
+	if(bound >= alphabet * _ref_compression_g(lo, nBlocks, d)) {
+		hi = lo;
+	} else {
+		while(hi - lo > 1e-13) {
+			const double p = (lo + hi) / 2.0, q = (1.0 - p) / (alphabet - 1.0);
+			const double e = _ref_compression_g(p, nBlocks, d)
+					+ (alphabet - 1.0) * _ref_compression_g(q, nBlocks, d);
+			if(e > bound) {
+				lo = p;
+			} else {
+				hi = p;
+			}
+		}
+	}
+	const double h = -log2((lo + hi) / 2.0) / (double)b;
+	return h < 1.0 ? h : 1.0;
+}
+
+/* Tuples compared by qsort. */
+static const uint8_t* tupleData;
+static size_t tupleLen;
+
+static int _tuple_cmp(const void* a, const void* b) {
+	return memcmp(tupleData + *(const size_t*)a, tupleData + *(const size_t*)b, tupleLen);
+}
+
+/* Occurrences of the most common w-tuple and pairs of equal w-tuples. */
+static void _ref_tuples(const uint8_t* s, const size_t n, const size_t w, size_t* maxCount,
+		double* pairs) {
+
+	const size_t count = n - w + 1;
+	size_t* idx = (size_t*)malloc(count * sizeof(size_t));
+
+	for(size_t i = 0; i < count; ++i) {
+		idx[i] = i;
+	}
+	tupleData = s;
+	tupleLen = w;
+	qsort(idx, count, sizeof(size_t), _tuple_cmp);
+
+	*maxCount = 0;
+	*pairs = 0.0;
+	for(size_t i = 0; i < count;) {
+		size_t j = i + 1;
+		while(j < count && memcmp(s + idx[i], s + idx[j], w) == 0) {
+			++j;
+		}
+		if(j - i > *maxCount) {
+			*maxCount = j - i;
+		}
+		*pairs += (double)(j - i) * (double)(j - i - 1) / 2.0;
+		i = j;
+	}
+	free(idx);
+}
+
+/* 6.3.5 and 6.3.6 */
+static void _ref_tuple_lrs(const uint8_t* s, const size_t n, double* hTuple, double* hLrs) {
+
+	size_t t = 0, q;
+	double pairs, pMax = 0.0;
+
+	for(size_t i = 1;; ++i) {
+		_ref_tuples(s, n, i, &q, &pairs);
+		if(q < 35) {
+			break;
+		}
+		t = i;
+		const double p = pow((double)q / (double)(n - i + 1), 1.0 / (double)i);
+		if(p > pMax) {
+			pMax = p;
+		}
+	}
+	*hTuple = t > 0 ? -log2(_ref_upper(pMax, n)) : ENTROPY_NA;
+
+	pMax = 0.0;
+	*hLrs = ENTROPY_NA;
+	for(size_t w = t + 1;; ++w) {
+		_ref_tuples(s, n, w, &q, &pairs);
+		if(q < 2) {
+			break;
+		}
+		const double total = (double)(n - w + 1) * (double)(n - w) / 2.0;
+		const double p = pow(pairs / total, 1.0 / (double)w);
+		if(p > pMax) {
+			pMax = p;
+		}
+		*hLrs = -log2(_ref_upper(pMax, n));
+	}
+}
+
+/* 6.3.7 */
+static double _ref_multi_mcw(const uint8_t* s, const size_t n, const int k) {
+
+	static const size_t w[4] = { 63, 255, 1023, 4095 };
+	size_t count[4][256], last[256], score[4] = { 0 };
+	size_t correct = 0, run = 0, longest = 0;
+	int winner = 0;
+
+	memset(count, 0, sizeof(count));
+	memset(last, 0, sizeof(last));
+
+	for(size_t i = 0; i < n; ++i) {
+		int frequent[4];
+
+		if(i >= w[0]) {
+			/* Most common value of the window, the most recent one in case of
+			 * tie. last is the position plus one. */
+			for(int j = 0; j < 4; ++j) {
+				frequent[j] = -1;
+				if(i < w[j]) {
+					continue;
+				}
+				for(int x = 0; x < k; ++x) {
+					if(count[j][x] > 0 && (frequent[j] < 0 || count[j][x] > count[j][frequent[j]]
+							|| (count[j][x] == count[j][frequent[j]] && last[x] > last[frequent[j]]))) {
+						frequent[j] = x;
+					}
+				}
+			}
+
+			if(frequent[winner] == s[i]) {
+				++correct;
+				if(++run > longest) {
+					longest = run;
+				}
+			} else {
+				run = 0;
+			}
+
+			for(int j = 0; j < 4; ++j) {
+				if(frequent[j] == s[i] && ++score[j] >= score[winner]) {
+					winner = j;
+				}
+			}
+		}
+
+		last[s[i]] = i + 1;
+		for(int j = 0; j < 4; ++j) {
+			++count[j][s[i]];
+			if(i >= w[j]) {
+				--count[j][s[i - w[j]]];
+			}
+		}
+	}
+	return _ref_predictor(n - w[0], correct, longest, k);
+}
+
+/* 6.3.8 */
+static double _ref_lag(const uint8_t* s, const size_t n, const int k) {
+
+	size_t score[129] = { 0 }, winner = 1;
+	size_t correct = 0, run = 0, longest = 0;
+
+	for(size_t i = 1; i < n; ++i) {
+		if(winner <= i && s[i - winner] == s[i]) {
+			++correct;
+			if(++run > longest) {
+				longest = run;
+			}
+		} else {
+			run = 0;
+		}
+		for(size_t d = 1; d <= 128 && d <= i; ++d) {
+			if(s[i - d] == s[i] && ++score[d] >= score[winner]) {
+				winner = d;
+			}
+		}
+	}
+	return _ref_predictor(n - 1, correct, longest, k);
+}
+
+/* Dictionary of contexts of up to 16 samples, by content, with the counters
+ * of the k values that follow each one. */
+typedef struct {
+	const uint8_t* s;
+	int k;
+	size_t mask;
+	uint32_t* slotPos;		/* Position of the context plus one, 0 if free. */
+	uint8_t* slotLen;
+	uint32_t* slotId;
+	uint32_t* counts;		/* k counters of each context, by id. */
+	size_t contexts;
+} refDictionary;
+
+static refDictionary _ref_dictionary(const uint8_t* s, const int k, const size_t maxContexts) {
+
+	refDictionary m;
+	size_t slots = 1;
+
+	while(slots < 2 * maxContexts) {
+		slots <<= 1;
+	}
+	m.s = s;
+	m.k = k;
+	m.mask = slots - 1;
+	m.slotPos = (uint32_t*)calloc(slots, sizeof(uint32_t));
+	m.slotLen = (uint8_t*)calloc(slots, 1);
+	m.slotId = (uint32_t*)calloc(slots, sizeof(uint32_t));
+	m.counts = (uint32_t*)calloc(maxContexts * (size_t)k, sizeof(uint32_t));
+	m.contexts = 0;
+	return m;
+}
+
+static void _ref_dictionary_free(refDictionary* m) {
+
+	free(m->slotPos);
+	free(m->slotLen);
+	free(m->slotId);
+	free(m->counts);
+}
+
+/* Returns the counters of the context s[pos .. pos + len - 1]. If it is not in
+ * the dictionary it is added when add is true, otherwise returns NULL. */
+static uint32_t* _ref_context(refDictionary* m, const size_t pos, const size_t len, const bool add) {
+
+	uint64_t h = 14695981039346656037ULL ^ len;
+	for(size_t i = 0; i < len; ++i) {
+		h = (h ^ m->s[pos + i]) * 1099511628211ULL;
+	}
+
+	size_t slot = (size_t)(h ^ (h >> 29)) & m->mask;
+	while(m->slotPos[slot] != 0) {
+		if(m->slotLen[slot] == len && memcmp(m->s + m->slotPos[slot] - 1, m->s + pos, len) == 0) {
+			return m->counts + (size_t)m->slotId[slot] * m->k;
+		}
+		slot = (slot + 1) & m->mask;
+	}
+	if(!add) {
+		return NULL;
+	}
+
+	m->slotPos[slot] = (uint32_t)pos + 1;
+	m->slotLen[slot] = (uint8_t)len;
+	m->slotId[slot] = (uint32_t)m->contexts++;
+	return m->counts + (size_t)m->slotId[slot] * m->k;
+}
+
+/* The most common value after a context, the biggest one in case of tie. */
+static int _ref_most_likely(const uint32_t* count, const int k) {
+
+	int y = 0;
+	for(int x = 1; x < k; ++x) {
+		if(count[x] >= count[y]) {
+			y = x;
+		}
+	}
+	return y;
+}
+
+/* 6.3.9. The limit of 100000 entries of each M_d applies to the contexts. */
+static double _ref_multi_mmc(const uint8_t* s, const size_t n, const int k) {
+
+	refDictionary m = _ref_dictionary(s, k, 16 * 100000);
+	size_t entries[17] = { 0 }, score[17] = { 0 }, winner = 1;
+	size_t correct = 0, run = 0, longest = 0;
+
+	for(size_t i = 2; i < n; ++i) {
+		int prediction[17];
+
+		for(size_t d = 1; d <= 16 && d < i; ++d) {
+			const size_t contexts = m.contexts;
+			uint32_t* count = _ref_context(&m, i - 1 - d, d, entries[d] < 100000);
+			if(count != NULL) {
+				entries[d] += m.contexts - contexts;
+				++count[s[i - 1]];
+			}
+		}
+
+		for(size_t d = 1; d <= 16; ++d) {
+			const uint32_t* count = d <= i ? _ref_context(&m, i - d, d, false) : NULL;
+			prediction[d] = count != NULL ? _ref_most_likely(count, k) : -1;
+		}
+
+		if(prediction[winner] == s[i]) {
+			++correct;
+			if(++run > longest) {
+				longest = run;
+			}
+		} else {
+			run = 0;
+		}
+		for(size_t d = 1; d <= 16; ++d) {
+			if(prediction[d] == s[i] && ++score[d] >= score[winner]) {
+				winner = d;
+			}
+		}
+	}
+
+	_ref_dictionary_free(&m);
+	return _ref_predictor(n - 2, correct, longest, k);
+}
+
+/* 6.3.10. The limit of 65536 entries applies to the contexts, entries returns
+ * how many were added. */
+static double _ref_lz78y(const uint8_t* s, const size_t n, const int k, size_t* entries) {
+
+	refDictionary m = _ref_dictionary(s, k, 65536);
+	size_t correct = 0, run = 0, longest = 0;
+
+	for(size_t i = 17; i < n; ++i) {
+		int prediction = -1;
+		uint32_t maxCount = 0;
+
+		for(size_t j = 16; j >= 1; --j) {
+			uint32_t* count = _ref_context(&m, i - 1 - j, j, m.contexts < 65536);
+			if(count != NULL) {
+				++count[s[i - 1]];
+			}
+		}
+
+		for(size_t j = 16; j >= 1; --j) {
+			const uint32_t* count = _ref_context(&m, i - j, j, false);
+			if(count != NULL) {
+				const int y = _ref_most_likely(count, k);
+				if(count[y] > maxCount) {
+					prediction = y;
+					maxCount = count[y];
+				}
+			}
+		}
+
+		if(prediction == s[i]) {
+			++correct;
+			if(++run > longest) {
+				longest = run;
+			}
+		} else {
+			run = 0;
+		}
+	}
+
+	*entries = m.contexts;
+	_ref_dictionary_free(&m);
+	return _ref_predictor(n - 17, correct, longest, k);
+}
+
+/* All the estimators over binary data. */
+static void _ref_binary(const uint8_t* s, const size_t n, double* h, size_t* lzEntries) {
+
+	h[EST_MOST_COMMON] = _ref_most_common(s, n);
+	h[EST_COLLISION] = _ref_collision(s, n);
+	h[EST_MARKOV] = _ref_markov(s, n);
+	h[EST_COMPRESSION] = _ref_compression(s, n);
+	_ref_tuple_lrs(s, n, &h[EST_T_TUPLE], &h[EST_LRS]);
+	h[EST_MULTI_MCW] = _ref_multi_mcw(s, n, 2);
+	h[EST_LAG] = _ref_lag(s, n, 2);
+	h[EST_MULTI_MMC] = _ref_multi_mmc(s, n, 2);
+	h[EST_LZ78Y] = _ref_lz78y(s, n, 2, lzEntries);
+}
+
+/******************************************************************************
+** Checks.
+******************************************************************************/
+
+static void _check_estimates(const double* got, const double* expected, const char* what) {
+
+	char name[96];
+
+	for(int e = 0; e < ENTROPY_ESTIMATORS; ++e) {
+		snprintf(name, sizeof(name), "%s %s", what, entropy_estimator_name((entropyEstimator)e));
+		_check_value(got[e], expected[e], TOLERANCE, name);
+	}
+}
+
+static double _min_estimate(const double* h) {
+
+	double min = ENTROPY_NA;
+	for(int e = 0; e < ENTROPY_ESTIMATORS; ++e) {
+		if(h[e] != ENTROPY_NA && (min == ENTROPY_NA || h[e] < min)) {
+			min = h[e];
+		}
+	}
+	return min;
+}
+
+/* Example of SP 800-90B 6.3.1: the mode appears 8 times in 20 samples. */
+static void _test_standard_example(void) {
+
+	static const uint8_t s[20] = { 0, 1, 1, 2, 0, 1, 2, 2, 0, 1, 0, 1, 1, 0, 2, 2, 1, 0, 2, 1 };
+	entropyOptions options = { 2, 0, 1 };
+	entropyResult r;
+
+	_check(entropy_assess_buffer(s, sizeof(s), &options, &r) == 0, "SP 800-90B 6.3.1 example assessed");
+	_check_value(r.h[EST_MOST_COMMON], 0.5363, 5e-5, "SP 800-90B 6.3.1 example");
+}
+
+/* Binary samples: the estimates over the samples and over the bitstring are
+ * the same. */
+static void _test_binary(void) {
+
+	const size_t n = 200000;
+	uint8_t* s = (uint8_t*)malloc(n);
+	entropyOptions options = { 1, 0, 0 };
+	entropyResult r;
+	double expected[ENTROPY_ESTIMATORS];
+	size_t lzEntries;
+
+	/* Markov source: P(1 | 0) = 0.45, P(1 | 1) = 0.6. */
+	s[0] = 0;
+	for(size_t i = 1; i < n; ++i) {
+		s[i] = _uniform() < (s[i - 1] ? 0.6 : 0.45);
+	}
+
+	_ref_binary(s, n, expected, &lzEntries);
+	_check(lzEntries == 65536, "binary LZ78Y dictionary full");
+
+	_check(entropy_assess_buffer(s, n, &options, &r) == 0, "binary assessed");
+	_check_estimates(r.h, expected, "binary");
+	_check(memcmp(r.h, r.hBits, sizeof(r.h)) == 0, "binary bitstring is the samples");
+	_check_value(r.hAssessed, _min_estimate(expected), TOLERANCE, "binary min-entropy");
+
+	free(s);
+}
+
+/* 2 bit samples: the estimates of the binary data only are not available over
+ * the samples, all of them run over the bitstring. */
+static void _test_non_binary(void) {
+
+	const size_t n = 150000;
+	uint8_t* s = (uint8_t*)malloc(n);
+	uint8_t* bits = (uint8_t*)malloc(2 * n);
+	entropyOptions options = { 2, 0, 0 };
+	entropyResult r;
+	double expected[ENTROPY_ESTIMATORS], expectedBits[ENTROPY_ESTIMATORS];
+	size_t lzEntries;
+
+	/* P = (0.4, 0.3, 0.2, 0.1), the previous sample is repeated 1 of 10 times.
+	 * The unused bits of the bytes have to be ignored. */
+	for(size_t i = 0; i < n; ++i) {
+		const double u = _uniform();
+		if(i > 0 && _uniform() < 0.1) {
+			s[i] = s[i - 1];
+		} else {
+			s[i] = u < 0.4 ? 0 : u < 0.7 ? 1 : u < 0.9 ? 2 : 3;
+		}
+		bits[2 * i] = s[i] >> 1;
+		bits[2 * i + 1] = s[i] & 1;
+	}
+
+	for(int e = 0; e < ENTROPY_ESTIMATORS; ++e) {
+		expected[e] = ENTROPY_NA;
+	}
+	expected[EST_MOST_COMMON] = _ref_most_common(s, n);
+	_ref_tuple_lrs(s, n, &expected[EST_T_TUPLE], &expected[EST_LRS]);
+	expected[EST_MULTI_MCW] = _ref_multi_mcw(s, n, 4);
+	expected[EST_LAG] = _ref_lag(s, n, 4);
+	expected[EST_MULTI_MMC] = _ref_multi_mmc(s, n, 4);
+	expected[EST_LZ78Y] = _ref_lz78y(s, n, 4, &lzEntries);
+	_check(lzEntries == 65536, "2 bit LZ78Y dictionary full");
+	_ref_binary(bits, 2 * n, expectedBits, &lzEntries);
+
+	for(size_t i = 0; i < n; ++i) {
+		s[i] |= 0xfc;
+	}
+
+	_check(entropy_assess_buffer(s, n, &options, &r) == 0, "2 bit assessed");
+	_check_estimates(r.h, expected, "2 bit");
+	_check_estimates(r.hBits, expectedBits, "2 bit bitstring");
+
+	const double hOriginal = _min_estimate(r.h);
+	const double hBitstring = _min_estimate(expectedBits);
+	_check_value(r.hOriginal, hOriginal, TOLERANCE, "2 bit H_original");
+	_check_value(r.hBitstring, hBitstring, TOLERANCE, "2 bit H_bitstring");
+	_check_value(r.hAssessed, fmin(hOriginal, 2.0 * hBitstring), TOLERANCE, "2 bit min-entropy");
+
+	free(s);
+	free(bits);
+}
+
+/* 8 bit samples. The values that follow the contexts of random samples fill
+ * the dictionary of LZ78Y long before the 65536 contexts, and then a value is
+ * followed by a fixed one 6 of 10 times. Only a limit on the contexts lets
+ * LZ78Y learn it. MultiMMC would need too much memory in the reference. */
+static void _test_bytes(void) {
+
+	const size_t n = 100000;
+	uint8_t* s = (uint8_t*)malloc(n);
+	entropyOptions options = { 8, 0, 0 };
+	entropyResult r;
+	double hTuple, hLrs;
+	size_t lzEntries;
+
+	for(size_t i = 0; i < n; ++i) {
+		if(i >= 20000 && _uniform() < 0.6) {
+			s[i] = (uint8_t)(s[i - 1] * 167 + 13);
+		} else {
+			s[i] = (uint8_t)(_uniform() * 256.0);
+		}
+	}
+
+	_check(entropy_assess_buffer(s, n, &options, &r) == 0, "8 bit assessed");
+	_check_value(r.h[EST_MOST_COMMON], _ref_most_common(s, n), TOLERANCE, "8 bit Most Common Value");
+	_ref_tuple_lrs(s, n, &hTuple, &hLrs);
+	_check_value(r.h[EST_T_TUPLE], hTuple, TOLERANCE, "8 bit t-Tuple");
+	_check_value(r.h[EST_LRS], hLrs, TOLERANCE, "8 bit LRS");
+	_check_value(r.h[EST_MULTI_MCW], _ref_multi_mcw(s, n, 256), TOLERANCE, "8 bit MultiMCW");
+	_check_value(r.h[EST_LAG], _ref_lag(s, n, 256), TOLERANCE, "8 bit Lag");
+	_check_value(r.h[EST_LZ78Y], _ref_lz78y(s, n, 256, &lzEntries), TOLERANCE, "8 bit LZ78Y");
+	_check(lzEntries == 65536, "8 bit LZ78Y dictionary full");
+
+	free(s);
+}
+
+static void _test_constant(void) {
+
+	const size_t n = 100000;
+	uint8_t* s = (uint8_t*)calloc(n, 1);
+	entropyOptions options = { 8, 0, 0 };
+	entropyResult r;
+	bool ok = true;
+
+	_check(entropy_assess_buffer(s, n, &options, &r) == 0, "constant assessed");
+	for(int e = 0; e < ENTROPY_ESTIMATORS; ++e) {
+		ok &= r.h[e] == ENTROPY_NA || r.h[e] < 1e-3;
+		ok &= r.hBits[e] == ENTROPY_NA || r.hBits[e] < 1e-3;
+	}
+	_check(ok && r.hAssessed < 1e-3, "constant has no entropy");
+
+	free(s);
+}
+
+typedef struct {
+	const uint8_t* data;
+	size_t len;
+	size_t pos;
+} memoryReader;
+
+/* Returns the data in pieces smaller than a block. */
+static size_t _memory_reader(void* ctx, uint8_t* buf, const size_t len) {
+
+	memoryReader* m = (memoryReader*)ctx;
+	size_t n = m->len - m->pos;
+
+	if(n > len) {
+		n = len;
+	}
+	if(n > 7777) {
+		n = 7777;
+	}
+	memcpy(buf, m->data + m->pos, n);
+	m->pos += n;
+	return n;
+}
+
+typedef struct {
+	uint64_t blocks;
+	uint64_t samples[8];
+	double mostCommon[8];
+} blockLog;
+
+static void _log_block(void* ctx, const uint64_t block, const entropyResult* r) {
+
+	blockLog* log = (blockLog*)ctx;
+
+	if(block < 8) {
+		log->samples[block] = r->samples;
+		log->mostCommon[block] = r->h[EST_MOST_COMMON];
+	}
+	log->blocks = block + 1;
+}
+
+static void _test_stream(void) {
+
+	const size_t n = 250000;
+	uint8_t* s = (uint8_t*)malloc(n);
+	entropyResult r, last;
+	char what[96];
+
+	for(size_t i = 0; i < n; ++i) {
+		s[i] = _uniform() < 0.5;
+	}
+
+	entropyOptions single = { 1, 0, 1 };
+	entropy_assess_buffer(s + 100000, 150000, &single, &last);
+
+	for(int threads = 1; threads <= 3; threads += 2) {
+		entropyOptions options = { 1, 100000, threads };
+		memoryReader m = { s, n, 0 };
+		blockLog log;
+
+		memset(&log, 0, sizeof(log));
+		snprintf(what, sizeof(what), "stream with %d threads: short last block merged", threads);
+		_check(entropy_assess_stream(_memory_reader, &m, &options, _log_block, &log, &r) == 0
+				&& r.blocks == 2 && log.blocks == 2 && r.samples == n && log.samples[0] == 100000
+				&& log.samples[1] == 150000 && log.mostCommon[1] == last.h[EST_MOST_COMMON], what);
+	}
+
+	entropyOptions options = { 1, 100000, 1 };
+	memoryReader exact = { s, 200000, 0 };
+	_check(entropy_assess_stream(_memory_reader, &exact, &options, NULL, NULL, &r) == 0
+			&& r.blocks == 2 && r.samples == 200000, "stream of whole blocks");
+
+	memoryReader shortStream = { s, 150000, 0 };
+	_check(entropy_assess_stream(_memory_reader, &shortStream, &options, NULL, NULL, &r) == 0
+			&& r.blocks == 1 && r.samples == 150000, "stream shorter than two blocks");
+
+	memoryReader tiny = { s, ENTROPY_MIN_BLOCK - 1, 0 };
+	_check(entropy_assess_stream(_memory_reader, &tiny, &options, NULL, NULL, &r) == -1,
+			"stream shorter than ENTROPY_MIN_BLOCK rejected");
+
+	free(s);
+}
+
+int main(void) {
+
+	_test_standard_example();
+	_test_binary();
+	_test_non_binary();
+	_test_bytes();
+	_test_constant();
+	_test_stream();
+
+	printf("%s\n", failures == 0 ? "All the checks pass." : "Some checks FAIL.");
+	return failures == 0 ? 0 : 1;
+}
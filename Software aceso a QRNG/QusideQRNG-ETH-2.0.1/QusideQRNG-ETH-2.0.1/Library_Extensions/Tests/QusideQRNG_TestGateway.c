@@ -0,0 +1,391 @@
+/*
+ ============================================================================
+ Name        : QusideQRNG_TestGateway.c
+ Author      : Alvaro Velasco Garcia, Heriberto J. Diaz
+ Created on  : 18 oct. 2022
+ Version     : 0.1
+ Copyright   : Copyright (C) 2022 QUSIDE TECHNOLOGIES - All Rights Reserved.
+               Unauthorized copying of this file, via any medium is
+               strictly prohibited.
+ Description : Checks the entropy gateway, started from this folder with
+               the mock library: the frames of the protocol, the responses
+               of pipelined and wrong requests, the client library, the
+               quota of a client and the share of a slow QRNG between a
+               client with small requests and a client with big ones.
+               Returns 0 if all the checks pass.
+ ============================================================================
+ */
+
+#include "quside_QRNG_gateway.h"
+#include <quside_QRNG_user.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+
+#define QUOTA				1000000		/* Bytes/s of the quota test. */
+#define QUOTA_BYTES			(3 << 20)
+#define SMALL_REQUEST		32768		/* Half a quantum of the scheduler. */
+#define SMALL_PIPELINE		64
+#define BIG_PIPELINE		8
+#define WARMUP_MS			500
+#define MEASURE_MS			2000
+
+/* Client of the share test, with its requests always in flight. */
+typedef struct {
+	int fd;
+	uint32_t request;
+	int pipeline;
+	uint64_t bytes;
+	bool error;
+} gwFlow;
+
+static int failures = 0;
+static int basePort = 0;
+static atomic_bool measuring;
+static atomic_bool stopping;
+
+static void _check(const bool ok, const char* what) {
+
+	printf("%s %s\n", ok ? "PASS" : "FAIL", what);
+	if(!ok) {
+		++failures;
+	}
+}
+
+static double _ms_since(const struct timespec* t0) {
+
+	struct timespec t1;
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	return (double)(t1.tv_sec - t0->tv_sec) * 1e3 + (double)(t1.tv_nsec - t0->tv_nsec) / 1e6;
+}
+
+static void _sleep_ms(const long ms) {
+
+	const struct timespec t = { ms / 1000, (ms % 1000) * 1000000L };
+	nanosleep(&t, NULL);
+}
+
+static int _send_all(const int fd, const void* buf, const size_t len) {
+
+	const uint8_t* p = (const uint8_t*)buf;
+	size_t done = 0;
+
+	while(done < len) {
+		const ssize_t n = send(fd, p + done, len - done, MSG_NOSIGNAL);
+		if(n <= 0) {
+			return -1;
+		}
+		done += (size_t)n;
+	}
+	return 0;
+}
+
+static int _recv_all(const int fd, void* buf, const size_t len) {
+
+	uint8_t* p = (uint8_t*)buf;
+	size_t done = 0;
+
+	while(done < len) {
+		const ssize_t n = recv(fd, p + done, len - done, 0);
+		if(n <= 0) {
+			return -1;
+		}
+		done += (size_t)n;
+	}
+	return 0;
+}
+
+/* Starts a gateway with one session with server. quota 0 means no quota. */
+static pid_t _start_gateway(const int port, const char* server, const int quota) {
+
+	char portArg[16], quotaArg[16];
+
+	snprintf(portArg, sizeof(portArg), "%d", port);
+	snprintf(quotaArg, sizeof(quotaArg), "%d", quota);
+
+	const pid_t pid = fork();
+	if(pid == 0) {
+		const int null = open("/dev/null", O_WRONLY);
+		dup2(null, STDOUT_FILENO);
+		if(quota > 0) {
+			execl("./QusideQRNG_Gateway", "QusideQRNG_Gateway", "-s", server, "-S", "1", "-p", portArg,
+					"-b", "8", "-u", "-q", quotaArg, (char*)NULL);
+		} else {
+			execl("./QusideQRNG_Gateway", "QusideQRNG_Gateway", "-s", server, "-S", "1", "-p", portArg,
+					"-b", "8", "-u", (char*)NULL);
+		}
+		_exit(127);
+	}
+	return pid;
+}
+
+static void _stop_gateway(const pid_t pid) {
+
+	kill(pid, SIGTERM);
+	waitpid(pid, NULL, 0);
+}
+
+/* Connects to the gateway, waiting until it listens. */
+static int _connect(const int port) {
+
+	struct sockaddr_in addr;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons((uint16_t)port);
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	for(int tries = 0; tries < 100; ++tries) {
+		const int fd = socket(AF_INET, SOCK_STREAM, 0);
+		if(fd >= 0 && connect(fd, (struct sockaddr*)&addr, sizeof(addr)) == 0) {
+			return fd;
+		}
+		if(fd >= 0) {
+			close(fd);
+		}
+		_sleep_ms(50);
+	}
+	return -1;
+}
+
+static int _request(const int fd, const uint16_t op, const uint32_t nBytes) {
+
+	uint8_t buf[GW_HEADER_SIZE];
+	gatewayRequest req = { op, 0, nBytes };
+
+	gw_encode_request(buf, &req);
+	return _send_all(fd, buf, sizeof(buf));
+}
+
+/* Reads a response and its data. Returns -1 if the frame is wrong. */
+static int _response(const int fd, gatewayResponse* res, uint8_t* data, const size_t cap) {
+
+	uint8_t buf[GW_HEADER_SIZE];
+
+	if(_recv_all(fd, buf, sizeof(buf)) != 0 || gw_decode_response(buf, res) != 0 || res->nBytes > cap) {
+		return -1;
+	}
+	return _recv_all(fd, data, res->nBytes);
+}
+
+static bool _nonzero(const uint8_t* data, const size_t n) {
+
+	for(size_t i = 0; i < n; ++i) {
+		if(data[i] != 0) {
+			return true;
+		}
+	}
+	return false;
+}
+
+static void _test_frames(void) {
+
+	/* "QGW1", op 1, device 2 and 10000 bytes, all little endian. */
+	const uint8_t expected[GW_HEADER_SIZE] = { 'Q', 'G', 'W', '1', 1, 0, 2, 0, 0x10, 0x27, 0, 0 };
+	uint8_t buf[GW_HEADER_SIZE];
+	gatewayRequest req = { GW_OP_RANDOM, 2, 10000 }, req2;
+	gatewayResponse res = { GW_STATUS_TOO_BIG, 7 }, res2;
+
+	gw_encode_request(buf, &req);
+	const bool encoded = memcmp(buf, expected, sizeof(buf)) == 0;
+	const bool decoded = gw_decode_request(buf, &req2) == 0 && req2.op == req.op && req2.devInd == req.devInd
+			&& req2.nBytes == req.nBytes;
+	buf[0] = 'X';
+	_check(encoded && decoded && gw_decode_request(buf, &req2) == -1, "request frame");
+
+	gw_encode_response(buf, &res);
+	const bool response = gw_decode_response(buf, &res2) == 0 && res2.status == GW_STATUS_TOO_BIG && res2.nBytes == 7;
+	buf[3] = 0;
+	_check(response && gw_decode_response(buf, &res2) == -1, "response frame");
+}
+
+static void _test_requests(const int port) {
+
+	static uint8_t data[GW_MAX_REQUEST];
+	gatewayResponse res;
+	const int fd = _connect(port);
+
+	if(fd < 0) {
+		_check(false, "connect to the gateway");
+		return;
+	}
+
+	/* Four requests sent before reading any response are answered in order. */
+	bool ok = _request(fd, GW_OP_RANDOM, 1000) == 0 && _request(fd, GW_OP_RAW, 16) == 0
+			&& _request(fd, GW_OP_RANDOM, GW_MAX_REQUEST + 1) == 0 && _request(fd, GW_OP_RANDOM, 5) == 0;
+	ok = ok && _response(fd, &res, data, sizeof(data)) == 0 && res.status == GW_STATUS_OK && res.nBytes == 1000
+			&& _nonzero(data, 1000);
+	ok = ok && _response(fd, &res, data, sizeof(data)) == 0 && res.status == GW_STATUS_UNSUPPORTED && res.nBytes == 0;
+	ok = ok && _response(fd, &res, data, sizeof(data)) == 0 && res.status == GW_STATUS_TOO_BIG && res.nBytes == 0;
+	ok = ok && _response(fd, &res, data, sizeof(data)) == 0 && res.status == GW_STATUS_OK && res.nBytes == 5;
+	_check(ok, "pipelined requests answered in order");
+
+	/* A frame without the magic closes the connection. */
+	const uint8_t garbage[GW_HEADER_SIZE] = { 'H', 'T', 'T', 'P' };
+	uint8_t byte;
+	_send_all(fd, garbage, sizeof(garbage));
+	_check(recv(fd, &byte, 1, 0) == 0, "wrong magic closes the connection");
+	close(fd);
+}
+
+static void _test_client(const int port) {
+
+	char address[32];
+	const size_t n = ((size_t)3 << 20) + 5;
+	uint8_t* buf = (uint8_t*)calloc(1, n);
+	const int fd = _connect(port);
+
+	if(fd >= 0) {
+		close(fd);
+	}
+
+	snprintf(address, sizeof(address), "127.0.0.1:%d", port);
+	_check(connectToServer(address) == 0 && buf != NULL && get_random((uint32_t*)buf, n, 0) == 0
+			&& _nonzero(buf + n - 5, 5) && _nonzero(buf, 4096), "client library: capture of several requests");
+	_check(get_raw((uint32_t*)buf, 16, 0) == -1 && get_random((uint32_t*)buf, 16, 0) == 0,
+			"client library: raw refused and the stream still in sync");
+	disconnectServer();
+	free(buf);
+}
+
+static void _test_quota(const int port) {
+
+	char address[32];
+	struct timespec t0;
+	uint8_t* buf = (uint8_t*)malloc(QUOTA_BYTES);
+
+	snprintf(address, sizeof(address), "127.0.0.1:%d", port);
+	const int fd = _connect(port);
+	if(fd >= 0) {
+		close(fd);
+	}
+	if(buf == NULL || connectToServer(address) != 0) {
+		_check(false, "quota: connect");
+		free(buf);
+		return;
+	}
+
+	/* One second of quota at once, the rest at the rate of the quota. */
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	const int ret = get_random((uint32_t*)buf, QUOTA_BYTES, 0);
+	const double ms = _ms_since(&t0);
+	const double expectedMs = ((double)QUOTA_BYTES - QUOTA) / QUOTA * 1e3;
+
+	printf("     %d bytes in %.0f ms with a quota of %d bytes/s\n", QUOTA_BYTES, ms, QUOTA);
+	_check(ret == 0 && ms > 0.9 * expectedMs && ms < 1.3 * expectedMs, "quota of the client");
+	disconnectServer();
+	free(buf);
+}
+
+static void* _flow(void* arg) {
+
+	gwFlow* f = (gwFlow*)arg;
+	uint8_t buf[65536];
+
+	for(int i = 0; i < f->pipeline; ++i) {
+		f->error = f->error || _request(f->fd, GW_OP_RANDOM, f->request) != 0;
+	}
+
+	while(!atomic_load(&stopping) && !f->error) {
+		uint8_t header[GW_HEADER_SIZE];
+		gatewayResponse res;
+
+		if(_recv_all(f->fd, header, sizeof(header)) != 0 || gw_decode_response(header, &res) != 0
+				|| res.status != GW_STATUS_OK) {
+			f->error = true;
+			break;
+		}
+		for(size_t left = res.nBytes; left > 0 && !f->error; ) {
+			const ssize_t n = recv(f->fd, buf, left < sizeof(buf) ? left : sizeof(buf), 0);
+			if(n <= 0) {
+				f->error = true;
+				break;
+			}
+			left -= (size_t)n;
+			if(atomic_load(&measuring)) {
+				f->bytes += (uint64_t)n;
+			}
+		}
+		f->error = f->error || _request(f->fd, GW_OP_RANDOM, f->request) != 0;
+	}
+	return NULL;
+}
+
+/* The QRNG takes 20 ms per chunk, so the buffer is what both clients share.
+ * Both clients have more requests queued than a refill of the buffer. With
+ * a fixed quantum per turn the client of half quantum requests would get
+ * half the bytes of the other one. */
+static void _test_share(const int port) {
+
+	gwFlow flows[2] = {
+		{ -1, SMALL_REQUEST, SMALL_PIPELINE, 0, false },
+		{ -1, GW_MAX_REQUEST, BIG_PIPELINE, 0, false }
+	};
+	pthread_t threads[2];
+
+	atomic_store(&measuring, false);
+	atomic_store(&stopping, false);
+
+	for(int i = 0; i < 2; ++i) {
+		flows[i].fd = _connect(port);
+		if(flows[i].fd < 0) {
+			_check(false, "share: connect");
+			return;
+		}
+	}
+	for(int i = 0; i < 2; ++i) {
+		pthread_create(&threads[i], NULL, _flow, &flows[i]);
+	}
+
+	/* The buffer filled at the start is drained before measuring. */
+	_sleep_ms(WARMUP_MS);
+	atomic_store(&measuring, true);
+	_sleep_ms(MEASURE_MS);
+	atomic_store(&measuring, false);
+	atomic_store(&stopping, true);
+
+	/* The sockets are shut down so the blocked reads return. */
+	for(int i = 0; i < 2; ++i) {
+		shutdown(flows[i].fd, SHUT_RDWR);
+	}
+	for(int i = 0; i < 2; ++i) {
+		pthread_join(threads[i], NULL);
+		close(flows[i].fd);
+	}
+
+	const double ratio = flows[1].bytes > 0 ? (double)flows[0].bytes / (double)flows[1].bytes : 0.0;
+	printf("     small requests %llu bytes, big requests %llu bytes\n", (unsigned long long)flows[0].bytes,
+			(unsigned long long)flows[1].bytes);
+	_check(flows[0].bytes > 0 && ratio > 0.8 && ratio < 1.25, "same share for small and big requests");
+}
+
+int main(void) {
+
+	basePort = 20000 + (int)(getpid() % 20000);
+
+	_test_frames();
+
+	pid_t pid = _start_gateway(basePort, "127.0.0.1", 0);
+	_test_requests(basePort);
+	_test_client(basePort);
+	_stop_gateway(pid);
+
+	pid = _start_gateway(basePort + 1, "127.0.0.1", QUOTA);
+	_test_quota(basePort + 1);
+	_stop_gateway(pid);
+
+	pid = _start_gateway(basePort + 2, "stall:20", 0);
+	_test_share(basePort + 2);
+	_stop_gateway(pid);
+
+	return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,326 @@
+/*
+ ============================================================================
+ Name        : QusideQRNG_TestProvider.c
+ Author      : Alvaro Velasco Garcia, Heriberto J. Diaz
+ Created on  : 18 oct. 2022
+ Version     : 0.1
+ Copyright   : Copyright (C) 2022 QUSIDE TECHNOLOGIES - All Rights Reserved.
+               Unauthorized copying of this file, via any medium is
+               strictly prohibited.
+ Description : Loads libqusideQRNGprovider.so from configuration files, as
+               OpenSSL does, and checks it as seed source and as DRBG (both
+               at most 5% slower than the default DRBG, the median of
+               alternate rounds), with a buffer over the limit of locked
+               memory, with captures that fail, with the connection already
+               open by the application, sharing the combiner of the
+               application and with a QRNG that stalls when it is unloaded.
+               Returns 0 if all the checks pass.
+ ============================================================================
+ */
+
+#include "quside_QRNG_provider.h"
+#include "quside_QRNG_combiner.h"
+#include <quside_QRNG_user.h>
+#include <openssl/provider.h>
+#include <openssl/rand.h>
+#include <openssl/params.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <limits.h>
+#include <time.h>
+
+#define SEED		"seed = " QRNG_PROVIDER_RAND "\nseed_properties = " QRNG_PROVIDER_PROPERTIES "\n"
+#define DRBG		"random = " QRNG_PROVIDER_RAND "\nproperties = " QRNG_PROVIDER_PROPERTIES "\n"
+#define REQUESTS	2000		/* Requests of a round. */
+#define RATE_ROUNDS	151
+#define RATE_GAP	0.05		/* Speed that the QRNG can cost. */
+#define STALL_MS	3000
+#define SLACK_MS	500.0
+
+/* Socket of the library, exported so the provider sees a connection open. */
+int tcpSocket = 0;
+
+typedef struct {
+	uint64_t hits;
+	uint64_t misses;
+	uint64_t qrngBytes;
+	uint64_t osBytes;
+	uint64_t errors;
+	uint64_t locked;
+	unsigned int connected;
+} provCounters;
+
+static int failures = 0;
+static char dir[] = "/tmp/qprov.XXXXXX";
+
+static void _check(const bool ok, const char* what) {
+
+	printf("%s %s\n", ok ? "PASS" : "FAIL", what);
+	if(!ok) {
+		++failures;
+	}
+}
+
+static double _ms_since(const struct timespec* t0) {
+
+	struct timespec t1;
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	return (double)(t1.tv_sec - t0->tv_sec) * 1e3 + (double)(t1.tv_nsec - t0->tv_nsec) / 1e6;
+}
+
+static void _sleep_ms(const long ms) {
+
+	const struct timespec t = { ms / 1000, (ms % 1000) * 1000000L };
+	nanosleep(&t, NULL);
+}
+
+/* Library context with the provider loaded from a configuration file. */
+static OSSL_LIB_CTX* _load(const char* server, const char* options, const char* random) {
+
+	char cwd[PATH_MAX];
+	char path[PATH_MAX + 32];
+
+	snprintf(path, sizeof(path), "%s/openssl.cnf", dir);
+	FILE* f = fopen(path, "w");
+	if(f == NULL || getcwd(cwd, sizeof(cwd)) == NULL) {
+		return NULL;
+	}
+	fprintf(f, "openssl_conf = openssl_init\n[openssl_init]\nproviders = provider_sect\n"
+			"random = random_sect\n[provider_sect]\ndefault = default_sect\nquside = quside_sect\n"
+			"[default_sect]\nactivate = 1\n[quside_sect]\nmodule = %s/libqusideQRNGprovider.so\n"
+			"server = %s\n%sactivate = 1\n[random_sect]\n%s", cwd, server, options, random);
+	fclose(f);
+
+	OSSL_LIB_CTX* ctx = OSSL_LIB_CTX_new();
+	if(ctx != NULL && !OSSL_LIB_CTX_load_config(ctx, path)) {
+		OSSL_LIB_CTX_free(ctx);
+		ctx = NULL;
+	}
+	unlink(path);
+	return ctx;
+}
+
+static void _counters(OSSL_LIB_CTX* ctx, provCounters* c) {
+
+	uint64_t available = 0;
+	OSSL_PARAM params[] = {
+		OSSL_PARAM_uint64(QRNG_PROVIDER_PARAM_HITS, &c->hits),
+		OSSL_PARAM_uint64(QRNG_PROVIDER_PARAM_MISSES, &c->misses),
+		OSSL_PARAM_uint64(QRNG_PROVIDER_PARAM_QRNG_BYTES, &c->qrngBytes),
+		OSSL_PARAM_uint64(QRNG_PROVIDER_PARAM_OS_BYTES, &c->osBytes),
+		OSSL_PARAM_uint64(QRNG_PROVIDER_PARAM_ERRORS, &c->errors),
+		OSSL_PARAM_uint64(QRNG_PROVIDER_PARAM_AVAILABLE, &available),
+		OSSL_PARAM_uint64(QRNG_PROVIDER_PARAM_LOCKED, &c->locked),
+		OSSL_PARAM_uint(QRNG_PROVIDER_PARAM_CONNECTED, &c->connected),
+		OSSL_PARAM_END
+	};
+
+	memset(c, 0, sizeof(*c));
+	OSSL_PROVIDER* prov = OSSL_PROVIDER_load(ctx, "quside");
+	if(prov != NULL) {
+		OSSL_PROVIDER_get_params(prov, params);
+		OSSL_PROVIDER_unload(prov);
+	}
+}
+
+/* Requests of 32 bytes per second, as the nonces of the handshakes. */
+static double _rand_rate(OSSL_LIB_CTX* ctx, bool* ok) {
+
+	unsigned char buf[32];
+	struct timespec t0;
+
+	*ok = true;
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for(int i = 0; i < REQUESTS && *ok; ++i) {
+		*ok = RAND_bytes_ex(ctx, buf, sizeof(buf), 0) == 1;
+	}
+	return REQUESTS / _ms_since(&t0) * 1e3;
+}
+
+/* Speed of a context with the provider against the default context: the
+ * median of the ratios of RATE_ROUNDS short rounds, each one running both,
+ * so the changes of the load of the machine cancel. Two default contexts
+ * measured this way differ in less than 1%. */
+static double _rate_ratio(OSSL_LIB_CTX* ctx, double* refRate, double* rate, bool* ok) {
+
+	OSSL_LIB_CTX* ref = OSSL_LIB_CTX_new();
+	double ratios[RATE_ROUNDS];
+	bool refOk = true, ctxOk = true;
+
+	*refRate = 0.0;
+	*rate = 0.0;
+	for(int r = 0; r < RATE_ROUNDS; ++r) {
+		const double a = _rand_rate(ref, &refOk);
+		const double b = _rand_rate(ctx, &ctxOk);
+		ratios[r] = b / a;
+		*refRate += a / RATE_ROUNDS;
+		*rate += b / RATE_ROUNDS;
+		*ok = refOk && ctxOk;
+	}
+	OSSL_LIB_CTX_free(ref);
+
+	/* Insertion sort, the rounds are a few. */
+	for(int i = 1; i < RATE_ROUNDS; ++i) {
+		const double v = ratios[i];
+		int j = i;
+		while(j > 0 && ratios[j - 1] > v) {
+			ratios[j] = ratios[j - 1];
+			--j;
+		}
+		ratios[j] = v;
+	}
+	return ratios[RATE_ROUNDS / 2];
+}
+
+/* Returns if mlock is limited by RLIMIT_MEMLOCK in this process. */
+static bool _memlock_limited(void) {
+
+	const size_t size = 4 << 20;
+	void* p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	const bool limited = p != MAP_FAILED && mlock(p, size) != 0;
+
+	if(p != MAP_FAILED) {
+		munmap(p, size);
+	}
+	return limited;
+}
+
+int main(void) {
+
+	provCounters c0, c1;
+	combinerStats cs;
+	struct rlimit saved, limit;
+	struct timespec t0;
+	unsigned char buf[4096];
+	bool ok;
+
+	if(mkdtemp(dir) == NULL) {
+		puts("FAIL mkdtemp");
+		return 1;
+	}
+
+	/* Seed source: the DRBG of OpenSSL is seeded from the buffer. */
+	double refRate, rate;
+	OSSL_LIB_CTX* ctx = _load("127.0.0.1", "", SEED);
+	_check(ctx != NULL, "configuration as seed source");
+	if(ctx == NULL) {
+		return 1;
+	}
+	_sleep_ms(200);
+	_counters(ctx, &c0);
+	double ratio = _rate_ratio(ctx, &refRate, &rate, &ok);
+	_counters(ctx, &c1);
+	_check(ok && c1.connected == 1 && c1.locked == 1024 * 1024 && c1.hits > c0.hits && c1.misses == c0.misses,
+			"seed taken from the locked buffer");
+	printf("     %.0f requests/s of the default DRBG, %.0f seeded by the QRNG (median %+.1f%%)\n", refRate, rate,
+			100.0 * (ratio - 1.0));
+	_check(ratio > 1.0 - RATE_GAP, "DRBG seeded by the QRNG at most 5% slower than the default one");
+	OSSL_LIB_CTX_free(ctx);
+
+	/* DRBG: every request comes from the buffer or from the OS, with the
+	 * lock of the buffer and a copy from it. */
+	ctx = _load("127.0.0.1", "", DRBG);
+	_sleep_ms(200);
+	ratio = _rate_ratio(ctx, &refRate, &rate, &ok);
+	_counters(ctx, &c1);
+	printf("     %.0f requests/s of the default DRBG, %.0f of the provider (median %+.1f%%), %llu misses\n", refRate,
+			rate, 100.0 * (ratio - 1.0), (unsigned long long)c1.misses);
+	_check(ok && ratio > 1.0 - RATE_GAP, "DRBG of the provider at most 5% slower than the default one");
+	_counters(ctx, &c0);
+	ok = true;
+	for(int i = 0; i < 64 && ok; ++i) {
+		ok = RAND_bytes_ex(ctx, buf, sizeof(buf), 0) == 1;
+	}
+	_counters(ctx, &c1);
+	_check(ok && c1.hits > c0.hits && (c1.qrngBytes - c0.qrngBytes) + (c1.osBytes - c0.osBytes) >= 64 * sizeof(buf),
+			"configuration as DRBG");
+	OSSL_LIB_CTX_free(ctx);
+
+	/* Buffer over the limit of locked memory. */
+	getrlimit(RLIMIT_MEMLOCK, &saved);
+	limit = saved;
+	limit.rlim_cur = 2 << 20;
+	setrlimit(RLIMIT_MEMLOCK, &limit);
+	if(_memlock_limited()) {
+		ctx = _load("127.0.0.1", QRNG_PROVIDER_PARAM_BUFFER " = 8192\n", SEED);
+		_sleep_ms(100);
+		_counters(ctx, &c1);
+		_check(c1.locked > 0 && c1.locked <= (2 << 20) && c1.connected == 1, "buffer reduced to the locked memory");
+		OSSL_LIB_CTX_free(ctx);
+
+		limit.rlim_cur = 65536;
+		setrlimit(RLIMIT_MEMLOCK, &limit);
+		ctx = _load("127.0.0.1", "", SEED);
+		_sleep_ms(100);
+		_counters(ctx, &c1);
+		_check(c1.locked == 0 && c1.connected == 0 && RAND_bytes_ex(ctx, buf, 32, 0) == 1,
+				"OS used when the buffer can not be locked");
+		OSSL_LIB_CTX_free(ctx);
+
+		ctx = _load("127.0.0.1", QRNG_PROVIDER_PARAM_UNLOCKED " = 1\n", SEED);
+		_sleep_ms(100);
+		_counters(ctx, &c1);
+		_check(c1.locked == 0 && c1.connected == 1, "buffer not locked with allow_unlocked");
+		OSSL_LIB_CTX_free(ctx);
+	} else {
+		puts("SKIP limit of locked memory (the process can lock without limit)");
+	}
+	setrlimit(RLIMIT_MEMLOCK, &saved);
+
+	/* Failed captures: OS fallback, and the waits double (0, 1 and 3 s). */
+	ctx = _load("fail", "", DRBG);
+	_counters(ctx, &c0);
+	_sleep_ms(3500);
+	_counters(ctx, &c1);
+	_check(RAND_bytes_ex(ctx, buf, 32, 0) == 1 && c1.errors - c0.errors <= 3 && c1.errors - c0.errors >= 2,
+			"backoff doubled after failed captures");
+	printf("     %llu failed captures in 3.5 s\n", (unsigned long long)(c1.errors - c0.errors));
+	OSSL_LIB_CTX_free(ctx);
+
+	/* The connection of the library is already open. */
+	tcpSocket = 42;
+	_counters(NULL, &c0);
+	ctx = _load("127.0.0.1", "", SEED);
+	_sleep_ms(100);
+	_counters(ctx, &c1);
+	_check(c1.connected == 0 && c1.locked == 0 && c1.errors > c0.errors && RAND_bytes_ex(ctx, buf, 32, 0) == 1,
+			"connection of the application not taken");
+	OSSL_LIB_CTX_free(ctx);
+
+	/* Shared: the application owns the connection and the combiner. */
+	connectToServer("127.0.0.1");
+	combiner_init(0);
+	ctx = _load("", QRNG_PROVIDER_PARAM_SHARED " = 1\n", DRBG);
+	_sleep_ms(100);
+	_counters(ctx, &c0);
+	ok = RAND_bytes_ex(ctx, buf, sizeof(buf), 0) == 1;
+	_counters(ctx, &c1);
+	combiner_get_stats(&cs);
+	_check(ok && c1.connected == 1 && c1.hits > c0.hits && cs.requests > 0, "captures through the combiner");
+	OSSL_LIB_CTX_free(ctx);
+	combiner_release();
+	tcpSocket = 0;
+
+	/* The thread is blocked in a capture when the provider is unloaded. */
+	char stall[32];
+	snprintf(stall, sizeof(stall), "stall:%d", STALL_MS);
+	ctx = _load(stall, "", SEED);
+	_sleep_ms(200);
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	OSSL_LIB_CTX_free(ctx);
+	const double ms = _ms_since(&t0);
+	printf("     unloaded in %.1f ms\n", ms);
+	_check(ms < 1000.0 + SLACK_MS, "unload does not wait for a stalled capture");
+
+	/* The thread left frees the buffer when its capture returns. */
+	_sleep_ms(STALL_MS + 200);
+	ctx = _load("127.0.0.1", "", SEED);
+	_sleep_ms(100);
+	_counters(ctx, &c1);
+	_check(c1.connected == 1 && RAND_bytes_ex(ctx, buf, 32, 0) == 1, "loaded again after the stalled capture");
+	OSSL_LIB_CTX_free(ctx);
+
+	rmdir(dir);
+
+	return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,105 @@
+/*
+ ============================================================================
+ Name        : QusideQRNG_TestSHA256.c
+ Author      : Alvaro Velasco Garcia, Heriberto J. Diaz
+ Created on  : 18 oct. 2022
+ Version     : 0.1
+ Copyright   : Copyright (C) 2022 QUSIDE TECHNOLOGIES - All Rights Reserved.
+               Unauthorized copying of this file, via any medium is
+               strictly prohibited.
+ Description : Checks quside_QRNG_sha256 with the test vectors of FIPS 180-2
+               and of the NIST examples of SHA-256, in one call and split in
+               updates of many sizes. Returns 0 if all the checks pass.
+ ============================================================================
+ */
+
+#include "quside_QRNG_sha256.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+	const char* message;
+	size_t repeat;
+	const char* digest;
+} sha256Vector;
+
+static const sha256Vector vectors[] = {
+	{ "", 1,
+		"e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855" },
+	{ "abc", 1,
+		"ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad" },
+	{ "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq", 1,
+		"248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1" },
+	{ "abcdefghbcdefghicdefghijdefghijkefghijklfghijklmghijklmnhijklmno"
+		"ijklmnopjklmnopqklmnopqrlmnopqrsmnopqrstnopqrstu", 1,
+		"cf5b16a778af8380036ce59e7b0492370b249b11e8f07a51afac45037afee9d1" },
+	{ "a", 1000000,
+		"cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0" }
+};
+
+static const size_t bigSteps[] = { 1, 3, 63, 64, 65, 129, 4096 };
+
+static int failures = 0;
+
+static void _check(const bool ok, const char* what) {
+
+	printf("%s %s\n", ok ? "PASS" : "FAIL", what);
+	if(!ok) {
+		++failures;
+	}
+}
+
+static void _hex(const uint8_t* digest, char* out) {
+
+	for(int i = 0; i < SHA256_DIGEST_SIZE; ++i) {
+		sprintf(out + 2 * i, "%02x", digest[i]);
+	}
+}
+
+int main(void) {
+
+	char hex[2 * SHA256_DIGEST_SIZE + 1];
+	char what[128];
+	uint8_t digest[SHA256_DIGEST_SIZE];
+
+	printf("SHA extensions: %s\n", sha256_accelerated() ? "yes" : "no");
+
+	for(size_t v = 0; v < sizeof(vectors) / sizeof(vectors[0]); ++v) {
+		const size_t len = strlen(vectors[v].message);
+		const size_t total = len * vectors[v].repeat;
+		uint8_t* data = (uint8_t*)malloc(total + 1);
+
+		for(size_t r = 0; r < vectors[v].repeat; ++r) {
+			memcpy(data + r * len, vectors[v].message, len);
+		}
+
+		sha256(data, total, digest);
+		_hex(digest, hex);
+		snprintf(what, sizeof(what), "vector %zu in one call", v);
+		_check(strcmp(hex, vectors[v].digest) == 0, what);
+
+		/* Updates of every size up to two blocks cross all the paths of the
+		 * buffer. The million bytes vector only with some of them. */
+		bool ok = true;
+		const size_t nSteps = total > 4096 ? sizeof(bigSteps) / sizeof(bigSteps[0]) : 2 * SHA256_BLOCK_SIZE + 1;
+		for(size_t i = 0; i < nSteps && ok; ++i) {
+			const size_t step = total > 4096 ? bigSteps[i] : i + 1;
+			sha256Ctx ctx;
+
+			sha256_init(&ctx);
+			for(size_t pos = 0; pos < total; pos += step) {
+				sha256_update(&ctx, data + pos, total - pos < step ? total - pos : step);
+			}
+			sha256_final(&ctx, digest);
+			_hex(digest, hex);
+			ok = strcmp(hex, vectors[v].digest) == 0;
+		}
+		snprintf(what, sizeof(what), "vector %zu in updates", v);
+		_check(ok, what);
+
+		free(data);
+	}
+
+	return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,198 @@
+/*
+ ============================================================================
+ Name        : QusideQRNG_TestTelemetry.c
+ Author      : Alvaro Velasco Garcia, Heriberto J. Diaz
+ Created on  : 18 oct. 2022
+ Version     : 0.1
+ Copyright   : Copyright (C) 2022 QUSIDE TECHNOLOGIES - All Rights Reserved.
+               Unauthorized copying of this file, via any medium is
+               strictly prohibited.
+ Description : Checks the delta encoding of the telemetry history. The
+               module is included, so the rings are written directly with
+               known points and read back: deltas that fill a block, gaps,
+               deltas that do not fit in 16 bits and a ring that wraps
+               around, also the means of the minutes. Then the sampler with
+               the monitors of the admin mode mock. Returns 0 if all the
+               checks pass.
+ ============================================================================
+ */
+
+#include "quside_QRNG_telemetry.c"
+#include <stdio.h>
+#include <unistd.h>
+
+#define EXPECTED_POINTS		16384
+#define RING_POINTS			(64 * TELEMETRY_BLOCK_POINTS)	/* Points of the second resolution. */
+
+static int failures = 0;
+
+/* Points written to the ring under test, oldest first. */
+static int32_t expValues[EXPECTED_POINTS];
+static int64_t expTimes[EXPECTED_POINTS];
+static int expCount = 0;
+
+static double values[RING_POINTS];
+static time_t times[RING_POINTS];
+
+static void _check(const bool ok, const char* what) {
+
+	printf("%s %s\n", ok ? "PASS" : "FAIL", what);
+	if(!ok) {
+		++failures;
+	}
+}
+
+static void _append(telemetryRing* r, const int64_t t, const int32_t q, const int period) {
+
+	_ring_append(r, t, q, period);
+	expValues[expCount] = q;
+	expTimes[expCount] = t;
+	++expCount;
+}
+
+/* Reads the last maxPoints points and compares them with the last written. */
+static bool _roundtrip(const telemetryRing* r, const int period, const int maxPoints) {
+
+	const int stored = _ring_points(r);
+	const int want = stored < maxPoints ? stored : maxPoints;
+	const int got = _ring_read(r, period, values, times, maxPoints);
+
+	if(got != want || got > expCount) {
+		printf("     %d points read, %d expected\n", got, want);
+		return false;
+	}
+
+	int bad = 0;
+	for(int i = 0; i < got; ++i) {
+		const int j = expCount - got + i;
+		if(llround(values[i] * TELEMETRY_SCALE) != expValues[j] || (int64_t)times[i] != expTimes[j]) {
+			++bad;
+		}
+	}
+	if(bad > 0) {
+		printf("     %d of %d points differ\n", bad, got);
+	}
+	return bad == 0;
+}
+
+/* A new series, with the points written to it forgotten. */
+static telemetrySeries* _fresh(telemetrySeries* old) {
+
+	_series_free(old);
+	expCount = 0;
+	return _series_new();
+}
+
+int main(void) {
+
+	telemetrySeries* s = _fresh(NULL);
+	telemetryRing* r = &s->tiers[TELEMETRY_SECOND];
+
+	/* Deltas of one period fill a block with its 64 points. */
+	for(int i = 0; i < TELEMETRY_BLOCK_POINTS; ++i) {
+		_append(r, 1000 + i, 25000 + (i % 7) - 3, 1);
+	}
+	const int oneBlock = r->count;
+	_append(r, 1000 + TELEMETRY_BLOCK_POINTS, 25000, 1);
+	_check(oneBlock == 1 && r->count == 2 && _roundtrip(r, 1, RING_POINTS), "block boundary of the deltas");
+
+	/* A gap takes 4 codes: 15 of them and 3 deltas fill the 63 codes. */
+	s = _fresh(s);
+	r = &s->tiers[TELEMETRY_SECOND];
+	int64_t t = 5000;
+	_append(r, t, 0, 1);
+	for(int i = 0; i < 15; ++i) {
+		t += 2 + i;
+		_append(r, t, i, 1);
+	}
+	for(int i = 0; i < 3; ++i) {
+		_append(r, ++t, 100 + i, 1);
+	}
+	const bool full = r->count == 1 && r->blocks[r->head].codes == TELEMETRY_BLOCK_CODES;
+	t += 3;
+	_append(r, t, 200, 1);
+	_check(full && r->count == 2 && _roundtrip(r, 1, RING_POINTS), "block boundary of the escapes");
+
+	/* Gaps: the largest skip that fits, one more, the time going back, the
+	 * same time, and a time that is not a whole number of periods. */
+	s = _fresh(s);
+	r = &s->tiers[TELEMETRY_MINUTE];
+	t = 60;
+	_append(r, t, 7, 60);
+	t += 2 * 60;
+	_append(r, t, 8, 60);
+	t += (int64_t)(UINT16_MAX + 1) * 60;
+	_append(r, t, 9, 60);
+	const int gapBlocks = r->count;
+	t += (int64_t)(UINT16_MAX + 2) * 60;
+	_append(r, t, 10, 60);
+	const int skipBlocks = r->count;
+	_append(r, t - 60, 11, 60);
+	_append(r, t - 60, 12, 60);
+	_append(r, t + 30, 13, 60);
+	_append(r, t + 90, 14, 60);
+	_check(gapBlocks == 1 && skipBlocks == 2 && r->count == 5 && _roundtrip(r, 60, RING_POINTS),
+			"gaps in the samples");
+
+	/* Deltas at the limits of 16 bits and over them. */
+	s = _fresh(s);
+	r = &s->tiers[TELEMETRY_SECOND];
+	const int32_t wide[] = { 0, INT16_MAX, 0, INT16_MIN + 1, 0, INT16_MIN, 0, INT16_MAX + 1,
+			INT32_MAX, INT32_MIN, INT32_MAX, -1, 0 };
+	for(size_t i = 0; i < sizeof(wide) / sizeof(wide[0]); ++i) {
+		_append(r, 100 + (int64_t)i, wide[i], 1);
+	}
+	_check(r->count == 1 && _roundtrip(r, 1, RING_POINTS), "wide deltas");
+
+	/* Small and wide deltas and gaps over three times the ring. */
+	s = _fresh(s);
+	r = &s->tiers[TELEMETRY_SECOND];
+	unsigned int x = 1;
+	int32_t q = 0;
+	t = 1000;
+	while(expCount < 3 * RING_POINTS) {
+		x = x * 1103515245u + 12345u;
+		const unsigned int kind = (x >> 16) % 10;
+		t += kind == 0 ? 2 + (x >> 8) % 50 : 1;
+		if(kind == 1) {
+			q += 100000 - (int32_t)((x >> 4) % 200000);
+		} else {
+			q += (int32_t)((x >> 20) % 21) - 10;
+		}
+		_append(r, t, q, 1);
+	}
+	printf("     %d points written, %d kept in %d blocks\n", expCount, _ring_points(r), r->count);
+	_check(r->count == r->capacity && _roundtrip(r, 1, RING_POINTS) && _roundtrip(r, 1, 100),
+			"ring wrapped around");
+
+	/* Means of the minutes, the current minute is not written yet. */
+	s = _fresh(s);
+	for(int i = 0; i < 150; ++i) {
+		_series_add(s, i, i < 60 ? 20.0 : 20.5 + (i % 2));
+	}
+	const int minutes = _ring_read(&s->tiers[TELEMETRY_MINUTE], 60, values, times, RING_POINTS);
+	_check(minutes == 2 && values[0] == 20.0 && values[1] == 21.0 && times[0] == 0 && times[1] == 60,
+			"means of the minutes");
+	_series_free(s);
+
+	/* The sampler with the monitors of the mock, the first sample is taken
+	 * when it starts. */
+	const uint16_t devs[1] = { 0 };
+	double value[2];
+	int temps = -1, chans = -1, power = -1;
+	if(telemetry_start(devs, 1, NULL) == 0) {
+		for(int tries = 0; tries < 100 && temps <= 0; ++tries) {
+			usleep(10000);
+			temps = telemetry_get_series(0, TELEMETRY_TEMPERATURE, 0, TELEMETRY_SECOND, value, NULL, 2);
+		}
+		chans = telemetry_num_channels(0, TELEMETRY_OPTICAL_POWER);
+		power = telemetry_get_series(0, TELEMETRY_OPTICAL_POWER, 1, TELEMETRY_SECOND, value + 1, NULL, 1);
+		telemetry_stop();
+	}
+	_check(temps >= 1 && value[0] == 31.25 && chans == 2 && power == 1 && value[1] == 1.0,
+			"samples of the monitors");
+	_check(telemetry_get_series(0, TELEMETRY_TEMPERATURE, 0, TELEMETRY_SECOND, value, NULL, 2) == -1,
+			"no series after telemetry_stop");
+
+	return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,152 @@
+/*
+ ============================================================================
+ Name        : QusideQRNG_TestWindow.c
+ Author      : Alvaro Velasco Garcia, Heriberto J. Diaz
+ Created on  : 18 oct. 2022
+ Version     : 0.1
+ Copyright   : Copyright (C) 2022 QUSIDE TECHNOLOGIES - All Rights Reserved.
+               Unauthorized copying of this file, via any medium is
+               strictly prohibited.
+ Description : Checks that the window grows over one chunk with two healthy
+               sessions, and that window_get_random_deadline returns
+               WINDOW_TIMEOUT close to its deadline when the sessions of a
+               QRNG stall: with the RTT probe due in a stalled session, while
+               another thread holds the engine with a capture waiting for
+               the stalled QRNG, and with the deadline already over. Once the
+               stalled sessions are known, a capture goes through the
+               healthy ones in about their own time. Returns 0 if all the
+               checks pass.
+ ============================================================================
+ */
+
+#include "quside_QRNG_window.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define STALL_MS			1000
+#define DEADLINE_US			100000
+#define SLACK_MS			50.0		/* Time accepted over the deadline. */
+#define CAPTURE_BYTES		(1 << 20)
+#define HEALTHY_CAPTURES	16			/* Captures that measure the healthy sessions. */
+
+static int failures = 0;
+static uint8_t holderBuffer[CAPTURE_BYTES];
+static int holderResult = -1;
+
+static void _check(const bool ok, const char* what, const double ms) {
+
+	printf("%s %s (%.1f ms)\n", ok ? "PASS" : "FAIL", what, ms);
+	if(!ok) {
+		++failures;
+	}
+}
+
+static double _ms_since(const struct timespec* t0) {
+
+	struct timespec t1;
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	return (double)(t1.tv_sec - t0->tv_sec) * 1e3 + (double)(t1.tv_nsec - t0->tv_nsec) / 1e6;
+}
+
+static void _sleep_ms(const long ms) {
+
+	const struct timespec t = { ms / 1000, (ms % 1000) * 1000000L };
+	nanosleep(&t, NULL);
+}
+
+/* Capture without deadline that waits for the stalled QRNG. */
+static void* _holder(void* arg) {
+
+	(void)arg;
+	holderResult = window_get_random((uint32_t*)holderBuffer, CAPTURE_BYTES, 0);
+	return NULL;
+}
+
+/* Capture with deadline, returns its result and its time in ms. */
+static int _deadline_capture(uint8_t* buffer, const uint64_t timeoutUs, double* ms) {
+
+	struct timespec t0;
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	const int ret = window_get_random_deadline((uint32_t*)buffer, CAPTURE_BYTES, 0, timeoutUs);
+	*ms = _ms_since(&t0);
+
+	return ret;
+}
+
+int main(void) {
+
+	char stall[32];
+	char* servers[2] = { stall, "127.0.0.1" };
+	windowOptions options;
+	windowStats ws;
+	pthread_t holder;
+	double ms;
+
+	uint8_t* buffer = (uint8_t*)malloc(CAPTURE_BYTES);
+	const double limitMs = DEADLINE_US / 1000.0 + SLACK_MS;
+
+	memset(&options, 0, sizeof(options));
+	options.streamsPerServer = 2;
+	options.fixedTuning = true;
+
+	/* Time of the healthy sessions alone, the best of several captures. */
+	if(buffer == NULL || window_init(&servers[1], 1, &options) != 0) {
+		puts("FAIL window_init");
+		return 1;
+	}
+	double healthyMs = 0.0;
+	for(int i = 0; i < HEALTHY_CAPTURES; ++i) {
+		struct timespec t0;
+		clock_gettime(CLOCK_MONOTONIC, &t0);
+		window_get_random((uint32_t*)buffer, CAPTURE_BYTES, 0);
+		ms = _ms_since(&t0);
+		if(i == 0 || ms < healthyMs) {
+			healthyMs = ms;
+		}
+	}
+	window_get_stats(&ws);
+	printf("     window %zu bytes, bandwidth %.0f MB/s\n", ws.windowBytes, ws.bandwidth / 1e6);
+	_check(ws.windowBytes >= 2 * WINDOW_DEFAULT_CHUNK, "window of two sessions over one chunk", healthyMs);
+	window_release();
+
+	/* The first session, the one of the first RTT probe, is stalled. */
+	snprintf(stall, sizeof(stall), "stall:%d", STALL_MS);
+
+	if(window_init(servers, 2, &options) != 0) {
+		puts("FAIL window_init");
+		return 1;
+	}
+
+	int ret = _deadline_capture(buffer, DEADLINE_US, &ms);
+	_check(ret == WINDOW_TIMEOUT && ms < limitMs, "deadline with the probe due in a stalled session", ms);
+	_sleep_ms(STALL_MS + 200);
+
+	/* The holder keeps the engine until its chunks of the stalled QRNG arrive. */
+	pthread_create(&holder, NULL, _holder, NULL);
+	_sleep_ms(100);
+	ret = _deadline_capture(buffer, DEADLINE_US, &ms);
+	_check(ret == WINDOW_TIMEOUT && ms < limitMs, "deadline while another thread holds the engine", ms);
+	pthread_join(holder, NULL);
+	_check(holderResult == 0, "capture without deadline of the holder", 0.0);
+
+	ret = _deadline_capture(buffer, 1, &ms);
+	_check(ret == WINDOW_TIMEOUT && ms < SLACK_MS, "deadline over before the first chunk", ms);
+	_sleep_ms(STALL_MS + 200);
+
+	/* The stalled sessions were late in the capture of the holder, so they
+	 * get no chunks and the capture takes the time of the healthy ones. */
+	ret = _deadline_capture(buffer, 5 * STALL_MS * 1000, &ms);
+	_check(ret == 0 && ms < 2.0 * healthyMs + SLACK_MS / 5.0, "capture through the healthy sessions", ms);
+
+	window_get_stats(&ws);
+	_check(ws.deadlineMisses == 3, "deadline misses counted", 0.0);
+
+	window_release();
+	free(buffer);
+
+	return failures == 0 ? 0 : 1;
+}
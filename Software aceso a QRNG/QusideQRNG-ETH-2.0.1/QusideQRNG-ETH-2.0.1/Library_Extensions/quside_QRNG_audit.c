@@ -0,0 +1,876 @@
+/*
+ ============================================================================
+ Name        : quside_QRNG_audit.c
+ Author      : Alvaro Velasco Garcia, Heriberto J. Diaz
+ Created on  : 18 oct. 2022
+ Version     : 0.1
+ Copyright   : Copyright (C) 2022 QUSIDE TECHNOLOGIES - All Rights Reserved.
+               Unauthorized copying of this file, via any medium is
+               strictly prohibited.
+ Description : Audit log of the captures.
+
+               The capturing threads only hash the block and queue a record.
+               A writer thread chains the queued records and writes them in
+               batches with one write. The queue never drops records: if it
+               is full, the capturing thread waits. After each batch the head
+               of the chain is rewritten in the head file, and audit_close
+               writes the record that seals the log.
+
+               A batch that fails to be written is cut from the log and the
+               chain goes back to the head, so the records stay queued and
+               the writer tries them again every flushMs. Meanwhile
+               audit_record fails, the blocks it is given would not be in
+               the log. The records that are still queued when the log is
+               closed are counted as lost.
+
+               The verifier maps the log and splits the records between
+               threads. Each link only needs the chainHash of the previous
+               record, so all the links are checked in parallel. The data
+               hashes are sorted to find the blocks recorded twice. The
+               records with the same prefix of the hash are compared whole,
+               all of them with each other.
+ ============================================================================
+ */
+
+#include "quside_QRNG_audit.h"
+#include "quside_QRNG_sha256.h"
+#include "quside_QRNG_combiner.h"
+#include <quside_QRNG_user.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <endian.h>
+#include <math.h>
+
+#define AUDIT_QUEUE				4096
+#define AUDIT_HMIN_PERIOD_NS	60000000000ULL
+#define AUDIT_MAX_DEVICES		64
+#define AUDIT_LINK_SIZE			72		/* Bytes of a record covered by its chainHash. */
+
+/* Only the admin mode library has get_hmin. */
+extern int get_hmin(const uint16_t devInd, float* hMin) __attribute__((weak));
+
+/* Record waiting to be chained and written. */
+typedef struct {
+	uint64_t seq;
+	uint64_t timeNs;
+	uint64_t offset;
+	uint32_t length;
+	uint16_t devID;
+	uint16_t flags;
+	float hmin;
+	uint8_t dataHash[SHA256_DIGEST_SIZE];
+} auditEntry;
+
+static int logFd = -1;
+static auditEntry* queue = NULL;
+static size_t queueHead = 0;			/* Next entry to write. */
+static size_t queueCount = 0;
+static size_t batchRecords = AUDIT_DEFAULT_BATCH;
+static int flushMs = AUDIT_DEFAULT_FLUSH_MS;
+static bool syncBatches = false;
+static bool closing = false;
+static bool failing = false;			/* The last batch was not written. */
+static uint64_t nextSeq = 0;
+static uint64_t nextOffset = 0;
+static uint8_t chain[SHA256_DIGEST_SIZE];
+static char* headPath = NULL;
+static auditHead head;					/* Head of the records written. */
+static pthread_t writer;
+static pthread_mutex_t auditMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t writerCond;
+static pthread_cond_t roomCond = PTHREAD_COND_INITIALIZER;
+static auditStats stats;
+
+static uint16_t devIDs[AUDIT_MAX_DEVICES];
+static uint16_t numDevIDs = 0;
+static float hmins[AUDIT_MAX_DEVICES];
+static uint64_t hminNs[AUDIT_MAX_DEVICES];
+
+static uint64_t _clock_ns(const clockid_t clock) {
+
+	struct timespec ts;
+	clock_gettime(clock, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static void _put16(uint8_t* p, const uint16_t v) {
+	const uint16_t le = htole16(v);
+	memcpy(p, &le, 2);
+}
+
+static void _put32(uint8_t* p, const uint32_t v) {
+	const uint32_t le = htole32(v);
+	memcpy(p, &le, 4);
+}
+
+static void _put64(uint8_t* p, const uint64_t v) {
+	const uint64_t le = htole64(v);
+	memcpy(p, &le, 8);
+}
+
+static uint16_t _get16(const uint8_t* p) {
+	uint16_t v;
+	memcpy(&v, p, 2);
+	return le16toh(v);
+}
+
+static uint32_t _get32(const uint8_t* p) {
+	uint32_t v;
+	memcpy(&v, p, 4);
+	return le32toh(v);
+}
+
+static uint64_t _get64(const uint8_t* p) {
+	uint64_t v;
+	memcpy(&v, p, 8);
+	return le64toh(v);
+}
+
+/* Encodes an entry and chains it to the previous record. */
+static void _encode(uint8_t* rec, const auditEntry* e, uint8_t* prevChain) {
+
+	uint32_t hminBits;
+	sha256Ctx ctx;
+
+	memcpy(&hminBits, &e->hmin, 4);
+
+	_put64(rec, e->seq);
+	_put64(rec + 8, e->timeNs);
+	_put64(rec + 16, e->offset);
+	_put32(rec + 24, e->length);
+	_put16(rec + 28, e->devID);
+	_put16(rec + 30, e->flags);
+	_put32(rec + 32, hminBits);
+	_put32(rec + 36, 0);
+	memcpy(rec + 40, e->dataHash, SHA256_DIGEST_SIZE);
+
+	sha256_init(&ctx);
+	sha256_update(&ctx, prevChain, SHA256_DIGEST_SIZE);
+	sha256_update(&ctx, rec, AUDIT_LINK_SIZE);
+	sha256_final(&ctx, rec + AUDIT_LINK_SIZE);
+
+	memcpy(prevChain, rec + AUDIT_LINK_SIZE, SHA256_DIGEST_SIZE);
+}
+
+static void _hex(const uint8_t* digest, char* out) {
+
+	for(int i = 0; i < SHA256_DIGEST_SIZE; ++i) {
+		sprintf(out + 2 * i, "%02x", digest[i]);
+	}
+}
+
+static int _write_all(const int fd, const uint8_t* buf, size_t len) {
+
+	while(len > 0) {
+		const ssize_t n = write(fd, buf, len);
+		if(n < 0 && errno == EINTR) {
+			continue;
+		}
+		if(n <= 0) {
+			return -1;
+		}
+		buf += n;
+		len -= (size_t)n;
+	}
+	return 0;
+}
+
+/* Replaces the head file, so it never has a partial head. */
+static int _store_head(const uint64_t records) {
+
+	char line[sizeof(AUDIT_HEAD_MAGIC) + 24 + 2 * SHA256_DIGEST_SIZE + 2];
+	char hex[2 * SHA256_DIGEST_SIZE + 1];
+	char tmp[PATH_MAX];
+
+	if(headPath == NULL) {
+		return 0;
+	}
+
+	_hex(chain, hex);
+	const int len = snprintf(line, sizeof(line), "%s %llu %s\n", AUDIT_HEAD_MAGIC, (unsigned long long)records, hex);
+	if(snprintf(tmp, sizeof(tmp), "%s.tmp", headPath) >= (int)sizeof(tmp)) {
+		return -1;
+	}
+
+	const int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0640);
+	if(fd < 0) {
+		return -1;
+	}
+	int err = _write_all(fd, (const uint8_t*)line, (size_t)len) != 0;
+	if(!err && syncBatches) {
+		err = fdatasync(fd) != 0;
+	}
+	close(fd);
+
+	return err || rename(tmp, headPath) != 0 ? -1 : 0;
+}
+
+/******************************************************************************
+** _flush
+**
+** Writes the encoded records and publishes the new head. If they are not
+** written, also in part, the log is cut back to the records of the head and
+** the chain goes back to its chainHash, so they can be written again.
+**
+** @return [int] 0 if the records are in the log, otherwise -1. A head file
+** that is not stored counts as a write error, but the records are written.
+******************************************************************************/
+static int _flush(const uint8_t* buf, const size_t n) {
+
+	int err = buf == NULL || _write_all(logFd, buf, n * AUDIT_RECORD_SIZE) != 0;
+	if(!err && syncBatches) {
+		err = fdatasync(logFd) != 0;
+	}
+
+	pthread_mutex_lock(&auditMutex);
+	if(!err) {
+		head.records += n;
+		memcpy(head.chainHash, chain, SHA256_DIGEST_SIZE);
+	} else {
+		const off_t size = (off_t)(AUDIT_HEADER_SIZE + head.records * AUDIT_RECORD_SIZE);
+		if(ftruncate(logFd, size) != 0 || lseek(logFd, size, SEEK_SET) != size) {
+			/* The log is left as it is, the next write fails too. */
+		}
+		memcpy(chain, head.chainHash, SHA256_DIGEST_SIZE);
+	}
+	const uint64_t records = head.records;
+	pthread_mutex_unlock(&auditMutex);
+
+	if(err) {
+		return -1;
+	}
+
+	/* A head that was not written is not published: it would anchor records
+	 * that are not in the log. */
+	if(_store_head(records) != 0) {
+		pthread_mutex_lock(&auditMutex);
+		stats.writeErrors++;
+		pthread_mutex_unlock(&auditMutex);
+	}
+	return 0;
+}
+
+static void* _writer_thread(void* arg) {
+
+	uint8_t* buf = (uint8_t*)malloc(AUDIT_QUEUE * AUDIT_RECORD_SIZE);
+	auditEntry seal;
+
+	(void)arg;
+
+	pthread_mutex_lock(&auditMutex);
+
+	for(;;) {
+
+		/* A failed batch is tried again after flushMs. */
+		if((queueCount < batchRecords || failing) && !closing) {
+			struct timespec ts;
+			clock_gettime(CLOCK_MONOTONIC, &ts);
+			ts.tv_nsec += (long)flushMs * 1000000L;
+			ts.tv_sec += ts.tv_nsec / 1000000000L;
+			ts.tv_nsec %= 1000000000L;
+
+			while((queueCount < batchRecords || failing) && !closing
+					&& pthread_cond_timedwait(&writerCond, &auditMutex, &ts) == 0) {
+				/* Woken before the time to flush. */
+			}
+		}
+
+		if(queueCount == 0) {
+			if(closing) {
+				break;
+			}
+			continue;
+		}
+
+		/* The entries are encoded out of the lock. The producers only append
+		 * after queueHead + queueCount, so they do not touch them. */
+		const size_t first = queueHead;
+		const size_t n = queueCount;
+		pthread_mutex_unlock(&auditMutex);
+
+		for(size_t i = 0; buf != NULL && i < n; ++i) {
+			_encode(buf + i * AUDIT_RECORD_SIZE, &queue[(first + i) % AUDIT_QUEUE], chain);
+		}
+
+		const int err = _flush(buf, n);
+
+		pthread_mutex_lock(&auditMutex);
+		failing = err != 0;
+		if(failing) {
+			stats.writeErrors++;
+			pthread_cond_broadcast(&roomCond);
+			if(!closing) {
+				continue;
+			}
+			/* Closing: the records are not tried again. */
+			stats.lostRecords += n;
+		} else {
+			stats.records += n;
+			stats.batches++;
+		}
+		queueHead = (first + n) % AUDIT_QUEUE;
+		queueCount -= n;
+		pthread_cond_broadcast(&roomCond);
+	}
+
+	/* The last record seals the log: without it the log was cut or the
+	 * process did not close it. */
+	memset(&seal, 0, sizeof(seal));
+	seal.seq = nextSeq;
+	seal.offset = nextOffset;
+	seal.timeNs = _clock_ns(CLOCK_REALTIME);
+	seal.devID = 0xFFFF;
+	seal.flags = AUDIT_FLAG_CLOSE;
+	seal.hmin = NAN;
+	const bool lost = stats.lostRecords > 0;
+	pthread_mutex_unlock(&auditMutex);
+
+	/* Without all the records the log is not sealed: it is not complete. */
+	if(!lost) {
+		if(buf != NULL) {
+			_encode(buf, &seal, chain);
+		}
+		const int err = _flush(buf, 1);
+
+		pthread_mutex_lock(&auditMutex);
+		stats.writeErrors += (uint64_t)(err != 0);
+		pthread_mutex_unlock(&auditMutex);
+	}
+
+	free(buf);
+
+	return NULL;
+}
+
+/* Returns the hmin of the device. It is read again when the last value is
+ * older than AUDIT_HMIN_PERIOD_NS, so a calibration is seen in a minute. */
+static float _hmin(const uint16_t devInd) {
+
+	if(get_hmin == NULL || devInd >= AUDIT_MAX_DEVICES) {
+		return NAN;
+	}
+
+	const uint64_t now = _clock_ns(CLOCK_MONOTONIC);
+
+	pthread_mutex_lock(&auditMutex);
+	const bool stale = hminNs[devInd] == 0 || now - hminNs[devInd] > AUDIT_HMIN_PERIOD_NS;
+	float h = hmins[devInd];
+	pthread_mutex_unlock(&auditMutex);
+
+	if(stale) {
+		combiner_lock();
+		if(get_hmin(devInd, &h) != 0) {
+			h = NAN;
+		}
+		combiner_unlock();
+
+		pthread_mutex_lock(&auditMutex);
+		hmins[devInd] = h;
+		hminNs[devInd] = now;
+		pthread_mutex_unlock(&auditMutex);
+	}
+
+	return h;
+}
+
+int audit_open(const char* path, const auditOptions* options) {
+
+	uint8_t header[AUDIT_HEADER_SIZE];
+	pthread_condattr_t attr;
+
+	if(path == NULL || logFd >= 0) {
+		return -1;
+	}
+
+	queue = (auditEntry*)calloc(AUDIT_QUEUE, sizeof(auditEntry));
+	if(queue == NULL) {
+		return -1;
+	}
+
+	logFd = open(path, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0640);
+	if(logFd < 0) {
+		free(queue);
+		queue = NULL;
+		return -1;
+	}
+
+	batchRecords = options != NULL && options->batchRecords > 0 ? options->batchRecords : AUDIT_DEFAULT_BATCH;
+	if(batchRecords > AUDIT_QUEUE / 2) {
+		batchRecords = AUDIT_QUEUE / 2;
+	}
+	flushMs = options != NULL && options->flushMs > 0 ? options->flushMs : AUDIT_DEFAULT_FLUSH_MS;
+	syncBatches = options != NULL && options->sync;
+	headPath = options != NULL && options->headPath != NULL ? strdup(options->headPath) : NULL;
+
+	memset(header, 0, sizeof(header));
+	memcpy(header, AUDIT_MAGIC, sizeof(AUDIT_MAGIC));
+	_put32(header + 8, AUDIT_RECORD_SIZE);
+	_put64(header + 16, _clock_ns(CLOCK_REALTIME));
+	if(options != NULL && options->serverIP != NULL) {
+		strncpy((char*)header + 24, options->serverIP, 47);
+	}
+	if(options != NULL && options->serverVersion != NULL) {
+		strncpy((char*)header + 72, options->serverVersion, 55);
+	}
+
+	sha256(header, sizeof(header), chain);
+	memset(&head, 0, sizeof(head));
+	memcpy(head.chainHash, chain, SHA256_DIGEST_SIZE);
+
+	if(_write_all(logFd, header, sizeof(header)) != 0 || _store_head(0) != 0) {
+		close(logFd);
+		logFd = -1;
+		free(queue);
+		queue = NULL;
+		free(headPath);
+		headPath = NULL;
+		return -1;
+	}
+
+	/* Device IDs of the indexes of the captures. */
+	uint16_t* ids = NULL;
+	uint16_t n = 0;
+	combiner_lock();
+	get_boards(&ids, &n);
+	combiner_unlock();
+	numDevIDs = n < AUDIT_MAX_DEVICES ? n : AUDIT_MAX_DEVICES;
+	if(ids != NULL) {
+		memcpy(devIDs, ids, numDevIDs * sizeof(uint16_t));
+	}
+
+	memset(hminNs, 0, sizeof(hminNs));
+	memset(&stats, 0, sizeof(stats));
+	queueHead = 0;
+	queueCount = 0;
+	nextSeq = 0;
+	nextOffset = 0;
+	closing = false;
+	failing = false;
+
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&writerCond, &attr);
+	pthread_condattr_destroy(&attr);
+
+	if(pthread_create(&writer, NULL, _writer_thread, NULL) != 0) {
+		pthread_cond_destroy(&writerCond);
+		close(logFd);
+		logFd = -1;
+		free(queue);
+		queue = NULL;
+		free(headPath);
+		headPath = NULL;
+		return -1;
+	}
+
+	return 0;
+}
+
+void audit_close(void) {
+
+	pthread_mutex_lock(&auditMutex);
+	if(logFd < 0 || closing) {
+		pthread_mutex_unlock(&auditMutex);
+		return;
+	}
+	closing = true;
+	pthread_cond_signal(&writerCond);
+	pthread_mutex_unlock(&auditMutex);
+
+	pthread_join(writer, NULL);
+	pthread_cond_destroy(&writerCond);
+
+	fdatasync(logFd);
+	close(logFd);
+	logFd = -1;
+
+	free(queue);
+	queue = NULL;
+	free(headPath);
+	headPath = NULL;
+}
+
+int audit_record(const void* data, const size_t len, const uint16_t devInd, const bool raw) {
+
+	auditEntry e;
+
+	if(data == NULL || len == 0 || len > UINT32_MAX || logFd < 0) {
+		return -1;
+	}
+
+	/* The block is hashed before it leaves the library. */
+	sha256(data, len, e.dataHash);
+	e.timeNs = _clock_ns(CLOCK_REALTIME);
+	e.length = (uint32_t)len;
+	e.devID = devInd < numDevIDs ? devIDs[devInd] : 0xFFFF;
+	e.flags = raw ? AUDIT_FLAG_RAW : 0;
+	e.hmin = _hmin(devInd);
+
+	pthread_mutex_lock(&auditMutex);
+
+	if(queueCount == AUDIT_QUEUE && !closing && !failing) {
+		++stats.waits;
+		pthread_cond_signal(&writerCond);
+		while(queueCount == AUDIT_QUEUE && !closing && !failing) {
+			pthread_cond_wait(&roomCond, &auditMutex);
+		}
+	}
+
+	/* While the log can not be written the block is not recorded. */
+	if(closing || failing) {
+		pthread_mutex_unlock(&auditMutex);
+		return -1;
+	}
+
+	/* The sequence and the range are given in the order of the queue. */
+	e.seq = nextSeq++;
+	e.offset = nextOffset;
+	nextOffset += len;
+	stats.bytes += len;
+
+	queue[(queueHead + queueCount) % AUDIT_QUEUE] = e;
+	if(++queueCount == batchRecords) {
+		pthread_cond_signal(&writerCond);
+	}
+
+	pthread_mutex_unlock(&auditMutex);
+
+	return 0;
+}
+
+int audit_get_random(uint32_t* mem_slot, const size_t Nuint32, const uint16_t devInd) {
+
+	if(combiner_get_random(mem_slot, Nuint32, devInd) != 0) {
+		return -1;
+	}
+	return audit_record(mem_slot, Nuint32, devInd, false);
+}
+
+int audit_get_raw(uint32_t* mem_slot, const size_t Nuint32, const uint16_t devInd) {
+
+	if(combiner_get_raw(mem_slot, Nuint32, devInd) != 0) {
+		return -1;
+	}
+	return audit_record(mem_slot, Nuint32, devInd, true);
+}
+
+void audit_get_stats(auditStats* s) {
+
+	pthread_mutex_lock(&auditMutex);
+	*s = stats;
+	pthread_mutex_unlock(&auditMutex);
+}
+
+void audit_get_head(auditHead* h) {
+
+	pthread_mutex_lock(&auditMutex);
+	*h = head;
+	pthread_mutex_unlock(&auditMutex);
+}
+
+int audit_load_head(const char* path, auditHead* h) {
+
+	char magic[sizeof(AUDIT_HEAD_MAGIC)];
+	char hex[2 * SHA256_DIGEST_SIZE + 1];
+	unsigned long long records;
+
+	if(path == NULL || h == NULL) {
+		return -1;
+	}
+
+	FILE* f = fopen(path, "r");
+	if(f == NULL) {
+		return -1;
+	}
+	const int fields = fscanf(f, "%11s %llu %64s", magic, &records, hex);
+	fclose(f);
+
+	if(fields != 3 || strcmp(magic, AUDIT_HEAD_MAGIC) != 0 || strlen(hex) != 2 * SHA256_DIGEST_SIZE) {
+		return -1;
+	}
+
+	h->records = records;
+	for(int i = 0; i < SHA256_DIGEST_SIZE; ++i) {
+		unsigned int byte;
+		if(sscanf(hex + 2 * i, "%2x", &byte) != 1) {
+			return -1;
+		}
+		h->chainHash[i] = (uint8_t)byte;
+	}
+	return 0;
+}
+
+/******************************************************************************
+** Verifier.
+******************************************************************************/
+
+/* Prefix of a data hash and its record, to find the duplicates. */
+typedef struct {
+	uint64_t prefix;
+	uint64_t index;
+} auditKey;
+
+typedef struct {
+	const uint8_t* records;
+	const uint8_t* genesis;
+	uint64_t first;
+	uint64_t last;
+	uint64_t total;
+	auditKey* keys;
+	auditReport report;
+	pthread_t thread;
+	bool threaded;
+} auditVerifyJob;
+
+static int _cmp_key(const void* a, const void* b) {
+
+	const auditKey* x = (const auditKey*)a;
+	const auditKey* y = (const auditKey*)b;
+
+	if(x->prefix != y->prefix) {
+		return x->prefix < y->prefix ? -1 : 1;
+	}
+	return (x->index > y->index) - (x->index < y->index);
+}
+
+static void _mark_bad(auditReport* r, const uint64_t i) {
+
+	if(r->firstBad < 0 || (int64_t)i < r->firstBad) {
+		r->firstBad = (int64_t)i;
+	}
+}
+
+static void* _verify_thread(void* arg) {
+
+	auditVerifyJob* job = (auditVerifyJob*)arg;
+	uint8_t digest[SHA256_DIGEST_SIZE];
+
+	for(uint64_t i = job->first; i < job->last; ++i) {
+		const uint8_t* rec = job->records + i * AUDIT_RECORD_SIZE;
+		const uint8_t* prev = i > 0 ? rec - AUDIT_RECORD_SIZE : NULL;
+		sha256Ctx ctx;
+
+		sha256_init(&ctx);
+		sha256_update(&ctx, prev != NULL ? prev + AUDIT_LINK_SIZE : job->genesis, SHA256_DIGEST_SIZE);
+		sha256_update(&ctx, rec, AUDIT_LINK_SIZE);
+		sha256_final(&ctx, digest);
+
+		if(memcmp(digest, rec + AUDIT_LINK_SIZE, SHA256_DIGEST_SIZE) != 0) {
+			++job->report.badLinks;
+			_mark_bad(&job->report, i);
+		}
+
+		if(_get64(rec) != i) {
+			++job->report.badSequence;
+			_mark_bad(&job->report, i);
+		}
+
+		const uint64_t expected = prev != NULL ? _get64(prev + 16) + _get32(prev + 24) : 0;
+		if(_get64(rec + 16) != expected) {
+			++job->report.badRanges;
+			_mark_bad(&job->report, i);
+		}
+
+		/* Only the last record can seal the log, and it has no data. */
+		if(_get16(rec + 30) & AUDIT_FLAG_CLOSE) {
+			if(i + 1 != job->total || _get32(rec + 24) != 0) {
+				++job->report.badSequence;
+				_mark_bad(&job->report, i);
+			}
+		}
+
+		job->report.bytes += _get32(rec + 24);
+
+		job->keys[i - job->first].prefix = _get64(rec + 40);
+		job->keys[i - job->first].index = i;
+	}
+
+	qsort(job->keys, (size_t)(job->last - job->first), sizeof(auditKey), _cmp_key);
+
+	return NULL;
+}
+
+/* Returns if the record at index is a duplicate of a record of the run of keys
+ * with its prefix, and adds it to the run otherwise. */
+static bool _duplicate(const uint8_t* records, const auditKey* k, uint64_t** run, size_t* runSize,
+		size_t* runCap) {
+
+	for(size_t r = 0; r < *runSize; ++r) {
+		if(memcmp(records + k->index * AUDIT_RECORD_SIZE + 40, records + (*run)[r] * AUDIT_RECORD_SIZE + 40,
+				SHA256_DIGEST_SIZE) == 0) {
+			return true;
+		}
+	}
+
+	if(*runSize == *runCap) {
+		const size_t cap = *runCap > 0 ? 2 * *runCap : 8;
+		uint64_t* grown = (uint64_t*)realloc(*run, cap * sizeof(uint64_t));
+		if(grown == NULL) {
+			return false;
+		}
+		*run = grown;
+		*runCap = cap;
+	}
+	(*run)[(*runSize)++] = k->index;
+
+	return false;
+}
+
+int audit_verify(const char* path, const int threads, auditReport* report) {
+	return audit_verify_anchor(path, threads, NULL, report);
+}
+
+int audit_verify_anchor(const char* path, const int threads, const auditHead* anchor, auditReport* report) {
+
+	struct stat st;
+
+	if(path == NULL || report == NULL) {
+		return -1;
+	}
+
+	memset(report, 0, sizeof(*report));
+	report->firstBad = -1;
+
+	const int fd = open(path, O_RDONLY | O_CLOEXEC);
+	if(fd < 0) {
+		return -1;
+	}
+	if(fstat(fd, &st) != 0 || (size_t)st.st_size < AUDIT_HEADER_SIZE) {
+		close(fd);
+		return -1;
+	}
+
+	const size_t size = (size_t)st.st_size;
+	const uint8_t* map = (const uint8_t*)mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if(map == MAP_FAILED) {
+		return -1;
+	}
+
+	if(memcmp(map, AUDIT_MAGIC, sizeof(AUDIT_MAGIC)) != 0 || _get32(map + 8) != AUDIT_RECORD_SIZE) {
+		report->badHeader = true;
+		munmap((void*)map, size);
+		return 1;
+	}
+
+	uint8_t genesis[SHA256_DIGEST_SIZE];
+	sha256(map, AUDIT_HEADER_SIZE, genesis);
+
+	const uint64_t n = (size - AUDIT_HEADER_SIZE) / AUDIT_RECORD_SIZE;
+	const uint8_t* records = map + AUDIT_HEADER_SIZE;
+	report->records = n;
+	report->truncated = (size - AUDIT_HEADER_SIZE) % AUDIT_RECORD_SIZE != 0;
+	report->unclosed = n == 0 || !(_get16(records + (n - 1) * AUDIT_RECORD_SIZE + 30) & AUDIT_FLAG_CLOSE);
+	report->head.records = n;
+	memcpy(report->head.chainHash, n > 0 ? records + (n - 1) * AUDIT_RECORD_SIZE + AUDIT_LINK_SIZE : genesis,
+			SHA256_DIGEST_SIZE);
+
+	/* The anchor has to be the chainHash of its record in this log. */
+	if(anchor != NULL) {
+		const uint8_t* expected = anchor->records == 0 ? genesis
+				: anchor->records <= n ? records + (anchor->records - 1) * AUDIT_RECORD_SIZE + AUDIT_LINK_SIZE : NULL;
+		report->badAnchor = expected == NULL || memcmp(expected, anchor->chainHash, SHA256_DIGEST_SIZE) != 0;
+	}
+
+	int nThreads = threads > 0 ? threads : (int)sysconf(_SC_NPROCESSORS_ONLN);
+	if(nThreads < 1) {
+		nThreads = 1;
+	}
+	if((uint64_t)nThreads > n) {
+		nThreads = n > 0 ? (int)n : 1;
+	}
+
+	auditVerifyJob* jobs = (auditVerifyJob*)calloc((size_t)nThreads, sizeof(auditVerifyJob));
+	auditKey* keys = (auditKey*)malloc((size_t)(n > 0 ? n : 1) * sizeof(auditKey));
+	int ret = -1;
+
+	if(jobs != NULL && keys != NULL) {
+
+		for(int t = 0; t < nThreads; ++t) {
+			jobs[t].records = records;
+			jobs[t].genesis = genesis;
+			jobs[t].total = n;
+			jobs[t].first = n * (uint64_t)t / (uint64_t)nThreads;
+			jobs[t].last = n * (uint64_t)(t + 1) / (uint64_t)nThreads;
+			jobs[t].keys = keys + jobs[t].first;
+			jobs[t].report.firstBad = -1;
+
+			jobs[t].threaded = t > 0 && pthread_create(&jobs[t].thread, NULL, _verify_thread, &jobs[t]) == 0;
+		}
+
+		/* The jobs without thread are done in this one. */
+		for(int t = 0; t < nThreads; ++t) {
+			if(!jobs[t].threaded) {
+				_verify_thread(&jobs[t]);
+			}
+		}
+
+		for(int t = 0; t < nThreads; ++t) {
+			if(jobs[t].threaded) {
+				pthread_join(jobs[t].thread, NULL);
+			}
+			report->badLinks += jobs[t].report.badLinks;
+			report->badSequence += jobs[t].report.badSequence;
+			report->badRanges += jobs[t].report.badRanges;
+			report->bytes += jobs[t].report.bytes;
+			if(jobs[t].report.firstBad >= 0) {
+				_mark_bad(report, (uint64_t)jobs[t].report.firstBad);
+			}
+		}
+
+		/* Merge of the sorted slices. Each record is compared whole with all
+		 * the previous records of the run with its prefix. */
+		uint64_t* pos = (uint64_t*)malloc((size_t)nThreads * sizeof(uint64_t));
+		uint64_t* run = NULL;
+		size_t runSize = 0;
+		size_t runCap = 0;
+		uint64_t runPrefix = 0;
+
+		if(pos != NULL) {
+			for(int t = 0; t < nThreads; ++t) {
+				pos[t] = jobs[t].first;
+			}
+
+			for(;;) {
+				int best = -1;
+				for(int t = 0; t < nThreads; ++t) {
+					if(pos[t] < jobs[t].last && (best < 0 || _cmp_key(&keys[pos[t]], &keys[pos[best]]) < 0)) {
+						best = t;
+					}
+				}
+				if(best < 0) {
+					break;
+				}
+
+				const auditKey k = keys[pos[best]++];
+
+				if(runSize > 0 && k.prefix != runPrefix) {
+					runSize = 0;
+				}
+				runPrefix = k.prefix;
+
+				if(_duplicate(records, &k, &run, &runSize, &runCap)) {
+					++report->duplicates;
+					_mark_bad(report, k.index);
+				}
+			}
+
+			free(run);
+			free(pos);
+
+			ret = report->badLinks == 0 && report->badSequence == 0 && report->badRanges == 0
+					&& report->duplicates == 0 && !report->truncated && !report->unclosed
+					&& !report->badAnchor ? 0 : 1;
+		}
+	}
+
+	free(keys);
+	free(jobs);
+	munmap((void*)map, size);
+
+	return ret;
+}
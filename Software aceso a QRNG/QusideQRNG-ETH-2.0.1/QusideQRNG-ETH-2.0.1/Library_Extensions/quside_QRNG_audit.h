@@ -0,0 +1,250 @@
+/*
+ ============================================================================
+ Name        : quside_QRNG_audit.h
+ Author      : Alvaro Velasco Garcia, Heriberto J. Diaz
+ Created on  : 18 oct. 2022
+ Version     : 0.1
+ Copyright   : Copyright (C) 2022 QUSIDE TECHNOLOGIES - All Rights Reserved.
+               Unauthorized copying of this file, via any medium is
+               strictly prohibited.
+ Description : This header defines the audit log of the captures. Each
+               delivered block of random numbers is recorded with its device,
+               time, byte range, hmin and SHA-256, and each record is chained
+               to the previous one with SHA-256, so a removed, changed or
+               reordered record breaks the chain.
+
+               Log format (all the fields little endian):
+
+                   Header (AUDIT_HEADER_SIZE bytes):
+                       magic[8] recordSize[4] flags[4] startNs[8]
+                       serverIP[48] serverVersion[56]
+
+                   Record (AUDIT_RECORD_SIZE bytes):
+                       seq[8] timeNs[8] offset[8] length[4] devID[2]
+                       flags[2] hmin[4] reserved[4] dataHash[32] chainHash[32]
+
+               chainHash = SHA-256(previous chainHash | record[0..72)). The
+               previous chainHash of the first record is the SHA-256 of the
+               header.
+
+               audit_close seals the log with a last record with the flag
+               AUDIT_FLAG_CLOSE and length 0, so a log cut at a record
+               boundary is detected. A log cut and sealed again is only
+               detected against a head (number of records and chainHash of
+               the last one) kept out of the log: the head is read with
+               audit_get_head, and it is also rewritten in headPath after
+               each batch, to be exported.
+
+               Head file: "QAUDITHEAD1 <records> <chainHash in hex>\n"
+ ============================================================================
+ */
+
+#ifndef QUSIDE_QRNG_AUDIT_H
+#define QUSIDE_QRNG_AUDIT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#define AUDIT_MAGIC				"QAUDIT1"
+#define AUDIT_HEADER_SIZE		128
+#define AUDIT_RECORD_SIZE		104
+#define AUDIT_HASH_SIZE			32
+#define AUDIT_HEAD_MAGIC		"QAUDITHEAD1"
+
+/* Flags of a record. */
+#define AUDIT_FLAG_RAW			0x0001
+#define AUDIT_FLAG_CLOSE		0x8000		/* Last record, written by audit_close. */
+
+/* Default records written together and time to write an incomplete batch. */
+#define AUDIT_DEFAULT_BATCH		256
+#define AUDIT_DEFAULT_FLUSH_MS	100
+
+/* Options of the audit log. */
+typedef struct {
+	const char* serverIP;		/* Recorded in the header. It can be NULL. */
+	const char* serverVersion;	/* Recorded in the header. It can be NULL. */
+	size_t batchRecords;		/* 0 means AUDIT_DEFAULT_BATCH. */
+	int flushMs;				/* 0 means AUDIT_DEFAULT_FLUSH_MS. */
+	bool sync;					/* fdatasync after each batch. */
+	const char* headPath;		/* Head file rewritten after each batch. It can be NULL. */
+} auditOptions;
+
+/* Head of the chain: records written and chainHash of the last one. */
+typedef struct {
+	uint64_t records;
+	uint8_t chainHash[AUDIT_HASH_SIZE];
+} auditHead;
+
+/* Statistics of the audit log. */
+typedef struct {
+	uint64_t records;			/* Records written. */
+	uint64_t bytes;				/* Bytes of random numbers recorded. */
+	uint64_t batches;			/* Writes to the log. */
+	uint64_t waits;				/* Records that waited for room in the queue. */
+	uint64_t writeErrors;		/* Batches not written, and head files not stored. */
+	uint64_t lostRecords;		/* Records not written when the log was closed. */
+} auditStats;
+
+/* Result of the verification of a log. */
+typedef struct {
+	uint64_t records;
+	uint64_t bytes;
+	uint64_t badLinks;			/* Records whose chainHash is wrong. */
+	uint64_t badSequence;		/* Records with an unexpected seq. */
+	uint64_t badRanges;			/* Records whose offset is not the end of the previous one. */
+	uint64_t duplicates;		/* Records with the dataHash of a previous record. */
+	int64_t firstBad;			/* Index of the first wrong record, or -1. */
+	bool badHeader;
+	bool truncated;				/* The log ends with an incomplete record. */
+	bool unclosed;				/* The last record is not the one of audit_close. */
+	bool badAnchor;				/* The log does not contain the head given. */
+	auditHead head;				/* Head of the log. */
+} auditReport;
+
+/******************************************************************************
+** audit_open
+**
+** Creates a new audit log and starts the thread that writes it. The log
+** can not exist. The device IDs are read with get_boards, so it has to be
+** called after connectToServer.
+**
+** @param path [const char*] Path of the log.
+** @param options [const auditOptions*] Options. NULL uses the defaults.
+**
+** @return [int] If it success returns 0, otherwise -1.
+******************************************************************************/
+int audit_open(const char* path, const auditOptions* options);
+
+/******************************************************************************
+** audit_close
+**
+** Writes the pending records, seals the log with the AUDIT_FLAG_CLOSE record
+** and closes it. If the pending records can not be written they are counted
+** in lostRecords and the log is not sealed.
+**
+** @return void.
+******************************************************************************/
+void audit_close(void);
+
+/******************************************************************************
+** audit_record
+**
+** Records a block of random numbers that is delivered. The block is hashed
+** in the calling thread and the record is written in the background. It
+** fails while the last batch could not be written: the queued records are
+** tried again, but the new ones are not accepted.
+**
+** @param data [const void*] Random numbers.
+** @param len [const size_t] Size of the block in bytes.
+** @param devInd [const uint16_t] Index of the device that generated them.
+** @param raw [const bool] true for raw random numbers.
+**
+** @return [int] If it success returns 0, otherwise -1.
+******************************************************************************/
+int audit_record(const void* data, const size_t len, const uint16_t devInd, const bool raw);
+
+/******************************************************************************
+** audit_get_random
+**
+** Captures with combiner_get_random and records the block.
+**
+** @param mem_slot [uint32_t *] pointer to region where save the numbers.
+** @param Nuint32 [const size_t] count of random numbers in bytes.
+** @param devInd [uint16_t] Index of the device to use from the list.
+**
+** @return [int] If it success returns 0, otherwise -1.
+******************************************************************************/
+int audit_get_random(uint32_t* mem_slot, const size_t Nuint32, const uint16_t devInd);
+
+/******************************************************************************
+** audit_get_raw
+**
+** Captures with combiner_get_raw and records the block.
+**
+** @param mem_slot [uint32_t *] pointer to region where save the numbers.
+** @param Nuint32 [const size_t] count of random numbers in bytes.
+** @param devInd [uint16_t] Index of the device to use from the list.
+**
+** @return [int] If it success returns 0, otherwise -1.
+******************************************************************************/
+int audit_get_raw(uint32_t* mem_slot, const size_t Nuint32, const uint16_t devInd);
+
+/******************************************************************************
+** audit_get_stats
+**
+** Returns the statistics of the audit log.
+**
+** @param stats [auditStats*] Variable that will contain the statistics.
+**
+** @return void.
+******************************************************************************/
+void audit_get_stats(auditStats* stats);
+
+/******************************************************************************
+** audit_get_head
+**
+** Returns the head of the records written to the log. It can be sent out of
+** the host to check later that the log was not cut.
+**
+** @param head [auditHead*] Variable that will contain the head.
+**
+** @return void.
+******************************************************************************/
+void audit_get_head(auditHead* head);
+
+/******************************************************************************
+** audit_load_head
+**
+** Reads a head file written with headPath.
+**
+** @param path [const char*] Path of the head file.
+** @param head [auditHead*] Variable that will contain the head.
+**
+** @return [int] If it success returns 0, otherwise -1.
+******************************************************************************/
+int audit_load_head(const char* path, auditHead* head);
+
+/******************************************************************************
+** audit_verify
+**
+** Verifies a log: the chain of hashes, the sequence, the byte ranges, that
+** no block was recorded twice and that the log was closed. The records are
+** checked in parallel.
+**
+** @param path [const char*] Path of the log.
+** @param threads [const int] Threads used. 0 uses all the CPUs.
+** @param report [auditReport*] Variable that will contain the result.
+**
+** @return [int] If the log is right returns 0, if it is wrong 1, and -1 if
+**               it can not be read.
+******************************************************************************/
+int audit_verify(const char* path, const int threads, auditReport* report);
+
+/******************************************************************************
+** audit_verify_anchor
+**
+** Like audit_verify, and also checks that the record head->records - 1 of
+** the log has the chainHash of the head, so the log was not cut before it
+** and the records up to it were not written again.
+**
+** @param path [const char*] Path of the log.
+** @param threads [const int] Threads used. 0 uses all the CPUs.
+** @param head [const auditHead*] Head kept out of the log. NULL does not check it.
+** @param report [auditReport*] Variable that will contain the result.
+**
+** @return [int] If the log is right returns 0, if it is wrong 1, and -1 if
+**               it can not be read.
+******************************************************************************/
+int audit_verify_anchor(const char* path, const int threads, const auditHead* head,
+		auditReport* report);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* QUSIDE_QRNG_AUDIT_H */
@@ -0,0 +1,540 @@
+/*
+ ============================================================================
+ Name        : quside_QRNG_calibration.c
+ Author      : Alvaro Velasco Garcia, Heriberto J. Diaz
+ Created on  : 18 oct. 2022
+ Version     : 0.1
+ Copyright   : Copyright (C) 2022 QUSIDE TECHNOLOGIES - All Rights Reserved.
+               Unauthorized copying of this file, via any medium is
+               strictly prohibited.
+ Description : Calibration of the devices without stopping the captures.
+
+               set_calibration blocks the QRNG, so the device is first taken
+               out of rotation in the window engine, which returns when its
+               chunks in flight are completed. The calibration runs in a
+               worker process with its own admin session, the status is
+               polled until CALIB_SUCCED or CALIB_FAIL, and the device only
+               goes back to rotation after update_thresholds and
+               check_thresholds success. Meanwhile the window engine sends
+               the chunks to the other devices.
+
+               A worker that does not answer is stopped. It can not be
+               started again because the process already has threads, so
+               the QRNG is marked down for the calibrations. The device
+               stays out of rotation in CALIB_STATE_FAILED: set_calibration
+               may still be running in the QRNG or may have stopped half
+               way. calibration_recover brings it back after the status of
+               the calibration and the thresholds are checked with a new
+               worker.
+ ============================================================================
+ */
+
+#include "quside_QRNG_calibration.h"
+#include "quside_QRNG_window.h"
+#include <quside_QRNG_admin.h>
+#include <sys/wait.h>
+#include <signal.h>
+#include <poll.h>
+#include <errno.h>
+
+#define CALIBRATION_MAX_SERVERS		256
+
+/* Time to answer the orders that do not calibrate, in ms. */
+#define CALIBRATION_ORDER_TIMEOUT	30000
+
+typedef enum {
+	CALIB_CMD_CALIBRATE,
+	CALIB_CMD_CALIBRATE_FIXED_VTC,
+	CALIB_CMD_STATUS,
+	CALIB_CMD_UPDATE_THRESHOLDS,
+	CALIB_CMD_CHECK_THRESHOLDS,
+	CALIB_CMD_QUIT
+} calibrationCmdType;
+
+/* Message sent to a worker. */
+typedef struct {
+	uint32_t op;
+	uint32_t devInd;
+} calibrationCmd;
+
+/* Message returned by a worker. */
+typedef struct {
+	int32_t status;
+	int32_t value;
+} calibrationReply;
+
+/* Admin session with a QRNG and its calibration in progress. */
+typedef struct {
+	pid_t pid;
+	int fd;
+	bool alive;
+	bool running;
+	bool joinable;
+	bool reserved;			/* The device was in rotation when it was chosen. */
+	pthread_t thread;
+	uint16_t devInd;
+	calibrationOptions options;
+	int result;
+} calibrationWorker;
+
+static calibrationWorker workers[CALIBRATION_MAX_SERVERS];
+static int nWorkers = 0;
+static calibrationState states[CALIBRATION_MAX_SERVERS][WINDOW_MAX_DEVICES];
+static int reserved = 0;		/* Devices chosen for calibration still in rotation. */
+static pthread_mutex_t calibrationMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t calibrationCond = PTHREAD_COND_INITIALIZER;
+
+static int _send_all(const int fd, const void* buf, const size_t len) {
+
+	const uint8_t* p = (const uint8_t*)buf;
+	size_t done = 0;
+
+	while(done < len) {
+		const ssize_t n = send(fd, p + done, len - done, MSG_NOSIGNAL);
+		if(n < 0 && errno == EINTR) {
+			continue;
+		}
+		if(n <= 0) {
+			return -1;
+		}
+		done += (size_t)n;
+	}
+	return 0;
+}
+
+static int _recv_all(const int fd, void* buf, const size_t len) {
+
+	uint8_t* p = (uint8_t*)buf;
+	size_t done = 0;
+
+	while(done < len) {
+		const ssize_t n = recv(fd, p + done, len - done, 0);
+		if(n < 0 && errno == EINTR) {
+			continue;
+		}
+		if(n <= 0) {
+			return -1;
+		}
+		done += (size_t)n;
+	}
+	return 0;
+}
+
+/******************************************************************************
+** _worker_main
+**
+** Body of a worker process. It owns one admin session with the QRNG.
+******************************************************************************/
+static void _worker_main(const int fd, char* serverIP) {
+
+	calibrationReply reply;
+	calibrationCmd cmd;
+
+	memset(&reply, 0, sizeof(reply));
+	reply.status = connectToServer(serverIP) == 0 ? 0 : -1;
+
+	if(_send_all(fd, &reply, sizeof(reply)) != 0 || reply.status != 0) {
+		_exit(1);
+	}
+
+	while(_recv_all(fd, &cmd, sizeof(cmd)) == 0 && cmd.op != CALIB_CMD_QUIT) {
+
+		const uint16_t devInd = (uint16_t)cmd.devInd;
+		calibrationStatus status = DEFAULT;
+
+		reply.value = 0;
+
+		switch(cmd.op) {
+		case CALIB_CMD_CALIBRATE:
+			reply.status = set_calibration(devInd);
+			break;
+		case CALIB_CMD_CALIBRATE_FIXED_VTC:
+			reply.status = set_calibration_with_fixed_VTC(devInd);
+			break;
+		case CALIB_CMD_STATUS:
+			reply.status = get_calibration_status(devInd, &status);
+			reply.value = (int32_t)status;
+			break;
+		case CALIB_CMD_UPDATE_THRESHOLDS:
+			reply.status = update_thresholds(devInd);
+			break;
+		case CALIB_CMD_CHECK_THRESHOLDS:
+			reply.status = check_thresholds(devInd);
+			break;
+		default:
+			reply.status = -1;
+			break;
+		}
+
+		if(_send_all(fd, &reply, sizeof(reply)) != 0) {
+			break;
+		}
+	}
+
+	disconnectServer();
+	_exit(0);
+}
+
+static void _kill_worker(calibrationWorker* w) {
+
+	if(w->fd >= 0) {
+		close(w->fd);
+		w->fd = -1;
+	}
+	if(w->pid > 0) {
+		kill(w->pid, SIGKILL);
+		waitpid(w->pid, NULL, 0);
+		w->pid = 0;
+	}
+	w->alive = false;
+}
+
+/******************************************************************************
+** _order
+**
+** Sends an order to the worker and waits for the answer up to timeoutMs. A
+** worker that does not answer is stopped, because its session is not in
+** sync anymore.
+**
+** @return [int] Status returned by the library, or -1.
+******************************************************************************/
+static int _order(calibrationWorker* w, const uint32_t op, const uint16_t devInd,
+		const int timeoutMs, int32_t* value) {
+
+	calibrationCmd cmd = { op, devInd };
+	calibrationReply reply;
+	struct pollfd pfd;
+
+	if(!w->alive || _send_all(w->fd, &cmd, sizeof(cmd)) != 0) {
+		_kill_worker(w);
+		return -1;
+	}
+
+	pfd.fd = w->fd;
+	pfd.events = POLLIN;
+
+	int ready;
+	do {
+		ready = poll(&pfd, 1, timeoutMs);
+	} while(ready < 0 && errno == EINTR);
+
+	if(ready <= 0 || _recv_all(w->fd, &reply, sizeof(reply)) != 0) {
+		_kill_worker(w);
+		return -1;
+	}
+
+	if(value != NULL) {
+		*value = reply.value;
+	}
+	return reply.status;
+}
+
+static void _set_state(const int server, const uint16_t devInd, const calibrationState state) {
+
+	pthread_mutex_lock(&calibrationMutex);
+	states[server][devInd] = state;
+	pthread_mutex_unlock(&calibrationMutex);
+}
+
+/* Updates and checks the thresholds after a calibration. */
+static int _verify(calibrationWorker* w, const uint16_t devInd) {
+
+	if(_order(w, CALIB_CMD_UPDATE_THRESHOLDS, devInd, CALIBRATION_ORDER_TIMEOUT, NULL) != 0
+			|| _order(w, CALIB_CMD_CHECK_THRESHOLDS, devInd, CALIBRATION_ORDER_TIMEOUT, NULL) != 0) {
+		return -1;
+	}
+	return 0;
+}
+
+static void* _calibration_thread(void* arg) {
+
+	calibrationWorker* w = (calibrationWorker*)arg;
+	const int server = (int)(w - workers);
+	const uint16_t devInd = w->devInd;
+	const int timeoutMs = w->options.timeoutSec * 1000;
+	int ret = -1;
+
+	const int drained = window_set_device_enabled(server, devInd, false);
+
+	/* Out of rotation, so the device is not counted by window_get_stats. */
+	pthread_mutex_lock(&calibrationMutex);
+	reserved -= w->reserved;
+	w->reserved = false;
+	pthread_mutex_unlock(&calibrationMutex);
+
+	if(drained == 0) {
+
+		_set_state(server, devInd, CALIB_STATE_CALIBRATING);
+
+		const uint32_t op = w->options.fixedVTC ? CALIB_CMD_CALIBRATE_FIXED_VTC : CALIB_CMD_CALIBRATE;
+		int elapsedMs = 0;
+
+		if(_order(w, op, devInd, timeoutMs, NULL) == 0) {
+
+			/* The status is polled until the calibration finishes. */
+			while(w->alive && elapsedMs <= timeoutMs) {
+				int32_t status = DEFAULT;
+
+				if(_order(w, CALIB_CMD_STATUS, devInd, CALIBRATION_ORDER_TIMEOUT, &status) != 0) {
+					break;
+				}
+				if(status == CALIB_SUCCED) {
+					ret = 0;
+					break;
+				}
+				if(status == CALIB_FAIL || status == I2C_ERROR) {
+					break;
+				}
+
+				usleep((useconds_t)w->options.pollMs * 1000);
+				elapsedMs += w->options.pollMs;
+			}
+		}
+
+		if(ret == 0) {
+			_set_state(server, devInd, CALIB_STATE_VERIFYING);
+			ret = _verify(w, devInd);
+		}
+
+		if(ret == 0 && window_set_device_enabled(server, devInd, true) != 0) {
+			ret = -1;
+		}
+	}
+
+	/* Also without worker, the device stays out of rotation: its
+	 * calibration may still be running or be half applied. */
+	pthread_mutex_lock(&calibrationMutex);
+	states[server][devInd] = ret == 0 ? CALIB_STATE_ACTIVE : CALIB_STATE_FAILED;
+	w->result = ret;
+	w->running = false;
+	pthread_cond_broadcast(&calibrationCond);
+	pthread_mutex_unlock(&calibrationMutex);
+
+	return NULL;
+}
+
+int calibration_init(char** serverIPs, const int numServers) {
+
+	if(serverIPs == NULL || numServers <= 0 || numServers > CALIBRATION_MAX_SERVERS || nWorkers > 0) {
+		return -1;
+	}
+
+	/* The states are kept, so the failed devices stay out of rotation. */
+	memset(workers, 0, sizeof(workers));
+	reserved = 0;
+	nWorkers = numServers;
+
+	for(int i = 0; i < nWorkers; ++i) {
+		calibrationWorker* w = &workers[i];
+		int sv[2];
+
+		w->fd = -1;
+
+		if(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) != 0) {
+			continue;
+		}
+
+		w->pid = fork();
+
+		if(w->pid == 0) {
+			/* The worker only keeps its own end. */
+			for(int j = 0; j < i; ++j) {
+				if(workers[j].fd >= 0) {
+					close(workers[j].fd);
+				}
+			}
+			close(sv[0]);
+			_worker_main(sv[1], serverIPs[i]);
+		}
+
+		close(sv[1]);
+
+		if(w->pid < 0) {
+			close(sv[0]);
+			w->pid = 0;
+			continue;
+		}
+
+		w->fd = sv[0];
+		w->alive = true;
+	}
+
+	int ret = 0;
+
+	/* Wait for the connection result of each worker. */
+	for(int i = 0; i < nWorkers; ++i) {
+		calibrationReply reply;
+
+		if(!workers[i].alive || _recv_all(workers[i].fd, &reply, sizeof(reply)) != 0
+				|| reply.status != 0) {
+			_kill_worker(&workers[i]);
+			ret = -1;
+		}
+	}
+
+	return ret;
+}
+
+void calibration_release(void) {
+
+	for(int i = 0; i < nWorkers; ++i) {
+		calibrationWorker* w = &workers[i];
+
+		if(w->joinable) {
+			pthread_join(w->thread, NULL);
+			w->joinable = false;
+		}
+
+		if(w->alive) {
+			calibrationCmd cmd = { CALIB_CMD_QUIT, 0 };
+			_send_all(w->fd, &cmd, sizeof(cmd));
+			close(w->fd);
+			w->fd = -1;
+			waitpid(w->pid, NULL, 0);
+			w->pid = 0;
+			w->alive = false;
+		}
+	}
+
+	nWorkers = 0;
+}
+
+int calibration_start(const int server, const uint16_t devInd, const calibrationOptions* options) {
+
+	windowStats ws;
+
+	if(server < 0 || server >= nWorkers || devInd >= WINDOW_MAX_DEVICES
+			|| (int)devInd >= window_num_devices(server)) {
+		return -1;
+	}
+
+	calibrationWorker* w = &workers[server];
+
+	pthread_mutex_lock(&calibrationMutex);
+
+	if(w->running || !w->alive) {
+		pthread_mutex_unlock(&calibrationMutex);
+		return -1;
+	}
+
+	/* The captures need at least another device. The devices reserved by
+	 * other calibrations are still in the count of window_get_stats until
+	 * they are drained, so they are subtracted. A device drained but not
+	 * yet released from the reservation is subtracted twice, which only
+	 * refuses a calibration. */
+	window_get_stats(&ws);
+	if(states[server][devInd] == CALIB_STATE_ACTIVE && ws.devices - reserved <= 1) {
+		pthread_mutex_unlock(&calibrationMutex);
+		return -1;
+	}
+
+	if(w->joinable) {
+		pthread_join(w->thread, NULL);
+		w->joinable = false;
+	}
+
+	w->devInd = devInd;
+	w->options.fixedVTC = options != NULL && options->fixedVTC;
+	w->options.timeoutSec = options != NULL && options->timeoutSec > 0 ?
+			options->timeoutSec : CALIBRATION_DEFAULT_TIMEOUT;
+	w->options.pollMs = options != NULL && options->pollMs > 0 ?
+			options->pollMs : CALIBRATION_DEFAULT_POLL;
+	w->result = -1;
+	w->running = true;
+
+	/* The device is reserved before the mutex is released. */
+	const calibrationState previous = states[server][devInd];
+	states[server][devInd] = CALIB_STATE_DRAINING;
+	w->reserved = previous == CALIB_STATE_ACTIVE;
+	reserved += w->reserved;
+
+	if(pthread_create(&w->thread, NULL, _calibration_thread, w) != 0) {
+		states[server][devInd] = previous;
+		reserved -= w->reserved;
+		w->reserved = false;
+		w->running = false;
+		pthread_mutex_unlock(&calibrationMutex);
+		return -1;
+	}
+	w->joinable = true;
+
+	pthread_mutex_unlock(&calibrationMutex);
+
+	return 0;
+}
+
+int calibration_recover(const int server, const uint16_t devInd) {
+
+	if(server < 0 || server >= nWorkers || devInd >= WINDOW_MAX_DEVICES) {
+		return -1;
+	}
+
+	calibrationWorker* w = &workers[server];
+
+	pthread_mutex_lock(&calibrationMutex);
+	if(w->running || !w->alive || states[server][devInd] != CALIB_STATE_FAILED) {
+		pthread_mutex_unlock(&calibrationMutex);
+		return -1;
+	}
+	w->running = true;
+	states[server][devInd] = CALIB_STATE_VERIFYING;
+	pthread_mutex_unlock(&calibrationMutex);
+
+	int32_t status = DEFAULT;
+	int ret = -1;
+
+	if(_order(w, CALIB_CMD_STATUS, devInd, CALIBRATION_ORDER_TIMEOUT, &status) == 0 && status == CALIB_SUCCED
+			&& _verify(w, devInd) == 0 && window_set_device_enabled(server, devInd, true) == 0) {
+		ret = 0;
+	}
+
+	pthread_mutex_lock(&calibrationMutex);
+	states[server][devInd] = ret == 0 ? CALIB_STATE_ACTIVE : CALIB_STATE_FAILED;
+	w->result = ret;
+	w->running = false;
+	pthread_cond_broadcast(&calibrationCond);
+	pthread_mutex_unlock(&calibrationMutex);
+
+	return ret;
+}
+
+calibrationState calibration_get_state(const int server, const uint16_t devInd) {
+
+	calibrationState state = CALIB_STATE_FAILED;
+
+	if(server >= 0 && server < nWorkers && devInd < WINDOW_MAX_DEVICES) {
+		pthread_mutex_lock(&calibrationMutex);
+		state = states[server][devInd];
+		pthread_mutex_unlock(&calibrationMutex);
+	}
+
+	return state;
+}
+
+int calibration_wait(const int server) {
+
+	if(server < 0 || server >= nWorkers) {
+		return -1;
+	}
+
+	pthread_mutex_lock(&calibrationMutex);
+	while(workers[server].running) {
+		pthread_cond_wait(&calibrationCond, &calibrationMutex);
+	}
+	const int ret = workers[server].result;
+	pthread_mutex_unlock(&calibrationMutex);
+
+	return ret;
+}
+
+const char* calibration_state_name(const calibrationState state) {
+
+	switch(state) {
+	case CALIB_STATE_ACTIVE:		return "ACTIVE";
+	case CALIB_STATE_DRAINING:		return "DRAINING";
+	case CALIB_STATE_CALIBRATING:	return "CALIBRATING";
+	case CALIB_STATE_VERIFYING:		return "VERIFYING";
+	case CALIB_STATE_FAILED:		return "FAILED";
+	default:						return "UNKNOWN";
+	}
+}
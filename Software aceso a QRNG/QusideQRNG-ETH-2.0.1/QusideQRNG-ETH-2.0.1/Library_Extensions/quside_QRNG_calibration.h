@@ -0,0 +1,155 @@
+/*
+ ============================================================================
+ Name        : quside_QRNG_calibration.h
+ Author      : Alvaro Velasco Garcia, Heriberto J. Diaz
+ Created on  : 18 oct. 2022
+ Version     : 0.1
+ Copyright   : Copyright (C) 2022 QUSIDE TECHNOLOGIES - All Rights Reserved.
+               Unauthorized copying of this file, via any medium is
+               strictly prohibited.
+ Description : This header defines the calibration of the devices without
+               stopping the captures of the window engine. The device is
+               taken out of rotation, calibrated, and brought back only if
+               the thresholds are updated and checked.
+
+               It needs the admin mode library.
+ ============================================================================
+ */
+
+#ifndef QUSIDE_QRNG_CALIBRATION_H
+#define QUSIDE_QRNG_CALIBRATION_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Default time to finish a calibration in seconds. */
+#define CALIBRATION_DEFAULT_TIMEOUT		600
+
+/* Default period of the polls of the calibration status in ms. */
+#define CALIBRATION_DEFAULT_POLL		1000
+
+/* State of a device. */
+typedef enum {
+	CALIB_STATE_ACTIVE,			/* In rotation. */
+	CALIB_STATE_DRAINING,		/* Waiting for the chunks in flight. */
+	CALIB_STATE_CALIBRATING,	/* Calibrating. */
+	CALIB_STATE_VERIFYING,		/* Updating and checking the thresholds. */
+	CALIB_STATE_FAILED			/* Out of rotation until a new calibration. */
+} calibrationState;
+
+/* Options of a calibration. */
+typedef struct {
+	bool fixedVTC;				/* Use set_calibration_with_fixed_VTC. */
+	int timeoutSec;				/* 0 means CALIBRATION_DEFAULT_TIMEOUT. */
+	int pollMs;					/* 0 means CALIBRATION_DEFAULT_POLL. */
+} calibrationOptions;
+
+/******************************************************************************
+** calibration_init
+**
+** Starts one admin session with each QRNG in its own worker process. The
+** QRNGs have to be in the same order as in window_init. It has to be called
+** before creating any thread. The states of the devices are kept from a
+** previous calibration_init, so a failed device stays out of rotation.
+**
+** @param serverIPs [char**] IPs of the QRNGs.
+** @param numServers [const int] Number of IPs.
+**
+** @return [int] If all the sessions are connected returns 0, otherwise -1.
+******************************************************************************/
+int calibration_init(char** serverIPs, const int numServers);
+
+/******************************************************************************
+** calibration_release
+**
+** Waits for the calibrations in progress and stops the worker processes.
+**
+** @return void.
+******************************************************************************/
+void calibration_release(void);
+
+/******************************************************************************
+** calibration_start
+**
+** Starts the calibration of a device in the background. The device is
+** drained, calibrated, its thresholds are updated and checked, and then it
+** goes back to rotation. If some step fails, the device stays out of
+** rotation in CALIB_STATE_FAILED.
+**
+** Only one device of each QRNG is calibrated at the same time, and the last
+** device in rotation of all the QRNGs is never calibrated, also when several
+** calibrations are started at the same time.
+**
+** If the worker of the QRNG does not answer, it is stopped, the device stays
+** out of rotation in CALIB_STATE_FAILED (calibration_wait returns -1) and
+** the next calibrations of the QRNG fail until calibration_release and
+** calibration_init. Then calibration_recover can bring the device back.
+**
+** @param server [const int] Index of the QRNG in the serverIPs.
+** @param devInd [const uint16_t] Index of the device in the QRNG.
+** @param options [const calibrationOptions*] Options. NULL uses the defaults.
+**
+** @return [int] If the calibration is started returns 0, otherwise -1.
+******************************************************************************/
+int calibration_start(const int server, const uint16_t devInd, const calibrationOptions* options);
+
+/******************************************************************************
+** calibration_recover
+**
+** Brings back to rotation a device in CALIB_STATE_FAILED, for example after
+** its worker was stopped in the middle of a calibration, without
+** calibrating it again. The device goes back only if get_calibration_status
+** returns CALIB_SUCCED and update_thresholds and check_thresholds success,
+** otherwise it stays in CALIB_STATE_FAILED. It blocks until it finishes.
+**
+** @param server [const int] Index of the QRNG in the serverIPs.
+** @param devInd [const uint16_t] Index of the device in the QRNG.
+**
+** @return [int] If the device is back in rotation returns 0, otherwise -1.
+******************************************************************************/
+int calibration_recover(const int server, const uint16_t devInd);
+
+/******************************************************************************
+** calibration_get_state
+**
+** Returns the state of a device.
+**
+** @param server [const int] Index of the QRNG in the serverIPs.
+** @param devInd [const uint16_t] Index of the device in the QRNG.
+**
+** @return [calibrationState] State of the device.
+******************************************************************************/
+calibrationState calibration_get_state(const int server, const uint16_t devInd);
+
+/******************************************************************************
+** calibration_wait
+**
+** Waits until the calibration of the QRNG finishes.
+**
+** @param server [const int] Index of the QRNG in the serverIPs.
+**
+** @return [int] If the last calibration of the QRNG success returns 0,
+**               otherwise -1.
+******************************************************************************/
+int calibration_wait(const int server);
+
+/******************************************************************************
+** calibration_state_name
+**
+** Returns the name of a state.
+**
+** @param state [const calibrationState] State.
+**
+** @return [const char*] Name of the state.
+******************************************************************************/
+const char* calibration_state_name(const calibrationState state);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* QUSIDE_QRNG_CALIBRATION_H */
@@ -0,0 +1,300 @@
+/*
+ ============================================================================
+ Name        : quside_QRNG_combiner.c
+ Author      : Alvaro Velasco Garcia, Heriberto J. Diaz
+ Created on  : 18 oct. 2022
+ Version     : 0.1
+ Copyright   : Copyright (C) 2022 QUSIDE TECHNOLOGIES - All Rights Reserved.
+               Unauthorized copying of this file, via any medium is
+               strictly prohibited.
+ Description : Thread safe front end for get_random and get_raw.
+
+               The library keeps the connection in global variables, so only
+               one capture can be in flight. Every caller pushes its request
+               in a lock-free stack. The first caller that finds the combiner
+               free becomes the combiner: it takes all the pending requests,
+               merges the ones that use the same device and type in one
+               capture and copies each slice to the mem_slot of its owner.
+               The requests pushed while that capture is in flight are
+               merged in the next one.
+ ============================================================================
+ */
+
+#include "quside_QRNG_combiner.h"
+#include <quside_QRNG_user.h>
+#include <stdatomic.h>
+#include <sched.h>
+
+/* Number of times a waiter checks its request before sleeping. */
+#define COMBINER_SPIN_LOOPS		256
+
+/* Number of passes the combiner does before giving the role to other thread. */
+#define COMBINER_MAX_PASSES		64
+
+/* Request of one caller. It lives in the stack of the caller. */
+typedef struct combinerRequest {
+	struct combinerRequest* next;
+	uint32_t* mem_slot;
+	size_t nBytes;
+	uint16_t devInd;
+	bool raw;
+	int result;
+	atomic_int done;
+} combinerRequest;
+
+static _Atomic(combinerRequest*) pendingHead = NULL;
+static atomic_bool combinerBusy = false;
+
+static pthread_mutex_t waitMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t waitCond = PTHREAD_COND_INITIALIZER;
+static pthread_mutex_t libraryMutex = PTHREAD_MUTEX_INITIALIZER;
+
+static uint32_t* scratch = NULL;
+static size_t scratchBytes = 0;
+
+static atomic_uint_fast64_t statRequests;
+static atomic_uint_fast64_t statCaptures;
+static atomic_uint_fast64_t statBytes;
+static atomic_uint_fast64_t statErrors;
+static atomic_uint_fast64_t statMaxMerged;
+
+/******************************************************************************
+** _capture
+**
+** Calls the library with the lock of the connection taken.
+******************************************************************************/
+static int _capture(uint32_t* mem_slot, const size_t nBytes, const uint16_t devInd,
+		const bool raw) {
+
+	int ret;
+
+	pthread_mutex_lock(&libraryMutex);
+	ret = raw ? get_raw(mem_slot, nBytes, devInd) : get_random(mem_slot, nBytes, devInd);
+	pthread_mutex_unlock(&libraryMutex);
+
+	atomic_fetch_add(&statCaptures, 1);
+
+	return ret;
+}
+
+/******************************************************************************
+** _complete
+**
+** Publishes the result of a request. After this call the request can not be
+** used because the owner can return and release its stack.
+******************************************************************************/
+static void _complete(combinerRequest* req, const int result) {
+
+	req->result = result;
+
+	if(result == 0) {
+		atomic_fetch_add(&statBytes, req->nBytes);
+	} else {
+		atomic_fetch_add(&statErrors, 1);
+	}
+
+	atomic_store_explicit(&req->done, 1, memory_order_release);
+}
+
+/******************************************************************************
+** _combine
+**
+** Takes all the pending requests and serves them merging the compatible ones.
+******************************************************************************/
+static void _combine(void) {
+
+	combinerRequest* list = atomic_exchange(&pendingHead, NULL);
+	combinerRequest* fifo = NULL;
+
+	/* The stack returns the newest request first, reverse it to be fair. */
+	while(list != NULL) {
+		combinerRequest* next = list->next;
+		list->next = fifo;
+		fifo = list;
+		list = next;
+	}
+
+	while(fifo != NULL) {
+
+		combinerRequest* first = fifo;
+		fifo = first->next;
+
+		/* A request that does not fit in the scratch buffer goes alone. */
+		if(first->nBytes >= scratchBytes) {
+			_complete(first, _capture(first->mem_slot, first->nBytes, first->devInd, first->raw));
+			continue;
+		}
+
+		/* Move the requests compatible with the first one to the batch. */
+		combinerRequest* batch = first;
+		combinerRequest* tail = first;
+		combinerRequest** link = &fifo;
+		size_t total = first->nBytes;
+		uint64_t merged = 1;
+
+		first->next = NULL;
+
+		while(*link != NULL) {
+			combinerRequest* req = *link;
+
+			if(req->raw == first->raw && req->devInd == first->devInd
+					&& total + req->nBytes <= scratchBytes) {
+				*link = req->next;
+				req->next = NULL;
+				tail->next = req;
+				tail = req;
+				total += req->nBytes;
+				++merged;
+			} else {
+				link = &req->next;
+			}
+		}
+
+		/* Only the thread that holds combinerBusy writes it, so the load and
+		 * the store do not race. */
+		if(merged > atomic_load(&statMaxMerged)) {
+			atomic_store(&statMaxMerged, merged);
+		}
+
+		const int ret = _capture(scratch, total, first->devInd, first->raw);
+		size_t offset = 0;
+
+		while(batch != NULL) {
+			combinerRequest* next = batch->next;
+
+			if(ret == 0) {
+				memcpy(batch->mem_slot, (uint8_t*)scratch + offset, batch->nBytes);
+			}
+			offset += batch->nBytes;
+			_complete(batch, ret);
+			batch = next;
+		}
+
+		/* The bytes of one caller can not be seen by other caller. */
+		memset(scratch, 0, total);
+	}
+
+	pthread_mutex_lock(&waitMutex);
+	pthread_cond_broadcast(&waitCond);
+	pthread_mutex_unlock(&waitMutex);
+}
+
+/******************************************************************************
+** _submit
+**
+** Pushes a request and waits until it is served, becoming the combiner if
+** no other thread is doing it.
+******************************************************************************/
+static int _submit(uint32_t* mem_slot, const size_t nBytes, const uint16_t devInd,
+		const bool raw) {
+
+	if(mem_slot == NULL || scratch == NULL) {
+		return -1;
+	}
+
+	if(nBytes == 0) {
+		return 0;
+	}
+
+	combinerRequest req;
+	req.mem_slot = mem_slot;
+	req.nBytes = nBytes;
+	req.devInd = devInd;
+	req.raw = raw;
+	req.result = -1;
+	atomic_init(&req.done, 0);
+
+	atomic_fetch_add(&statRequests, 1);
+
+	req.next = atomic_load(&pendingHead);
+	while(!atomic_compare_exchange_weak(&pendingHead, &req.next, &req)) {
+	}
+
+	int spins = 0;
+
+	while(!atomic_load_explicit(&req.done, memory_order_acquire)) {
+
+		if(!atomic_exchange(&combinerBusy, true)) {
+
+			int passes = 0;
+
+			while(atomic_load(&pendingHead) != NULL && passes < COMBINER_MAX_PASSES) {
+				_combine();
+				++passes;
+			}
+
+			pthread_mutex_lock(&waitMutex);
+			atomic_store(&combinerBusy, false);
+			pthread_cond_broadcast(&waitCond);
+			pthread_mutex_unlock(&waitMutex);
+			continue;
+		}
+
+		if(spins < COMBINER_SPIN_LOOPS) {
+			++spins;
+			sched_yield();
+			continue;
+		}
+
+		pthread_mutex_lock(&waitMutex);
+		while(!atomic_load_explicit(&req.done, memory_order_acquire)
+				&& atomic_load(&combinerBusy)) {
+			pthread_cond_wait(&waitCond, &waitMutex);
+		}
+		pthread_mutex_unlock(&waitMutex);
+	}
+
+	return req.result;
+}
+
+int combiner_init(const size_t maxBatchBytes) {
+
+	const size_t bytes = maxBatchBytes == 0 ? COMBINER_DEFAULT_BATCH : maxBatchBytes;
+
+	/* The library writes uint32 words, round the size up. */
+	scratch = (uint32_t*)calloc((bytes + 3) >> 2, sizeof(uint32_t));
+	if(scratch == NULL) {
+		return -1;
+	}
+	scratchBytes = bytes;
+
+	atomic_store(&statRequests, 0);
+	atomic_store(&statCaptures, 0);
+	atomic_store(&statBytes, 0);
+	atomic_store(&statErrors, 0);
+	atomic_store(&statMaxMerged, 0);
+
+	return 0;
+}
+
+void combiner_release(void) {
+
+	free(scratch);
+	scratch = NULL;
+	scratchBytes = 0;
+}
+
+int combiner_get_random(uint32_t* mem_slot, const size_t Nuint32, const uint16_t devInd) {
+	return _submit(mem_slot, Nuint32, devInd, false);
+}
+
+int combiner_get_raw(uint32_t* mem_slot, const size_t Nuint32, const uint16_t devInd) {
+	return _submit(mem_slot, Nuint32, devInd, true);
+}
+
+void combiner_lock(void) {
+	pthread_mutex_lock(&libraryMutex);
+}
+
+void combiner_unlock(void) {
+	pthread_mutex_unlock(&libraryMutex);
+}
+
+void combiner_get_stats(combinerStats* stats) {
+
+	stats->requests = atomic_load(&statRequests);
+	stats->captures = atomic_load(&statCaptures);
+	stats->bytes = atomic_load(&statBytes);
+	stats->errors = atomic_load(&statErrors);
+	stats->maxMerged = atomic_load(&statMaxMerged);
+}
@@ -0,0 +1,124 @@
+/*
+ ============================================================================
+ Name        : quside_QRNG_combiner.h
+ Author      : Alvaro Velasco Garcia, Heriberto J. Diaz
+ Created on  : 18 oct. 2022
+ Version     : 0.1
+ Copyright   : Copyright (C) 2022 QUSIDE TECHNOLOGIES - All Rights Reserved.
+               Unauthorized copying of this file, via any medium is
+               strictly prohibited.
+ Description : This header defines a thread safe front end for get_random
+               and get_raw. The requests of the threads that arrive while a
+               capture is in flight are merged in one capture and the data
+               is split back to each caller.
+ ============================================================================
+ */
+
+#ifndef QUSIDE_QRNG_COMBINER_H
+#define QUSIDE_QRNG_COMBINER_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* Default maximum number of bytes requested to the QRNG in one capture. */
+#define COMBINER_DEFAULT_BATCH		65536
+
+/* Statistics of the combiner. */
+typedef struct {
+	uint64_t requests;		/* Requests submitted by the callers. */
+	uint64_t captures;		/* Captures sent to the QRNG. */
+	uint64_t bytes;			/* Bytes delivered to the callers. */
+	uint64_t errors;		/* Requests that returned -1. */
+	uint64_t maxMerged;		/* Biggest number of requests in one capture. */
+} combinerStats;
+
+/******************************************************************************
+** combiner_init
+**
+** Initializes the combiner. It has to be called after connectToServer and
+** before any thread calls combiner_get_random or combiner_get_raw.
+**
+** @param maxBatchBytes [const size_t] Maximum number of bytes merged in one
+**                                     capture. If it is 0 the value
+**                                     COMBINER_DEFAULT_BATCH is used.
+**
+** @return [int] If it success returns 0, otherwise -1.
+******************************************************************************/
+int combiner_init(const size_t maxBatchBytes);
+
+/******************************************************************************
+** combiner_release
+**
+** Releases the resources of the combiner. No thread can be inside
+** combiner_get_random or combiner_get_raw when it is called.
+**
+** @return void.
+******************************************************************************/
+void combiner_release(void);
+
+/******************************************************************************
+** combiner_get_random
+**
+** Thread safe version of get_random. It can be called from any thread.
+**
+** @param mem_slot [uint32_t *] pointer to region where save the numbers.
+** @param Nuint32 [const size_t] count of random numbers in bytes.
+** @param devInd [uint16_t] Index of the device to use from the list.
+**
+** @return [int] If it success returns 0, otherwise -1.
+******************************************************************************/
+int combiner_get_random(uint32_t* mem_slot, const size_t Nuint32, const uint16_t devInd);
+
+/******************************************************************************
+** combiner_get_raw
+**
+** Thread safe version of get_raw. It can be called from any thread.
+**
+** @param mem_slot [uint32_t *] pointer to region where save the numbers.
+** @param Nuint32 [const size_t] count of random numbers in bytes.
+** @param devInd [uint16_t] Index of the device to use from the list.
+**
+** @return [int] If it success returns 0, otherwise -1.
+******************************************************************************/
+int combiner_get_raw(uint32_t* mem_slot, const size_t Nuint32, const uint16_t devInd);
+
+/******************************************************************************
+** combiner_lock
+**
+** Takes the lock that protects the connection with the QRNG. Any other call
+** to the library done while the combiner is in use (monitors, calibration,
+** ...) has to be done between combiner_lock and combiner_unlock.
+**
+** @return void.
+******************************************************************************/
+void combiner_lock(void);
+
+/******************************************************************************
+** combiner_unlock
+**
+** Releases the lock taken with combiner_lock.
+**
+** @return void.
+******************************************************************************/
+void combiner_unlock(void);
+
+/******************************************************************************
+** combiner_get_stats
+**
+** Returns the statistics of the combiner.
+**
+** @param stats [combinerStats*] Variable that will contain the statistics.
+**
+** @return void.
+******************************************************************************/
+void combiner_get_stats(combinerStats* stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* QUSIDE_QRNG_COMBINER_H */
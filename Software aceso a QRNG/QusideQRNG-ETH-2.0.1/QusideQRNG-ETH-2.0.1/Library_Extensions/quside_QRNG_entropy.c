@@ -0,0 +1,1600 @@
+/*
+ ============================================================================
+ Name        : quside_QRNG_entropy.c
+ Author      : Alvaro Velasco Garcia, Heriberto J. Diaz
+ Created on  : 18 oct. 2022
+ Version     : 0.1
+ Copyright   : Copyright (C) 2022 QUSIDE TECHNOLOGIES - All Rights Reserved.
+               Unauthorized copying of this file, via any medium is
+               strictly prohibited.
+ Description : Non-IID min-entropy estimators of NIST SP 800-90B.
+
+               The data is split in blocks. Each block is packed once as a
+               bitstring, and the estimators over the samples and over the
+               bitstring of all the blocks of a batch are distributed between
+               the worker threads. The t-tuple and LRS
+               estimates share one suffix array and are computed in O(n)
+               from the LCP intervals. The bitstring counters use 64 bit
+               words and popcount.
+ ============================================================================
+ */
+
+#include "quside_QRNG_entropy.h"
+#include "quside_QRNG_combiner.h"
+#include <quside_QRNG_user.h>
+#include <math.h>
+#include <stdatomic.h>
+
+/* Upper bound of the confidence intervals of the standard (99%). */
+#define Z_ALPHA					2.576
+
+/* Parameters of the estimators defined in the standard. */
+#define COMPRESSION_B			6
+#define COMPRESSION_D			1000
+#define TUPLE_CUTOFF			35
+#define MCW_WINDOWS				4
+#define LAG_D					128
+#define MMC_D					16
+#define MMC_MAX_ENTRIES			100000
+#define LZ78Y_B					16
+#define LZ78Y_MAX_DICT			65536
+
+/* Biggest bitstring supported by the 32 bit indexes of the suffix array. */
+#define ENTROPY_MAX_BLOCK		((size_t)1 << 30)
+
+/* Independent jobs of a block, run over the samples and over the bitstring.
+ * t-tuple and LRS are one job. */
+typedef enum {
+	JOB_MOST_COMMON,
+	JOB_COLLISION,
+	JOB_MARKOV,
+	JOB_COMPRESSION,
+	JOB_TUPLE,
+	JOB_MULTI_MCW,
+	JOB_LAG,
+	JOB_MULTI_MMC,
+	JOB_LZ78Y,
+	ENTROPY_JOBS
+} entropyJob;
+
+/* Block of samples ready to be assessed. */
+typedef struct {
+	uint8_t* data;			/* Samples masked to bitsPerSample bits. */
+	size_t len;
+	uint64_t* bitWords;		/* Bitstring, first bit in the MSB of word 0. */
+	uint8_t* bitData;		/* Bitstring, one bit per byte. Only if bits > 1. */
+	size_t nBits;
+	int bits;
+	entropyResult result;
+} entropyBlock;
+
+/* Batch of jobs shared by the worker threads. */
+typedef struct {
+	entropyBlock* blocks;
+	size_t nBlocks;
+	atomic_size_t next;
+} entropyBatch;
+
+static const char* estimatorNames[ENTROPY_ESTIMATORS] = {
+	"Most Common Value",
+	"Collision",
+	"Markov",
+	"Compression",
+	"t-Tuple",
+	"LRS",
+	"MultiMCW",
+	"Lag",
+	"MultiMMC",
+	"LZ78Y"
+};
+
+const char* entropy_estimator_name(const entropyEstimator est) {
+	return est < ENTROPY_ESTIMATORS ? estimatorNames[est] : "Unknown";
+}
+
+/******************************************************************************
+** Common helpers.
+******************************************************************************/
+
+static double _upper_bound(const double p, const size_t n) {
+
+	const double pu = p + Z_ALPHA * sqrt(p * (1.0 - p) / (double)(n - 1));
+	return pu > 1.0 ? 1.0 : pu;
+}
+
+static inline int _bit_at(const uint64_t* words, const size_t pos) {
+	return (int)((words[pos >> 6] >> (63 - (pos & 63))) & 1);
+}
+
+/* Reads nb <= 57 bits starting at pos. */
+static inline uint32_t _bits_at(const uint64_t* words, const size_t pos, const int nb) {
+
+	const size_t w = pos >> 6;
+	const int off = (int)(pos & 63);
+	uint64_t v = words[w] << off;
+
+	if(off + nb > 64) {
+		v |= words[w + 1] >> (64 - off);
+	}
+	return (uint32_t)(v >> (64 - nb));
+}
+
+/* Solves the local probability equation of the predictors (6.3.7 step 9). */
+static double _local_equation(const double p, const double r, const double n) {
+
+	const double q = 1.0 - p;
+	double x = 1.0;
+
+	for(int i = 0; i < 10; ++i) {
+		x = 1.0 + q * pow(p, r) * pow(x, r + 1.0);
+	}
+	return (1.0 - p * x) / ((r + 1.0 - r * x) * q) * exp(-(n + 1.0) * log(x));
+}
+
+static double _predictor_entropy(const size_t n, const size_t correct,
+		const size_t longestRun, const int k) {
+
+	double pGlobal;
+
+	if(n < 2) {
+		return ENTROPY_NA;
+	}
+
+	if(correct == 0) {
+		pGlobal = 1.0 - pow(0.01, 1.0 / (double)n);
+	} else {
+		pGlobal = _upper_bound((double)correct / (double)n, n);
+	}
+
+	const double r = (double)longestRun + 1.0;
+	double lo = 0.0, hi = 1.0;
+
+	for(int i = 0; i < 100; ++i) {
+		const double mid = (lo + hi) / 2.0;
+		if(_local_equation(mid, r, (double)n) > 0.99) {
+			lo = mid;
+		} else {
+			hi = mid;
+		}
+	}
+
+	double p = pGlobal > lo ? pGlobal : lo;
+	if(p < 1.0 / k) {
+		p = 1.0 / k;
+	}
+	return -log2(p);
+}
+
+/* Keeps the counters of the predictions of a predictor. */
+typedef struct {
+	size_t correct;
+	size_t run;
+	size_t longestRun;
+} predictorScore;
+
+static inline void _predictor_hit(predictorScore* ps, const bool hit) {
+
+	if(hit) {
+		++ps->correct;
+		if(++ps->run > ps->longestRun) {
+			ps->longestRun = ps->run;
+		}
+	} else {
+		ps->run = 0;
+	}
+}
+
+/******************************************************************************
+** 6.3.1 Most Common Value.
+******************************************************************************/
+static double _most_common(const uint8_t* s, const size_t len) {
+
+	/* Four histograms avoid the stalls of consecutive equal samples. */
+	size_t hist[4][256];
+	size_t i = 0, maxCount = 0;
+
+	memset(hist, 0, sizeof(hist));
+
+	for(; i + 4 <= len; i += 4) {
+		++hist[0][s[i]];
+		++hist[1][s[i + 1]];
+		++hist[2][s[i + 2]];
+		++hist[3][s[i + 3]];
+	}
+	for(; i < len; ++i) {
+		++hist[0][s[i]];
+	}
+
+	for(int v = 0; v < 256; ++v) {
+		const size_t c = hist[0][v] + hist[1][v] + hist[2][v] + hist[3][v];
+		if(c > maxCount) {
+			maxCount = c;
+		}
+	}
+
+	return -log2(_upper_bound((double)maxCount / (double)len, len));
+}
+
+/******************************************************************************
+** 6.3.2 Collision, binary data.
+******************************************************************************/
+static double _collision(const uint64_t* words, const size_t nBits) {
+
+	size_t i = 0, v = 0;
+	double sum = 0.0, sum2 = 0.0;
+
+	while(i + 1 < nBits) {
+		int t;
+
+		if(_bit_at(words, i) == _bit_at(words, i + 1)) {
+			t = 2;
+		} else if(i + 2 < nBits) {
+			t = 3;
+		} else {
+			break;
+		}
+
+		++v;
+		sum += t;
+		sum2 += t * t;
+		i += t;
+	}
+
+	if(v < 2) {
+		return ENTROPY_NA;
+	}
+
+	const double mean = sum / v;
+	const double sigma = sqrt((sum2 - v * mean * mean) / (v - 1));
+	const double meanBound = mean - Z_ALPHA * sigma / sqrt((double)v);
+
+	/* With binary data the collision time is 2 or 3, so its expected value is
+	 * 2(p^2 + q^2) + 3(2pq) = 2 + 2pq. Solve it for p >= 0.5. */
+	double p;
+
+	if(meanBound >= 2.5) {
+		p = 0.5;
+	} else if(meanBound <= 2.0) {
+		p = 1.0;
+	} else {
+		p = 0.5 * (1.0 + sqrt(5.0 - 2.0 * meanBound));
+	}
+
+	return -log2(p);
+}
+
+/******************************************************************************
+** 6.3.3 Markov, binary data.
+******************************************************************************/
+static double _markov(const uint64_t* words, const size_t nBits) {
+
+	const size_t nWords = (nBits + 63) >> 6;
+	const int tail = (int)(nBits & 63);
+	size_t ones = 0, pairs11 = 0;
+
+	if(nBits < 2) {
+		return ENTROPY_NA;
+	}
+
+	for(size_t w = 0; w < nWords; ++w) {
+		uint64_t word = words[w];
+
+		if(w == nWords - 1 && tail != 0) {
+			word &= ~0ULL << (64 - tail);
+		}
+
+		ones += __builtin_popcountll(word);
+		pairs11 += __builtin_popcountll(word & (word << 1));
+
+		if(w + 1 < nWords) {
+			pairs11 += (word & 1) & (words[w + 1] >> 63);
+		}
+	}
+
+	const int first = _bit_at(words, 0);
+	const int last = _bit_at(words, nBits - 1);
+	const size_t onesHead = ones - last;		/* Ones in positions 0..n-2. */
+	const size_t onesTail = ones - first;		/* Ones in positions 1..n-1. */
+	const double c11 = (double)pairs11;
+	const double c10 = (double)(onesHead - pairs11);
+	const double c01 = (double)(onesTail - pairs11);
+	const double c00 = (double)(nBits - 1 - onesHead) - c01;
+
+	const double p1 = (double)ones / (double)nBits;
+	const double p0 = 1.0 - p1;
+	const double p00 = c00 + c01 > 0 ? c00 / (c00 + c01) : 0.0;
+	const double p01 = c00 + c01 > 0 ? c01 / (c00 + c01) : 0.0;
+	const double p10 = c10 + c11 > 0 ? c10 / (c10 + c11) : 0.0;
+	const double p11 = c10 + c11 > 0 ? c11 / (c10 + c11) : 0.0;
+
+	/* Log2 probabilities of the most likely sequences of 128 bits. */
+	const double l[6] = {
+		log2(p0) + 127.0 * log2(p00),
+		log2(p0) + 64.0 * log2(p01) + 63.0 * log2(p10),
+		log2(p0) + log2(p01) + 126.0 * log2(p11),
+		log2(p1) + log2(p10) + 126.0 * log2(p00),
+		log2(p1) + 64.0 * log2(p10) + 63.0 * log2(p01),
+		log2(p1) + 127.0 * log2(p11)
+	};
+
+	double lMax = -INFINITY;
+	for(int i = 0; i < 6; ++i) {
+		if(!isnan(l[i]) && l[i] > lMax) {
+			lMax = l[i];
+		}
+	}
+
+	const double h = -lMax / 128.0;
+	return h > 1.0 ? 1.0 : h;
+}
+
+/******************************************************************************
+** 6.3.4 Compression, binary data.
+******************************************************************************/
+static double _compression_g(const double z, const size_t nBlocks, const double* log2u) {
+
+	const size_t d = COMPRESSION_D;
+	const double v = (double)(nBlocks - d);
+	double sum = 0.0, power = 1.0;
+
+	/* G(z) = 1/v sum_{t=d+1}^{L} sum_{u=1}^{t} log2(u) F(z,t,u). The terms with
+	 * u < t are grouped by u, each one appears L - max(d, u) times. */
+	for(size_t u = 1; u <= nBlocks; ++u) {
+
+		if(u < nBlocks) {
+			const size_t times = nBlocks - (u > d ? u : d);
+			sum += log2u[u] * z * z * power * (double)times;
+		}
+		if(u > d) {
+			sum += log2u[u] * z * power;
+		}
+
+		power *= 1.0 - z;
+		if(power < 1e-300) {
+			break;
+		}
+	}
+
+	return sum / v;
+}
+
+static double _compression(const uint64_t* words, const size_t nBits) {
+
+	const size_t nBlocks = nBits / COMPRESSION_B;
+	const size_t d = COMPRESSION_D;
+	const int alphabet = 1 << COMPRESSION_B;
+
+	if(nBlocks <= d + 1) {
+		return ENTROPY_NA;
+	}
+
+	double* log2u = (double*)malloc((nBlocks + 1) * sizeof(double));
+	if(log2u == NULL) {
+		return ENTROPY_NA;
+	}
+	log2u[0] = 0.0;
+	for(size_t u = 1; u <= nBlocks; ++u) {
+		log2u[u] = log2((double)u);
+	}
+
+	size_t dict[1 << COMPRESSION_B];
+	memset(dict, 0, sizeof(dict));
+
+	for(size_t i = 1; i <= d; ++i) {
+		dict[_bits_at(words, (i - 1) * COMPRESSION_B, COMPRESSION_B)] = i;
+	}
+
+	const size_t v = nBlocks - d;
+	double sum = 0.0, sum2 = 0.0;
+
+	for(size_t i = d + 1; i <= nBlocks; ++i) {
+		const uint32_t b = _bits_at(words, (i - 1) * COMPRESSION_B, COMPRESSION_B);
+		const size_t dist = dict[b] != 0 ? i - dict[b] : i;
+		const double l = log2u[dist];
+
+		dict[b] = i;
+		sum += l;
+		sum2 += l * l;
+	}
+
+	const double mean = sum / v;
+	const double sigma = 0.5907 * sqrt(sum2 / (v - 1) - mean * mean);
+	const double meanBound = mean - Z_ALPHA * sigma / sqrt((double)v);
+
+	/* The expected value decreases from p = 2^-b (uniform) to p = 1. */
+	double lo = 1.0 / alphabet, hi = 1.0, p;
+
+	const double eUniform = (alphabet) * _compression_g(lo, nBlocks, log2u);
+
+	if(meanBound >= eUniform) {
+		p = lo;
+	} else {
+		for(int it = 0; it < 60; ++it) {
+			const double mid = (lo + hi) / 2.0;
+			const double q = (1.0 - mid) / (alphabet - 1);
+			const double e = _compression_g(mid, nBlocks, log2u)
+					+ (alphabet - 1) * _compression_g(q, nBlocks, log2u);
+			if(e > meanBound) {
+				lo = mid;
+			} else {
+				hi = mid;
+			}
+		}
+		p = (lo + hi) / 2.0;
+	}
+
+	free(log2u);
+
+	const double h = -log2(p) / COMPRESSION_B;
+	return h > 1.0 ? 1.0 : h;
+}
+
+/******************************************************************************
+** 6.3.5 t-Tuple and 6.3.6 LRS.
+******************************************************************************/
+
+/* Suffix array by prefix doubling with radix sort. */
+static int32_t* _suffix_array(const uint8_t* s, const size_t n) {
+
+	const size_t buckets = n > 256 ? n + 1 : 257;
+	int32_t* sa = (int32_t*)malloc(n * sizeof(int32_t));
+	int32_t* rank = (int32_t*)malloc(n * sizeof(int32_t));
+	int32_t* tmp = (int32_t*)malloc(n * sizeof(int32_t));
+	int32_t* cnt = (int32_t*)malloc(buckets * sizeof(int32_t));
+
+	if(sa == NULL || rank == NULL || tmp == NULL || cnt == NULL) {
+		free(sa); free(rank); free(tmp); free(cnt);
+		return NULL;
+	}
+
+	memset(cnt, 0, 257 * sizeof(int32_t));
+	for(size_t i = 0; i < n; ++i) {
+		++cnt[s[i] + 1];
+	}
+	for(int v = 1; v < 257; ++v) {
+		cnt[v] += cnt[v - 1];
+	}
+	for(size_t i = 0; i < n; ++i) {
+		sa[cnt[s[i]]++] = (int32_t)i;
+	}
+
+	int32_t maxRank = 0;
+	rank[sa[0]] = 0;
+	for(size_t i = 1; i < n; ++i) {
+		if(s[sa[i]] != s[sa[i - 1]]) {
+			++maxRank;
+		}
+		rank[sa[i]] = maxRank;
+	}
+
+	for(size_t k = 1; (size_t)maxRank + 1 < n && k < n; k <<= 1) {
+
+		/* Order by the second key: suffixes without it go first. */
+		size_t j = 0;
+		for(size_t i = n - k; i < n; ++i) {
+			tmp[j++] = (int32_t)i;
+		}
+		for(size_t i = 0; i < n; ++i) {
+			if((size_t)sa[i] >= k) {
+				tmp[j++] = sa[i] - (int32_t)k;
+			}
+		}
+
+		/* Stable counting sort by the first key. */
+		memset(cnt, 0, ((size_t)maxRank + 2) * sizeof(int32_t));
+		for(size_t i = 0; i < n; ++i) {
+			++cnt[rank[i] + 1];
+		}
+		for(int32_t v = 1; v <= maxRank + 1; ++v) {
+			cnt[v] += cnt[v - 1];
+		}
+		for(size_t i = 0; i < n; ++i) {
+			sa[cnt[rank[tmp[i]]]++] = tmp[i];
+		}
+
+		/* New ranks in tmp. */
+		maxRank = 0;
+		tmp[sa[0]] = 0;
+		for(size_t i = 1; i < n; ++i) {
+			const int32_t a = sa[i - 1], b = sa[i];
+			const int32_t ra = (size_t)a + k < n ? rank[a + k] : -1;
+			const int32_t rb = (size_t)b + k < n ? rank[b + k] : -1;
+			if(rank[a] != rank[b] || ra != rb) {
+				++maxRank;
+			}
+			tmp[b] = maxRank;
+		}
+
+		int32_t* swap = rank;
+		rank = tmp;
+		tmp = swap;
+	}
+
+	free(rank);
+	free(tmp);
+	free(cnt);
+
+	return sa;
+}
+
+/* Kasai algorithm. lcp[i] is the LCP of the suffixes sa[i-1] and sa[i]. */
+static int32_t* _lcp_array(const uint8_t* s, const int32_t* sa, const size_t n) {
+
+	int32_t* lcp = (int32_t*)calloc(n + 1, sizeof(int32_t));
+	int32_t* inv = (int32_t*)malloc(n * sizeof(int32_t));
+
+	if(lcp == NULL || inv == NULL) {
+		free(lcp);
+		free(inv);
+		return NULL;
+	}
+
+	for(size_t i = 0; i < n; ++i) {
+		inv[sa[i]] = (int32_t)i;
+	}
+
+	size_t h = 0;
+	for(size_t i = 0; i < n; ++i) {
+		if(inv[i] > 0) {
+			const size_t j = (size_t)sa[inv[i] - 1];
+			while(i + h < n && j + h < n && s[i + h] == s[j + h]) {
+				++h;
+			}
+			lcp[inv[i]] = (int32_t)h;
+			if(h > 0) {
+				--h;
+			}
+		} else {
+			h = 0;
+		}
+	}
+
+	free(inv);
+	return lcp;
+}
+
+static void _tuple_and_lrs(const uint8_t* s, const size_t n, double* hTuple, double* hLrs) {
+
+	*hTuple = ENTROPY_NA;
+	*hLrs = ENTROPY_NA;
+
+	if(n < 2) {
+		return;
+	}
+
+	int32_t* sa = _suffix_array(s, n);
+	int32_t* lcp = sa != NULL ? _lcp_array(s, sa, n) : NULL;
+
+	if(lcp == NULL) {
+		free(sa);
+		return;
+	}
+	free(sa);
+
+	int32_t maxLcp = 0;
+	for(size_t i = 1; i < n; ++i) {
+		if(lcp[i] > maxLcp) {
+			maxLcp = lcp[i];
+		}
+	}
+
+	/* maxSize[l]: biggest LCP interval with value l (occurrences of the most
+	 * common l-tuple among the intervals of that depth).
+	 * pairs[W]: difference array of the pairs of suffixes whose LCP >= W. */
+	const size_t depth = (size_t)maxLcp + 2;
+	uint64_t* maxSize = (uint64_t*)calloc(depth, sizeof(uint64_t));
+	double* pairs = (double*)calloc(depth + 1, sizeof(double));
+	int32_t* stackLcp = (int32_t*)malloc((n + 1) * sizeof(int32_t));
+	int32_t* stackLb = (int32_t*)malloc((n + 1) * sizeof(int32_t));
+
+	if(maxSize == NULL || pairs == NULL || stackLcp == NULL || stackLb == NULL) {
+		free(lcp); free(maxSize); free(pairs); free(stackLcp); free(stackLb);
+		return;
+	}
+
+	size_t top = 0;
+	stackLcp[0] = 0;
+	stackLb[0] = 0;
+	lcp[n] = 0;
+
+	for(size_t i = 1; i <= n; ++i) {
+		int32_t lb = (int32_t)i - 1;
+
+		while(lcp[i] < stackLcp[top]) {
+			const int32_t l = stackLcp[top];
+			const uint64_t size = (uint64_t)(i - (size_t)stackLb[top]);
+			lb = stackLb[top];
+			--top;
+
+			const int32_t parent = lcp[i] > stackLcp[top] ? lcp[i] : stackLcp[top];
+			if(size > maxSize[l]) {
+				maxSize[l] = size;
+			}
+			/* This interval is the group of the W-tuples for parent < W <= l. */
+			const double c2 = (double)size * (double)(size - 1) / 2.0;
+			pairs[parent + 1] += c2;
+			pairs[l + 1] -= c2;
+		}
+
+		if(lcp[i] > stackLcp[top]) {
+			++top;
+			stackLcp[top] = lcp[i];
+			stackLb[top] = lb;
+		}
+	}
+
+	/* Q[t] = occurrences of the most common t-tuple. */
+	for(size_t l = depth - 1; l-- > 1;) {
+		if(maxSize[l + 1] > maxSize[l]) {
+			maxSize[l] = maxSize[l + 1];
+		}
+	}
+	for(size_t l = 1; l < depth; ++l) {
+		if(maxSize[l] == 0) {
+			maxSize[l] = 1;
+		}
+	}
+
+	size_t t = 0;
+	while(t + 1 < depth && maxSize[t + 1] >= TUPLE_CUTOFF) {
+		++t;
+	}
+
+	/* Q[1] is the histogram maximum even when no sample repeats. */
+	if(t > 0) {
+		double pMax = 0.0;
+		for(size_t i = 1; i <= t; ++i) {
+			const double p = pow((double)maxSize[i] / (double)(n - i + 1), 1.0 / i);
+			if(p > pMax) {
+				pMax = p;
+			}
+		}
+		*hTuple = -log2(_upper_bound(pMax, n));
+	}
+
+	const size_t u = t + 1;
+	const size_t v = (size_t)maxLcp;
+
+	if(u <= v) {
+		double pMax = 0.0, running = 0.0;
+
+		for(size_t w = 1; w <= v; ++w) {
+			running += pairs[w];
+			if(w < u) {
+				continue;
+			}
+			const double total = (double)(n - w + 1) * (double)(n - w) / 2.0;
+			const double p = pow(running / total, 1.0 / w);
+			if(p > pMax) {
+				pMax = p;
+			}
+		}
+		*hLrs = -log2(_upper_bound(pMax, n));
+	}
+
+	free(lcp);
+	free(maxSize);
+	free(pairs);
+	free(stackLcp);
+	free(stackLb);
+}
+
+/******************************************************************************
+** 6.3.7 MultiMCW prediction.
+******************************************************************************/
+
+/* Counters of one window. The mode is the most common value, the most recent
+ * one in case of tie. */
+typedef struct {
+	size_t size;
+	uint32_t count[256];
+	int mode;
+	uint32_t modeCount;
+} mcwWindow;
+
+static void _mcw_rescan(mcwWindow* w, const size_t* lastSeen) {
+
+	w->mode = -1;
+	w->modeCount = 0;
+
+	for(int v = 0; v < 256; ++v) {
+		if(w->count[v] > w->modeCount || (w->count[v] == w->modeCount
+				&& w->count[v] > 0 && lastSeen[v] > lastSeen[w->mode])) {
+			w->mode = v;
+			w->modeCount = w->count[v];
+		}
+	}
+}
+
+static double _multi_mcw(const uint8_t* s, const size_t len, const int k) {
+
+	static const size_t sizes[MCW_WINDOWS] = { 63, 255, 1023, 4095 };
+	mcwWindow* win = (mcwWindow*)calloc(MCW_WINDOWS, sizeof(mcwWindow));
+	size_t lastSeen[256];
+	size_t score[MCW_WINDOWS] = { 0 };
+	predictorScore ps = { 0, 0, 0 };
+	int winner = 0;
+
+	if(win == NULL || len <= sizes[0] + 1) {
+		free(win);
+		return ENTROPY_NA;
+	}
+
+	/* lastSeen is stored plus one, 0 means never seen. */
+	memset(lastSeen, 0, sizeof(lastSeen));
+	for(int j = 0; j < MCW_WINDOWS; ++j) {
+		win[j].size = sizes[j];
+		win[j].mode = -1;
+	}
+
+	for(size_t t = 0; t < len; ++t) {
+
+		int prediction[MCW_WINDOWS];
+		const int x = s[t];
+
+		if(t >= sizes[0]) {
+			for(int j = 0; j < MCW_WINDOWS; ++j) {
+				prediction[j] = t >= sizes[j] ? win[j].mode : -1;
+			}
+
+			_predictor_hit(&ps, prediction[winner] == x);
+
+			for(int j = 0; j < MCW_WINDOWS; ++j) {
+				if(prediction[j] == x) {
+					++score[j];
+					if(score[j] >= score[winner]) {
+						winner = j;
+					}
+				}
+			}
+		}
+
+		/* Slide the windows to contain s[t - size + 1 .. t]. */
+		lastSeen[x] = t + 1;
+		for(int j = 0; j < MCW_WINDOWS; ++j) {
+			mcwWindow* w = &win[j];
+
+			if(++w->count[x] >= w->modeCount) {
+				w->mode = x;
+				w->modeCount = w->count[x];
+			}
+
+			if(t >= w->size) {
+				const int y = s[t - w->size];
+				--w->count[y];
+				if(y == w->mode) {
+					_mcw_rescan(w, lastSeen);
+				}
+			}
+		}
+	}
+
+	free(win);
+	return _predictor_entropy(len - sizes[0], ps.correct, ps.longestRun, k);
+}
+
+/******************************************************************************
+** 6.3.8 Lag prediction.
+******************************************************************************/
+static double _lag(const uint8_t* s, const size_t len, const int k) {
+
+	size_t score[LAG_D + 1] = { 0 };
+	predictorScore ps = { 0, 0, 0 };
+	size_t winner = 1;
+
+	if(len < 3) {
+		return ENTROPY_NA;
+	}
+
+	for(size_t t = 1; t < len; ++t) {
+		const uint8_t x = s[t];
+		const size_t maxD = t < LAG_D ? t : LAG_D;
+
+		_predictor_hit(&ps, winner <= maxD && s[t - winner] == x);
+
+		for(size_t d = 1; d <= maxD; ++d) {
+			if(s[t - d] == x) {
+				++score[d];
+				if(score[d] >= score[winner]) {
+					winner = d;
+				}
+			}
+		}
+	}
+
+	return _predictor_entropy(len - 1, ps.correct, ps.longestRun, k);
+}
+
+/******************************************************************************
+** Dictionaries of MultiMMC and LZ78Y.
+**
+** The contexts are stored as a position and a length in the block, so a
+** node does not copy the samples.
+******************************************************************************/
+
+typedef struct {
+	uint32_t hash;
+	uint32_t pos;
+	uint32_t bestCount;
+	uint8_t len;
+	uint8_t bestY;
+} ctxNode;
+
+/* Counter of y after the context of a node, key = node * 256 + y + 1. */
+typedef struct {
+	uint32_t key;
+	uint32_t count;
+} ctxPair;
+
+/* The limit of the dictionary of the standard applies to the contexts. The
+ * values seen after a context are always counted. */
+typedef struct {
+	const uint8_t* data;
+	int32_t* slots;
+	size_t mask;
+	ctxNode* nodes;
+	size_t nNodes;
+	size_t maxNodes;
+	ctxPair* pairs;			/* Open addressing, doubled at half load. */
+	size_t pairMask;
+	size_t nPairs;
+} ctxTable;
+
+/* Initial size of the table of pairs. */
+#define CTX_PAIRS_INIT			4096
+
+static int _ctx_init(ctxTable* t, const uint8_t* data, const size_t maxNodes) {
+
+	size_t slots = 1;
+	while(slots < 2 * maxNodes) {
+		slots <<= 1;
+	}
+
+	t->data = data;
+	t->mask = slots - 1;
+	t->slots = (int32_t*)malloc(slots * sizeof(int32_t));
+	t->nodes = (ctxNode*)malloc(maxNodes * sizeof(ctxNode));
+	t->pairs = (ctxPair*)calloc(CTX_PAIRS_INIT, sizeof(ctxPair));
+	t->pairMask = CTX_PAIRS_INIT - 1;
+	t->nNodes = 0;
+	t->nPairs = 0;
+	t->maxNodes = maxNodes;
+
+	if(t->slots == NULL || t->nodes == NULL || t->pairs == NULL) {
+		return -1;
+	}
+	memset(t->slots, 0xff, slots * sizeof(int32_t));
+	return 0;
+}
+
+static void _ctx_free(ctxTable* t) {
+	free(t->slots);
+	free(t->nodes);
+	free(t->pairs);
+}
+
+static inline bool _ctx_match(const ctxTable* t, const ctxNode* node, const uint32_t hash,
+		const size_t pos, const size_t len) {
+	return node->hash == hash && node->len == len
+			&& memcmp(t->data + node->pos, t->data + pos, len) == 0;
+}
+
+/* Returns the slot of the context, or the empty slot where it has to go. */
+static size_t _ctx_slot(const ctxTable* t, const uint32_t hash, const size_t pos,
+		const size_t len) {
+
+	size_t slot = hash & t->mask;
+
+	for(;;) {
+		const int32_t idx = t->slots[slot];
+		if(idx < 0) {
+			return slot;
+		}
+		if(_ctx_match(t, &t->nodes[idx], hash, pos, len)) {
+			return slot;
+		}
+		slot = (slot + 1) & t->mask;
+	}
+}
+
+/* Looks for a context. The slot can be passed to _ctx_add as hint, because
+ * the context used for the prediction of s[t] is the one updated with s[t]
+ * in the next step. */
+static const ctxNode* _ctx_find(const ctxTable* t, const uint32_t hash,
+		const size_t pos, const size_t len, size_t* slot) {
+
+	*slot = _ctx_slot(t, hash, pos, len);
+
+	const int32_t idx = t->slots[*slot];
+	return idx < 0 ? NULL : &t->nodes[idx];
+}
+
+static inline size_t _pair_slot(const ctxPair* pairs, const size_t mask, const uint32_t key) {
+
+	size_t p = (key * 0x9E3779B1u) & mask;
+
+	while(pairs[p].key != 0 && pairs[p].key != key) {
+		p = (p + 1) & mask;
+	}
+	return p;
+}
+
+static int _ctx_grow_pairs(ctxTable* t) {
+
+	const size_t mask = 2 * (t->pairMask + 1) - 1;
+	ctxPair* pairs = (ctxPair*)calloc(mask + 1, sizeof(ctxPair));
+
+	if(pairs == NULL) {
+		return -1;
+	}
+	for(size_t i = 0; i <= t->pairMask; ++i) {
+		if(t->pairs[i].key != 0) {
+			pairs[_pair_slot(pairs, mask, t->pairs[i].key)] = t->pairs[i];
+		}
+	}
+
+	free(t->pairs);
+	t->pairs = pairs;
+	t->pairMask = mask;
+	return 0;
+}
+
+/* Counts y after the context. A new context is only added if the dictionary
+ * is not full. hint is the slot returned by _ctx_find for this context, or
+ * SIZE_MAX. */
+static void _ctx_add(ctxTable* t, const uint32_t hash, const size_t pos,
+		const size_t len, const uint8_t y, const size_t hint) {
+
+	size_t slot = hint;
+	ctxNode* node;
+
+	/* The hint is not valid if other context has taken its empty slot. */
+	if(slot == SIZE_MAX || (t->slots[slot] >= 0 && !_ctx_match(t, &t->nodes[t->slots[slot]],
+			hash, pos, len))) {
+		slot = _ctx_slot(t, hash, pos, len);
+	}
+
+	if(t->slots[slot] < 0) {
+		if(t->nNodes >= t->maxNodes) {
+			return;
+		}
+		node = &t->nodes[t->nNodes];
+		node->hash = hash;
+		node->pos = (uint32_t)pos;
+		node->len = (uint8_t)len;
+		node->bestCount = 0;
+		node->bestY = 0;
+		t->slots[slot] = (int32_t)t->nNodes++;
+	} else {
+		node = &t->nodes[t->slots[slot]];
+	}
+
+	const uint32_t key = (uint32_t)(node - t->nodes) * 256 + y + 1;
+	size_t p = _pair_slot(t->pairs, t->pairMask, key);
+
+	if(t->pairs[p].key == 0) {
+		if(2 * (t->nPairs + 1) > t->pairMask + 1) {
+			if(_ctx_grow_pairs(t) != 0) {
+				return;
+			}
+			p = _pair_slot(t->pairs, t->pairMask, key);
+		}
+		++t->nPairs;
+		t->pairs[p].key = key;
+	}
+
+	/* In case of tie the prediction is the biggest value. */
+	const uint32_t c = ++t->pairs[p].count;
+	if(c > node->bestCount || (c == node->bestCount && y > node->bestY)) {
+		node->bestCount = c;
+		node->bestY = y;
+	}
+}
+
+/* hashes[d] = hash of s[end - d + 1 .. end], built from the right. */
+static void _ctx_hashes(const uint8_t* s, const size_t end, const size_t maxLen,
+		uint32_t* hashes) {
+
+	uint64_t h = 0;
+
+	for(size_t d = 1; d <= maxLen; ++d) {
+		h = (h + s[end + 1 - d] + 1) * 0x9E3779B97F4A7C15ULL;
+		hashes[d] = (uint32_t)(h >> 32) ^ (uint32_t)h;
+	}
+}
+
+/******************************************************************************
+** 6.3.9 MultiMMC prediction.
+******************************************************************************/
+static double _multi_mmc(const uint8_t* s, const size_t len, const int k) {
+
+	ctxTable tables[MMC_D + 1];
+	uint32_t prevHash[MMC_D + 1], curHash[MMC_D + 1];
+	size_t hint[MMC_D + 1];
+	size_t score[MMC_D + 1] = { 0 };
+	predictorScore ps = { 0, 0, 0 };
+	size_t winner = 1;
+	double h = ENTROPY_NA;
+	int ok = 1;
+
+	if(len < 3) {
+		return ENTROPY_NA;
+	}
+
+	memset(tables, 0, sizeof(tables));
+	for(int d = 1; d <= MMC_D; ++d) {
+		ok &= _ctx_init(&tables[d], s, MMC_MAX_ENTRIES) == 0;
+	}
+
+	if(ok) {
+		_ctx_hashes(s, 0, 1, prevHash);
+		for(int d = 0; d <= MMC_D; ++d) {
+			hint[d] = SIZE_MAX;
+		}
+
+		for(size_t t = 2; t < len; ++t) {
+			int prediction[MMC_D + 1];
+			const size_t maxD = t < MMC_D ? t : MMC_D;
+
+			/* Count s[t-1] after the contexts that end in s[t-2]. */
+			for(size_t d = 1; d < t && d <= MMC_D; ++d) {
+				_ctx_add(&tables[d], prevHash[d], t - 1 - d, d, s[t - 1], hint[d]);
+			}
+
+			_ctx_hashes(s, t - 1, maxD, curHash);
+
+			for(size_t d = 1; d <= MMC_D; ++d) {
+				const ctxNode* node = d <= maxD ? _ctx_find(&tables[d], curHash[d], t - d, d, &hint[d]) : NULL;
+				prediction[d] = node != NULL ? node->bestY : -1;
+			}
+
+			_predictor_hit(&ps, prediction[winner] == s[t]);
+
+			for(size_t d = 1; d <= MMC_D; ++d) {
+				if(prediction[d] == s[t]) {
+					++score[d];
+					if(score[d] >= score[winner]) {
+						winner = d;
+					}
+				}
+			}
+
+			memcpy(prevHash, curHash, sizeof(curHash));
+		}
+
+		h = _predictor_entropy(len - 2, ps.correct, ps.longestRun, k);
+	}
+
+	for(int d = 1; d <= MMC_D; ++d) {
+		_ctx_free(&tables[d]);
+	}
+	return h;
+}
+
+/******************************************************************************
+** 6.3.10 LZ78Y prediction.
+******************************************************************************/
+static double _lz78y(const uint8_t* s, const size_t len, const int k) {
+
+	ctxTable dict;
+	uint32_t prevHash[LZ78Y_B + 1], curHash[LZ78Y_B + 1];
+	size_t hint[LZ78Y_B + 1];
+	predictorScore ps = { 0, 0, 0 };
+
+	if(len <= LZ78Y_B + 2) {
+		return ENTROPY_NA;
+	}
+
+	if(_ctx_init(&dict, s, LZ78Y_MAX_DICT) != 0) {
+		_ctx_free(&dict);
+		return ENTROPY_NA;
+	}
+
+	_ctx_hashes(s, LZ78Y_B - 1, LZ78Y_B, prevHash);
+	for(int j = 0; j <= LZ78Y_B; ++j) {
+		hint[j] = SIZE_MAX;
+	}
+
+	for(size_t t = LZ78Y_B + 1; t < len; ++t) {
+
+		for(size_t j = LZ78Y_B; j >= 1; --j) {
+			_ctx_add(&dict, prevHash[j], t - 1 - j, j, s[t - 1], hint[j]);
+		}
+
+		_ctx_hashes(s, t - 1, LZ78Y_B, curHash);
+
+		int prediction = -1;
+		uint32_t maxCount = 0;
+
+		for(size_t j = LZ78Y_B; j >= 1; --j) {
+			const ctxNode* node = _ctx_find(&dict, curHash[j], t - j, j, &hint[j]);
+			if(node != NULL && node->bestCount > maxCount) {
+				prediction = node->bestY;
+				maxCount = node->bestCount;
+			}
+		}
+
+		_predictor_hit(&ps, prediction == s[t]);
+		memcpy(prevHash, curHash, sizeof(curHash));
+	}
+
+	_ctx_free(&dict);
+	return _predictor_entropy(len - LZ78Y_B - 1, ps.correct, ps.longestRun, k);
+}
+
+/******************************************************************************
+** Blocks and worker threads.
+******************************************************************************/
+
+/* Runs a job over the samples or over the bitstring of a block. Collision,
+ * Markov and Compression are only defined for binary data. */
+static void _run_job(entropyBlock* b, const entropyJob job, const bool bitstring) {
+
+	/* Binary samples are their own bitstring, copied by _finish_block. */
+	if(bitstring && b->bits == 1) {
+		return;
+	}
+
+	const uint8_t* s = bitstring ? b->bitData : b->data;
+	const size_t len = bitstring ? b->nBits : b->len;
+	const int k = bitstring ? 2 : 1 << b->bits;
+	double* h = bitstring ? b->result.hBits : b->result.h;
+
+	switch(job) {
+	case JOB_MOST_COMMON:
+		h[EST_MOST_COMMON] = _most_common(s, len);
+		break;
+	case JOB_COLLISION:
+		if(k == 2) {
+			h[EST_COLLISION] = _collision(b->bitWords, b->nBits);
+		}
+		break;
+	case JOB_MARKOV:
+		if(k == 2) {
+			h[EST_MARKOV] = _markov(b->bitWords, b->nBits);
+		}
+		break;
+	case JOB_COMPRESSION:
+		if(k == 2) {
+			h[EST_COMPRESSION] = _compression(b->bitWords, b->nBits);
+		}
+		break;
+	case JOB_TUPLE:
+		_tuple_and_lrs(s, len, &h[EST_T_TUPLE], &h[EST_LRS]);
+		break;
+	case JOB_MULTI_MCW:
+		h[EST_MULTI_MCW] = _multi_mcw(s, len, k);
+		break;
+	case JOB_LAG:
+		h[EST_LAG] = _lag(s, len, k);
+		break;
+	case JOB_MULTI_MMC:
+		h[EST_MULTI_MMC] = _multi_mmc(s, len, k);
+		break;
+	case JOB_LZ78Y:
+		h[EST_LZ78Y] = _lz78y(s, len, k);
+		break;
+	default:
+		break;
+	}
+}
+
+static void* _worker(void* arg) {
+
+	entropyBatch* batch = (entropyBatch*)arg;
+	const size_t total = batch->nBlocks * ENTROPY_JOBS * 2;
+
+	/* The jobs are interleaved so the slow ones of each block start first,
+	 * the ones over the bitstring before the ones over the samples. */
+	for(;;) {
+		const size_t i = atomic_fetch_add(&batch->next, 1);
+		if(i >= total) {
+			break;
+		}
+		const size_t round = i / batch->nBlocks;
+		_run_job(&batch->blocks[i % batch->nBlocks], (entropyJob)(ENTROPY_JOBS - 1 - round / 2),
+				(round & 1) == 0);
+	}
+
+	return NULL;
+}
+
+static void _run_batch(entropyBlock* blocks, const size_t nBlocks, const int threads) {
+
+	entropyBatch batch;
+	pthread_t th[256];
+	int n = threads;
+
+	batch.blocks = blocks;
+	batch.nBlocks = nBlocks;
+	atomic_init(&batch.next, 0);
+
+	if(n > (int)(nBlocks * ENTROPY_JOBS * 2)) {
+		n = (int)(nBlocks * ENTROPY_JOBS * 2);
+	}
+	if(n > 256) {
+		n = 256;
+	}
+
+	int started = 0;
+	for(int i = 1; i < n; ++i) {
+		if(pthread_create(&th[started], NULL, _worker, &batch) == 0) {
+			++started;
+		}
+	}
+
+	_worker(&batch);
+
+	for(int i = 0; i < started; ++i) {
+		pthread_join(th[i], NULL);
+	}
+}
+
+/* Masks the samples and packs the bitstring of a block. */
+static void _prepare_block(entropyBlock* b, const size_t len, const int bits) {
+
+	b->len = len;
+	b->bits = bits;
+	b->nBits = len * (size_t)bits;
+
+	for(int e = 0; e < ENTROPY_ESTIMATORS; ++e) {
+		b->result.h[e] = ENTROPY_NA;
+		b->result.hBits[e] = ENTROPY_NA;
+	}
+
+	const size_t nWords = (b->nBits + 63) >> 6;
+
+	if(bits == 8) {
+		size_t w = 0;
+		for(; (w + 1) * 8 <= len; ++w) {
+			uint64_t v;
+			memcpy(&v, b->data + w * 8, 8);
+			b->bitWords[w] = __builtin_bswap64(v);
+		}
+		if(w < nWords) {
+			uint64_t v = 0;
+			for(size_t i = w * 8; i < len; ++i) {
+				v |= (uint64_t)b->data[i] << (56 - 8 * (i - w * 8));
+			}
+			b->bitWords[w] = v;
+		}
+	} else {
+		const uint8_t mask = (uint8_t)((1 << bits) - 1);
+		size_t pos = 0;
+
+		memset(b->bitWords, 0, nWords * sizeof(uint64_t));
+		for(size_t i = 0; i < len; ++i) {
+			b->data[i] &= mask;
+			for(int j = bits - 1; j >= 0; --j, ++pos) {
+				b->bitWords[pos >> 6] |= (uint64_t)((b->data[i] >> j) & 1) << (63 - (pos & 63));
+			}
+		}
+	}
+
+	if(bits > 1) {
+		uint8_t* bit = b->bitData;
+		for(size_t i = 0; i < len; ++i) {
+			for(int j = bits - 1; j >= 0; --j) {
+				*bit++ = (b->data[i] >> j) & 1;
+			}
+		}
+	}
+}
+
+static void _finish_block(entropyBlock* b) {
+
+	entropyResult* r = &b->result;
+
+	r->hOriginal = ENTROPY_NA;
+	r->hBitstring = ENTROPY_NA;
+
+	if(b->bits == 1) {
+		memcpy(r->hBits, r->h, sizeof(r->hBits));
+	}
+
+	for(int e = 0; e < ENTROPY_ESTIMATORS; ++e) {
+		/* -log2(1) gives -0. */
+		if(r->h[e] == 0.0) {
+			r->h[e] = 0.0;
+		}
+		if(r->hBits[e] == 0.0) {
+			r->hBits[e] = 0.0;
+		}
+
+		if(r->h[e] != ENTROPY_NA && (r->hOriginal == ENTROPY_NA || r->h[e] < r->hOriginal)) {
+			r->hOriginal = r->h[e];
+		}
+		if(r->hBits[e] != ENTROPY_NA && (r->hBitstring == ENTROPY_NA || r->hBits[e] < r->hBitstring)) {
+			r->hBitstring = r->hBits[e];
+		}
+	}
+
+	r->hAssessed = r->hOriginal;
+	if(r->hBitstring != ENTROPY_NA) {
+		const double hb = b->bits * r->hBitstring;
+		if(r->hAssessed == ENTROPY_NA || hb < r->hAssessed) {
+			r->hAssessed = hb;
+		}
+	}
+
+	r->samples = b->len;
+	r->blocks = 1;
+}
+
+static void _fold_result(entropyResult* total, const entropyResult* r) {
+
+	double* dst[2 * ENTROPY_ESTIMATORS + 3];
+	const double* src[2 * ENTROPY_ESTIMATORS + 3];
+
+	for(int e = 0; e < ENTROPY_ESTIMATORS; ++e) {
+		dst[e] = &total->h[e];
+		src[e] = &r->h[e];
+		dst[ENTROPY_ESTIMATORS + e] = &total->hBits[e];
+		src[ENTROPY_ESTIMATORS + e] = &r->hBits[e];
+	}
+	dst[2 * ENTROPY_ESTIMATORS] = &total->hOriginal;
+	src[2 * ENTROPY_ESTIMATORS] = &r->hOriginal;
+	dst[2 * ENTROPY_ESTIMATORS + 1] = &total->hBitstring;
+	src[2 * ENTROPY_ESTIMATORS + 1] = &r->hBitstring;
+	dst[2 * ENTROPY_ESTIMATORS + 2] = &total->hAssessed;
+	src[2 * ENTROPY_ESTIMATORS + 2] = &r->hAssessed;
+
+	for(int i = 0; i < 2 * ENTROPY_ESTIMATORS + 3; ++i) {
+		if(*src[i] != ENTROPY_NA && (*dst[i] == ENTROPY_NA || *src[i] < *dst[i])) {
+			*dst[i] = *src[i];
+		}
+	}
+
+	total->samples += r->samples;
+	total->blocks += r->blocks;
+}
+
+static void _reset_result(entropyResult* r) {
+
+	for(int e = 0; e < ENTROPY_ESTIMATORS; ++e) {
+		r->h[e] = ENTROPY_NA;
+		r->hBits[e] = ENTROPY_NA;
+	}
+	r->hOriginal = ENTROPY_NA;
+	r->hBitstring = ENTROPY_NA;
+	r->hAssessed = ENTROPY_NA;
+	r->samples = 0;
+	r->blocks = 0;
+}
+
+static void _resolve_options(const entropyOptions* options, int* bits, size_t* block,
+		int* threads) {
+
+	*bits = options != NULL && options->bitsPerSample > 0 ? options->bitsPerSample : 8;
+	*block = options != NULL && options->blockSamples > 0 ? options->blockSamples : ENTROPY_DEFAULT_BLOCK;
+	*threads = options != NULL && options->threads > 0 ? options->threads : (int)sysconf(_SC_NPROCESSORS_ONLN);
+
+	if(*bits > 8) {
+		*bits = 8;
+	}
+	/* A block can take the samples of a short last block. */
+	if(*block > ENTROPY_MAX_BLOCK / 2 / (size_t)*bits) {
+		*block = ENTROPY_MAX_BLOCK / 2 / (size_t)*bits;
+	}
+	if(*threads < 1) {
+		*threads = 1;
+	}
+}
+
+static int _alloc_blocks(entropyBlock* blocks, const size_t nBlocks, const size_t samples,
+		const int bits) {
+
+	for(size_t i = 0; i < nBlocks; ++i) {
+		blocks[i].data = (uint8_t*)malloc(samples + 8);
+		blocks[i].bitWords = (uint64_t*)malloc(((samples * bits + 63) >> 6) * sizeof(uint64_t) + 8);
+		blocks[i].bitData = bits > 1 ? (uint8_t*)malloc(samples * bits) : NULL;
+		if(blocks[i].data == NULL || blocks[i].bitWords == NULL
+				|| (bits > 1 && blocks[i].bitData == NULL)) {
+			return -1;
+		}
+	}
+	return 0;
+}
+
+static void _free_blocks(entropyBlock* blocks, const size_t nBlocks) {
+
+	for(size_t i = 0; i < nBlocks; ++i) {
+		free(blocks[i].data);
+		free(blocks[i].bitWords);
+		free(blocks[i].bitData);
+	}
+}
+
+int entropy_assess_buffer(const uint8_t* data, const size_t len,
+		const entropyOptions* options, entropyResult* result) {
+
+	int bits, threads;
+	size_t block;
+	entropyBlock b;
+
+	_resolve_options(options, &bits, &block, &threads);
+	_reset_result(result);
+
+	if(data == NULL || len < 2 || len > ENTROPY_MAX_BLOCK / (size_t)bits) {
+		return -1;
+	}
+
+	memset(&b, 0, sizeof(b));
+	if(_alloc_blocks(&b, 1, len, bits) != 0) {
+		_free_blocks(&b, 1);
+		return -1;
+	}
+
+	memcpy(b.data, data, len);
+	_prepare_block(&b, len, bits);
+	_run_batch(&b, 1, threads);
+	_finish_block(&b);
+
+	*result = b.result;
+	_free_blocks(&b, 1);
+
+	return 0;
+}
+
+int entropy_assess_stream(entropyReader reader, void* readerCtx,
+		const entropyOptions* options, entropyBlockCallback callback,
+		void* callbackCtx, entropyResult* result) {
+
+	int bits, threads;
+	size_t block;
+
+	_resolve_options(options, &bits, &block, &threads);
+	_reset_result(result);
+
+	if(reader == NULL) {
+		return -1;
+	}
+
+	/* One block per thread keeps all the cores busy with bounded memory. The
+	 * last block read is held back until the next one, so a short last block
+	 * can be merged into it. Each buffer has room for two blocks. */
+	const size_t batchBlocks = (size_t)threads;
+	entropyBlock* blocks = (entropyBlock*)calloc(batchBlocks + 1, sizeof(entropyBlock));
+
+	if(blocks == NULL || _alloc_blocks(blocks, batchBlocks + 1, 2 * block, bits) != 0) {
+		if(blocks != NULL) {
+			_free_blocks(blocks, batchBlocks + 1);
+		}
+		free(blocks);
+		return -1;
+	}
+
+	uint64_t blockIndex = 0;
+	size_t nBlocks = 0;
+	bool end = false;
+
+	while(!end) {
+
+		while(nBlocks <= batchBlocks && !end) {
+			entropyBlock* cur = &blocks[nBlocks];
+			size_t filled = 0;
+
+			while(filled < block) {
+				const size_t n = reader(readerCtx, cur->data + filled, block - filled);
+				if(n == 0) {
+					end = true;
+					break;
+				}
+				filled += n;
+			}
+
+			if(filled == block) {
+				cur->len = filled;
+				++nBlocks;
+			} else if(nBlocks > 0) {
+				entropyBlock* prev = &blocks[nBlocks - 1];
+				memcpy(prev->data + prev->len, cur->data, filled);
+				prev->len += filled;
+			} else if(filled >= ENTROPY_MIN_BLOCK) {
+				/* The whole stream is shorter than a block. */
+				cur->len = filled;
+				++nBlocks;
+			}
+		}
+
+		const size_t ready = end ? nBlocks : nBlocks - 1;
+
+		if(ready == 0) {
+			break;
+		}
+
+		for(size_t i = 0; i < ready; ++i) {
+			_prepare_block(&blocks[i], blocks[i].len, bits);
+		}
+		_run_batch(blocks, ready, threads);
+
+		for(size_t i = 0; i < ready; ++i) {
+			_finish_block(&blocks[i]);
+			_fold_result(result, &blocks[i].result);
+			if(callback != NULL) {
+				callback(callbackCtx, blockIndex, &blocks[i].result);
+			}
+			++blockIndex;
+		}
+
+		/* The held back block starts the next batch. */
+		if(!end) {
+			const entropyBlock held = blocks[ready];
+			blocks[ready] = blocks[0];
+			blocks[0] = held;
+			nBlocks = 1;
+		}
+	}
+
+	_free_blocks(blocks, batchBlocks + 1);
+	free(blocks);
+
+	return result->blocks > 0 ? 0 : -1;
+}
+
+static size_t _file_reader(void* ctx, uint8_t* buf, const size_t len) {
+	return fread(buf, 1, len, (FILE*)ctx);
+}
+
+int entropy_assess_file(const char* path, const entropyOptions* options,
+		entropyBlockCallback callback, void* callbackCtx, entropyResult* result) {
+
+	FILE* f = fopen(path, "rb");
+
+	if(f == NULL) {
+		_reset_result(result);
+		return -1;
+	}
+
+	const int ret = entropy_assess_stream(_file_reader, f, options, callback, callbackCtx, result);
+	fclose(f);
+
+	return ret;
+}
+
+/* State of the captures of entropy_assess_device. */
+typedef struct {
+	uint16_t devInd;
+	uint64_t remaining;
+} deviceReader;
+
+/* Maximum bytes of one capture. */
+#define ENTROPY_CAPTURE_BYTES	(1 << 20)
+
+static size_t _device_reader(void* ctx, uint8_t* buf, const size_t len) {
+
+	deviceReader* dr = (deviceReader*)ctx;
+	size_t n = len < ENTROPY_CAPTURE_BYTES ? len : ENTROPY_CAPTURE_BYTES;
+
+	if(n > dr->remaining) {
+		n = (size_t)dr->remaining;
+	}
+	if(n == 0) {
+		return 0;
+	}
+
+	/* The library writes whole uint32 words. */
+	uint32_t* words = (uint32_t*)malloc((n + 3) & ~(size_t)3);
+	if(words == NULL || combiner_get_raw(words, n, dr->devInd) != 0) {
+		free(words);
+		return 0;
+	}
+
+	memcpy(buf, words, n);
+	free(words);
+	dr->remaining -= n;
+
+	return n;
+}
+
+int entropy_assess_device(const uint16_t devInd, const uint64_t nBytes,
+		const entropyOptions* options, entropyBlockCallback callback,
+		void* callbackCtx, entropyResult* result) {
+
+	deviceReader dr;
+
+	dr.devInd = devInd;
+	dr.remaining = nBytes;
+
+	return entropy_assess_stream(_device_reader, &dr, options, callback, callbackCtx, result);
+}
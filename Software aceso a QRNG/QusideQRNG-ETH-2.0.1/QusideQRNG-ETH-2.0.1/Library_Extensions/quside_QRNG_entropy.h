@@ -0,0 +1,166 @@
+/*
+ ============================================================================
+ Name        : quside_QRNG_entropy.h
+ Author      : Alvaro Velasco Garcia, Heriberto J. Diaz
+ Created on  : 18 oct. 2022
+ Version     : 0.1
+ Copyright   : Copyright (C) 2022 QUSIDE TECHNOLOGIES - All Rights Reserved.
+               Unauthorized copying of this file, via any medium is
+               strictly prohibited.
+ Description : This header defines an independent min-entropy assessment of
+               the raw data of a QRNG with the non-IID estimators of
+               NIST SP 800-90B (section 6.3).
+ ============================================================================
+ */
+
+#ifndef QUSIDE_QRNG_ENTROPY_H
+#define QUSIDE_QRNG_ENTROPY_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* Value of an estimate that can not be computed with the provided data. */
+#define ENTROPY_NA					(-1.0)
+
+/* Number of samples of a block. SP 800-90B requires at least 1000000. */
+#define ENTROPY_DEFAULT_BLOCK		1000000
+
+/* A stream shorter than a block is assessed only if it has at least this
+ * number of samples. A short last block is merged into the previous one. */
+#define ENTROPY_MIN_BLOCK			100000
+
+/* Estimators of SP 800-90B section 6.3. */
+typedef enum {
+	EST_MOST_COMMON,		/* 6.3.1, samples. */
+	EST_COLLISION,			/* 6.3.2, binary data only. */
+	EST_MARKOV,				/* 6.3.3, binary data only. */
+	EST_COMPRESSION,		/* 6.3.4, binary data only. */
+	EST_T_TUPLE,			/* 6.3.5, samples. */
+	EST_LRS,				/* 6.3.6, samples. */
+	EST_MULTI_MCW,			/* 6.3.7, samples. */
+	EST_LAG,				/* 6.3.8, samples. */
+	EST_MULTI_MMC,			/* 6.3.9, samples. */
+	EST_LZ78Y,				/* 6.3.10, samples. */
+	ENTROPY_ESTIMATORS
+} entropyEstimator;
+
+/* Options of an assessment. */
+typedef struct {
+	int bitsPerSample;		/* Bits used of each byte (1..8). 0 means 8. */
+	size_t blockSamples;	/* Samples of each block. 0 means ENTROPY_DEFAULT_BLOCK. */
+	int threads;			/* Worker threads. 0 means one per online core. */
+} entropyOptions;
+
+/* Result of an assessment. h are the estimates over the samples, in bits per
+ * sample. hBits are the estimates of all the estimators over the bitstring of
+ * the samples, in bits per bit. With 1 bit per sample both are the same. */
+typedef struct {
+	double h[ENTROPY_ESTIMATORS];
+	double hBits[ENTROPY_ESTIMATORS];
+	double hOriginal;		/* Minimum of the estimates over the samples. */
+	double hBitstring;		/* Minimum of the estimates over the bitstring. */
+	double hAssessed;		/* min(hOriginal, bitsPerSample * hBitstring). */
+	uint64_t samples;		/* Samples assessed. */
+	uint64_t blocks;		/* Blocks assessed. */
+} entropyResult;
+
+/* Function that fills buf with up to len bytes. It returns the number of bytes
+ * read, 0 at the end of the stream. */
+typedef size_t (*entropyReader)(void* ctx, uint8_t* buf, const size_t len);
+
+/* Function called after each block is assessed, in the order of the stream. */
+typedef void (*entropyBlockCallback)(void* ctx, const uint64_t block,
+		const entropyResult* result);
+
+/******************************************************************************
+** entropy_estimator_name
+**
+** Returns the name of an estimator.
+**
+** @param est [const entropyEstimator] Estimator.
+**
+** @return [const char*] Name of the estimator.
+******************************************************************************/
+const char* entropy_estimator_name(const entropyEstimator est);
+
+/******************************************************************************
+** entropy_assess_buffer
+**
+** Assesses a buffer as a single block. The estimators run in parallel.
+**
+** @param data [const uint8_t*] One sample per byte.
+** @param len [const size_t] Number of samples.
+** @param options [const entropyOptions*] Options. NULL uses the defaults.
+** @param result [entropyResult*] Variable that will contain the result.
+**
+** @return [int] If it success returns 0, otherwise -1.
+******************************************************************************/
+int entropy_assess_buffer(const uint8_t* data, const size_t len,
+		const entropyOptions* options, entropyResult* result);
+
+/******************************************************************************
+** entropy_assess_stream
+**
+** Assesses a stream block by block without loading it whole. The blocks
+** and the estimators run in parallel in the worker threads. Each block is an
+** independent assessment, and the result is the minimum over all of them.
+** A last block shorter than blockSamples is merged into the previous one.
+**
+** @param reader [entropyReader] Function that reads the stream.
+** @param readerCtx [void*] Argument of reader.
+** @param options [const entropyOptions*] Options. NULL uses the defaults.
+** @param callback [entropyBlockCallback] Called for each block, can be NULL.
+** @param callbackCtx [void*] Argument of callback.
+** @param result [entropyResult*] Variable that will contain the minimum of
+**                                each estimate over all the blocks.
+**
+** @return [int] If it success returns 0, otherwise -1.
+******************************************************************************/
+int entropy_assess_stream(entropyReader reader, void* readerCtx,
+		const entropyOptions* options, entropyBlockCallback callback,
+		void* callbackCtx, entropyResult* result);
+
+/******************************************************************************
+** entropy_assess_file
+**
+** Assesses a file of raw data with entropy_assess_stream.
+**
+** @param path [const char*] Path of the file.
+** @param options [const entropyOptions*] Options. NULL uses the defaults.
+** @param callback [entropyBlockCallback] Called for each block, can be NULL.
+** @param callbackCtx [void*] Argument of callback.
+** @param result [entropyResult*] Variable that will contain the result.
+**
+** @return [int] If it success returns 0, otherwise -1.
+******************************************************************************/
+int entropy_assess_file(const char* path, const entropyOptions* options,
+		entropyBlockCallback callback, void* callbackCtx, entropyResult* result);
+
+/******************************************************************************
+** entropy_assess_device
+**
+** Captures raw data with combiner_get_raw and assesses it with
+** entropy_assess_stream. The combiner has to be initialized.
+**
+** @param devInd [const uint16_t] Index of the device to use from the list.
+** @param nBytes [const uint64_t] Number of raw bytes to capture.
+** @param options [const entropyOptions*] Options. NULL uses the defaults.
+** @param callback [entropyBlockCallback] Called for each block, can be NULL.
+** @param callbackCtx [void*] Argument of callback.
+** @param result [entropyResult*] Variable that will contain the result.
+**
+** @return [int] If it success returns 0, otherwise -1.
+******************************************************************************/
+int entropy_assess_device(const uint16_t devInd, const uint64_t nBytes,
+		const entropyOptions* options, entropyBlockCallback callback,
+		void* callbackCtx, entropyResult* result);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* QUSIDE_QRNG_ENTROPY_H */
@@ -0,0 +1,134 @@
+/*
+ ============================================================================
+ Name        : quside_QRNG_gateway.h
+ Author      : Alvaro Velasco Garcia, Heriberto J. Diaz
+ Created on  : 18 oct. 2022
+ Version     : 0.1
+ Copyright   : Copyright (C) 2022 QUSIDE TECHNOLOGIES - All Rights Reserved.
+               Unauthorized copying of this file, via any medium is
+               strictly prohibited.
+ Description : This header defines the binary protocol between the entropy
+               gateway (QusideQRNG_Gateway) and its clients.
+
+               The client sends requests of GW_HEADER_SIZE bytes and can
+               send several of them without waiting. The gateway answers
+               each request in order with a response of GW_HEADER_SIZE
+               bytes followed by nBytes of data. All the fields are little
+               endian.
+
+                   Request:  magic[4] op[2] devInd[2] nBytes[4]
+                   Response: magic[4] status[4] nBytes[4] data[nBytes]
+
+               libqusideQRNGgateway.so implements the functions of
+               quside_QRNG_user.h over this protocol, so a program linked
+               with it uses the gateway instead of the QRNG. The argument
+               of connectToServer is "ip" or "ip:port".
+ ============================================================================
+ */
+
+#ifndef QUSIDE_QRNG_GATEWAY_H
+#define QUSIDE_QRNG_GATEWAY_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <string.h>
+#include <endian.h>
+
+#define GW_MAGIC				0x31574751u		/* "QGW1" */
+#define GW_DEFAULT_PORT			7733
+#define GW_HEADER_SIZE			12
+
+/* Biggest nBytes of one request. */
+#define GW_MAX_REQUEST			(1u << 20)
+
+/* Operations of a request. */
+typedef enum {
+	GW_OP_RANDOM = 1,
+	GW_OP_RAW = 2,
+	GW_OP_DISCONNECT = 3
+} gatewayOp;
+
+/* Status of a response. */
+typedef enum {
+	GW_STATUS_OK = 0,
+	GW_STATUS_ERROR = -1,
+	GW_STATUS_UNSUPPORTED = -2,
+	GW_STATUS_TOO_BIG = -3
+} gatewayStatus;
+
+typedef struct {
+	uint16_t op;
+	uint16_t devInd;
+	uint32_t nBytes;
+} gatewayRequest;
+
+typedef struct {
+	int32_t status;
+	uint32_t nBytes;
+} gatewayResponse;
+
+static inline void gw_encode_request(uint8_t* buf, const gatewayRequest* req) {
+
+	const uint32_t magic = htole32(GW_MAGIC);
+	const uint16_t op = htole16(req->op);
+	const uint16_t dev = htole16(req->devInd);
+	const uint32_t n = htole32(req->nBytes);
+
+	memcpy(buf, &magic, 4);
+	memcpy(buf + 4, &op, 2);
+	memcpy(buf + 6, &dev, 2);
+	memcpy(buf + 8, &n, 4);
+}
+
+/* Returns 0 if the magic is right, otherwise -1. */
+static inline int gw_decode_request(const uint8_t* buf, gatewayRequest* req) {
+
+	uint32_t magic, n;
+	uint16_t op, dev;
+
+	memcpy(&magic, buf, 4);
+	memcpy(&op, buf + 4, 2);
+	memcpy(&dev, buf + 6, 2);
+	memcpy(&n, buf + 8, 4);
+
+	req->op = le16toh(op);
+	req->devInd = le16toh(dev);
+	req->nBytes = le32toh(n);
+
+	return le32toh(magic) == GW_MAGIC ? 0 : -1;
+}
+
+static inline void gw_encode_response(uint8_t* buf, const gatewayResponse* res) {
+
+	const uint32_t magic = htole32(GW_MAGIC);
+	const uint32_t status = htole32((uint32_t)res->status);
+	const uint32_t n = htole32(res->nBytes);
+
+	memcpy(buf, &magic, 4);
+	memcpy(buf + 4, &status, 4);
+	memcpy(buf + 8, &n, 4);
+}
+
+/* Returns 0 if the magic is right, otherwise -1. */
+static inline int gw_decode_response(const uint8_t* buf, gatewayResponse* res) {
+
+	uint32_t magic, status, n;
+
+	memcpy(&magic, buf, 4);
+	memcpy(&status, buf + 4, 4);
+	memcpy(&n, buf + 8, 4);
+
+	res->status = (int32_t)le32toh(status);
+	res->nBytes = le32toh(n);
+
+	return le32toh(magic) == GW_MAGIC ? 0 : -1;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* QUSIDE_QRNG_GATEWAY_H */
@@ -0,0 +1,225 @@
+/*
+ ============================================================================
+ Name        : quside_QRNG_gateway_client.c
+ Author      : Alvaro Velasco Garcia, Heriberto J. Diaz
+ Created on  : 18 oct. 2022
+ Version     : 0.1
+ Copyright   : Copyright (C) 2022 QUSIDE TECHNOLOGIES - All Rights Reserved.
+               Unauthorized copying of this file, via any medium is
+               strictly prohibited.
+ Description : Drop-in replacement of libqusideQRNGuser.so that takes the
+               random numbers from an entropy gateway. The functions can be
+               called from any thread.
+
+               The gateway shares the QRNG between many hosts, so reset
+               does nothing and the device list has one device with ID 0.
+ ============================================================================
+ */
+
+#include "quside_QRNG_gateway.h"
+#include <quside_QRNG_user.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <errno.h>
+
+/* Requests sent before reading the first response of a big capture. */
+#define GW_CLIENT_PIPELINE		8
+
+static int gwSocket = INVALID_SOCKET;
+static pthread_mutex_t gwMutex = PTHREAD_MUTEX_INITIALIZER;
+static uint16_t gwDevices[1] = { 0 };
+
+static int _send_all(const int fd, const void* buf, const size_t len) {
+
+	const uint8_t* p = (const uint8_t*)buf;
+	size_t done = 0;
+
+	while(done < len) {
+		const ssize_t n = send(fd, p + done, len - done, MSG_NOSIGNAL);
+		if(n < 0 && errno == EINTR) {
+			continue;
+		}
+		if(n <= 0) {
+			return -1;
+		}
+		done += (size_t)n;
+	}
+	return 0;
+}
+
+static int _recv_all(const int fd, void* buf, const size_t len) {
+
+	uint8_t* p = (uint8_t*)buf;
+	size_t done = 0;
+
+	while(done < len) {
+		const ssize_t n = recv(fd, p + done, len - done, 0);
+		if(n < 0 && errno == EINTR) {
+			continue;
+		}
+		if(n <= 0) {
+			return -1;
+		}
+		done += (size_t)n;
+	}
+	return 0;
+}
+
+int connectToServer(char *serverIP) {
+
+	char host[64];
+	int port = GW_DEFAULT_PORT;
+	struct sockaddr_in addr;
+
+	if(serverIP == NULL) {
+		return -1;
+	}
+
+	strncpy(host, serverIP, sizeof(host) - 1);
+	host[sizeof(host) - 1] = '\0';
+
+	char* colon = strchr(host, ':');
+	if(colon != NULL) {
+		*colon = '\0';
+		port = atoi(colon + 1);
+	}
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons((uint16_t)port);
+	if(inet_pton(AF_INET, host, &addr.sin_addr) != 1) {
+		return -1;
+	}
+
+	const int fd = socket(AF_INET, SOCK_STREAM, 0);
+	if(fd < 0) {
+		return -1;
+	}
+
+	if(connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+		close(fd);
+		return -1;
+	}
+
+	const int one = 1;
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+	pthread_mutex_lock(&gwMutex);
+	if(gwSocket != INVALID_SOCKET) {
+		close(gwSocket);
+	}
+	gwSocket = fd;
+	pthread_mutex_unlock(&gwMutex);
+
+	return 0;
+}
+
+void disconnectServer(void) {
+
+	pthread_mutex_lock(&gwMutex);
+
+	if(gwSocket != INVALID_SOCKET) {
+		uint8_t buf[GW_HEADER_SIZE];
+		gatewayRequest req = { GW_OP_DISCONNECT, 0, 0 };
+
+		gw_encode_request(buf, &req);
+		_send_all(gwSocket, buf, sizeof(buf));
+		close(gwSocket);
+		gwSocket = INVALID_SOCKET;
+	}
+
+	pthread_mutex_unlock(&gwMutex);
+}
+
+void reset(void) {
+}
+
+/******************************************************************************
+** _capture
+**
+** Sends the requests of a capture in pieces of GW_MAX_REQUEST bytes, with
+** up to GW_CLIENT_PIPELINE of them in flight.
+******************************************************************************/
+static int _capture(uint8_t* dst, const size_t nBytes, const uint16_t devInd,
+		const uint16_t op) {
+
+	size_t sent = 0, received = 0;
+	int ret = 0;
+
+	pthread_mutex_lock(&gwMutex);
+
+	if(gwSocket == INVALID_SOCKET) {
+		pthread_mutex_unlock(&gwMutex);
+		return -1;
+	}
+
+	while(received < nBytes) {
+
+		while(sent < nBytes && sent - received < (size_t)GW_CLIENT_PIPELINE * GW_MAX_REQUEST) {
+			uint8_t buf[GW_HEADER_SIZE];
+			gatewayRequest req;
+
+			req.op = op;
+			req.devInd = devInd;
+			req.nBytes = (uint32_t)(nBytes - sent < GW_MAX_REQUEST ? nBytes - sent : GW_MAX_REQUEST);
+
+			gw_encode_request(buf, &req);
+			if(_send_all(gwSocket, buf, sizeof(buf)) != 0) {
+				/* The responses of the requests already sent are not read. */
+				close(gwSocket);
+				gwSocket = INVALID_SOCKET;
+				ret = -1;
+				break;
+			}
+			sent += req.nBytes;
+		}
+
+		if(ret != 0) {
+			break;
+		}
+
+		uint8_t buf[GW_HEADER_SIZE];
+		gatewayResponse res;
+		const size_t expected = nBytes - received < GW_MAX_REQUEST ? nBytes - received : GW_MAX_REQUEST;
+
+		if(_recv_all(gwSocket, buf, sizeof(buf)) != 0 || gw_decode_response(buf, &res) != 0
+				|| res.nBytes > expected || _recv_all(gwSocket, dst + received, res.nBytes) != 0) {
+			/* The stream is not in sync anymore. */
+			close(gwSocket);
+			gwSocket = INVALID_SOCKET;
+			ret = -1;
+			break;
+		}
+
+		if(res.status != GW_STATUS_OK || res.nBytes != expected) {
+			ret = -1;
+		}
+		received += expected;
+	}
+
+	pthread_mutex_unlock(&gwMutex);
+
+	return ret;
+}
+
+int get_random(uint32_t* mem_slot, const size_t Nuint32, const uint16_t devInd) {
+	return mem_slot == NULL ? -1 : _capture((uint8_t*)mem_slot, Nuint32, devInd, GW_OP_RANDOM);
+}
+
+int get_raw(uint32_t* mem_slot, const size_t Nuint32, const uint16_t devInd) {
+	return mem_slot == NULL ? -1 : _capture((uint8_t*)mem_slot, Nuint32, devInd, GW_OP_RAW);
+}
+
+uint16_t find_boards(void) {
+	return 1;
+}
+
+void get_boards(uint16_t** devIDs, uint16_t* numDevs) {
+
+	*devIDs = gwDevices;
+	*numDevs = 1;
+}
+
+int find_device(const uint16_t devID) {
+	return devID == gwDevices[0] ? 0 : -1;
+}
@@ -0,0 +1,811 @@
+/*
+ ============================================================================
+ Name        : quside_QRNG_provider.c
+ Author      : Alvaro Velasco Garcia, Heriberto J. Diaz
+ Created on  : 18 oct. 2022
+ Version     : 0.1
+ Copyright   : Copyright (C) 2022 QUSIDE TECHNOLOGIES - All Rights Reserved.
+               Unauthorized copying of this file, via any medium is
+               strictly prohibited.
+ Description : OpenSSL 3 provider with the QRNG as RAND algorithm.
+
+               A thread keeps the connection with the QRNG and refills a
+               ring buffer, locked in memory and excluded from core dumps,
+               with get_random. The requests of OpenSSL only copy from the
+               buffer, so they never wait for the network. The bytes taken
+               are wiped from the buffer. If the buffer can not be locked it
+               is reduced down to two chunks, and if it still can not be
+               locked the OS serves all the requests (unless allow_unlocked).
+
+               A request that the buffer can not serve (the QRNG is not
+               reachable, the buffer is empty or the request is bigger than
+               the buffer) is served by getrandom and counted as a miss. The
+               thread connects again with an exponential backoff, that also
+               grows while the captures fail. A seed
+               waits a little for the buffer while the QRNG is connected (or
+               connecting the first time), so the first seed after loading
+               the provider also comes from the QRNG.
+
+               Used as seed source, the DRBGs of OpenSSL only call it when
+               they reseed. Used as DRBG, it serves all the requests.
+
+               The library keeps one connection per process. The provider
+               does not start if the application already opened it (seen in
+               tcpSocket when the library exports it). With shared = 1 the
+               provider does not connect: it captures with the combiner of
+               the application, that owns the connection. After a fork the
+               child only uses getrandom.
+
+               A library call can not be cancelled, so the teardown waits for
+               the thread up to PROV_STOP_WAIT_MS. After that the thread is
+               left to end by itself: it wipes and frees the buffer, and the
+               module is kept loaded until then.
+ ============================================================================
+ */
+
+#define _GNU_SOURCE
+
+#include "quside_QRNG_provider.h"
+#include <quside_QRNG_user.h>
+#include <openssl/core_dispatch.h>
+#include <openssl/core_names.h>
+#include <openssl/params.h>
+#include <openssl/crypto.h>
+#include <openssl/evp.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+#include <sys/random.h>
+#include <errno.h>
+#include <dlfcn.h>
+
+#define PROV_NAME				"Quside QRNG provider"
+#define PROV_VERSION			"0.1"
+#define PROV_REFILL_CHUNK		65536
+#define PROV_DEFAULT_BUFFER_KB	1024
+#define PROV_RETRY_MIN_MS		1000
+#define PROV_RETRY_MAX_MS		30000
+#define PROV_STRENGTH			256
+#define PROV_MAX_REQUEST		65536
+#define PROV_SEED_WAIT_MS		100
+#define PROV_STOP_WAIT_MS		1000
+
+/* Socket of the connection of the library. It is not in quside_QRNG_user.h,
+ * so it is only read when the library exports it. */
+extern int tcpSocket __attribute__((weak));
+
+/* Combiner of the application, used with shared = 1. */
+extern int combiner_get_random(uint32_t* mem_slot, const size_t Nuint32, const uint16_t devInd)
+		__attribute__((weak));
+
+/* Context of a RAND of the provider. The buffer is shared by all of them. */
+typedef struct {
+	int state;
+} qrngRand;
+
+static uint8_t* ring = NULL;
+static size_t ringSize = 0;
+static uint64_t ringHead = 0;			/* Bytes taken. */
+static uint64_t ringTail = 0;			/* Bytes captured. */
+static pthread_mutex_t poolMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t refillCond;
+static pthread_cond_t filledCond;
+static pthread_t refill;
+static bool running = false;
+static bool connected = false;
+static bool starting = false;			/* The first connection is not tried yet. */
+static bool threadAlive = false;		/* The refill thread has not ended. */
+static bool orphan = false;				/* The thread was left to end by itself. */
+static bool shared = false;				/* Captures through the combiner of the application. */
+static size_t lockedBytes = 0;
+static int ownSocket = 0;				/* tcpSocket left by the connections of the provider. */
+static int instances = 0;
+static pid_t poolPid = 0;
+static char serverIP[64];
+static uint16_t devIndex = 0;
+
+static atomic_uint_fast64_t hits;
+static atomic_uint_fast64_t misses;
+static atomic_uint_fast64_t qrngBytes;
+static atomic_uint_fast64_t osBytes;
+static atomic_uint_fast64_t errors;
+
+/******************************************************************************
+** Buffer of random numbers.
+******************************************************************************/
+
+static void _deadline(struct timespec* ts, const int ms) {
+
+	clock_gettime(CLOCK_MONOTONIC, ts);
+	ts->tv_sec += ms / 1000;
+	ts->tv_nsec += (long)(ms % 1000) * 1000000L;
+	if(ts->tv_nsec >= 1000000000L) {
+		ts->tv_sec++;
+		ts->tv_nsec -= 1000000000L;
+	}
+}
+
+/* Waits ms or until the provider is stopped. poolMutex is held. */
+static void _wait_ms(const int ms) {
+
+	struct timespec ts;
+	_deadline(&ts, ms);
+
+	while(running && pthread_cond_timedwait(&refillCond, &poolMutex, &ts) == 0) {
+		/* Woken by a consumer, the time is not over. */
+	}
+}
+
+static int _backoff(const int retryMs) {
+	return 2 * retryMs < PROV_RETRY_MAX_MS ? 2 * retryMs : PROV_RETRY_MAX_MS;
+}
+
+/* Wipes and frees the buffer. poolMutex is held. */
+static void _free_ring(void) {
+
+	if(ring != NULL) {
+		memset(ring, 0, ringSize);
+		if(lockedBytes > 0) {
+			munlock(ring, ringSize);
+		}
+		munmap(ring, ringSize);
+		ring = NULL;
+		ringSize = 0;
+		lockedBytes = 0;
+	}
+}
+
+static void* _refill_thread(void* arg) {
+
+	int retryMs = PROV_RETRY_MIN_MS;
+
+	(void)arg;
+
+	pthread_mutex_lock(&poolMutex);
+
+	while(running) {
+
+		if(!connected) {
+			pthread_mutex_unlock(&poolMutex);
+			const bool ok = shared || connectToServer(serverIP) == 0;
+			pthread_mutex_lock(&poolMutex);
+
+			if(ok && !shared && &tcpSocket != NULL) {
+				ownSocket = tcpSocket;
+			}
+			starting = false;
+			pthread_cond_broadcast(&filledCond);
+
+			if(!ok) {
+				atomic_fetch_add(&errors, 1);
+				_wait_ms(retryMs);
+				retryMs = _backoff(retryMs);
+				continue;
+			}
+			connected = true;
+		}
+
+		if(ringSize - (size_t)(ringTail - ringHead) < PROV_REFILL_CHUNK) {
+			pthread_cond_wait(&refillCond, &poolMutex);
+			continue;
+		}
+
+		/* ringSize is a multiple of the chunk, so the chunk is contiguous. The
+		 * consumers never read after ringTail, so it is filled out of the lock. */
+		uint8_t* dst = ring + ringTail % ringSize;
+		pthread_mutex_unlock(&poolMutex);
+		const int ret = shared ? combiner_get_random((uint32_t*)dst, PROV_REFILL_CHUNK, devIndex)
+				: get_random((uint32_t*)dst, PROV_REFILL_CHUNK, devIndex);
+		pthread_mutex_lock(&poolMutex);
+
+		if(ret != 0) {
+			memset(dst, 0, PROV_REFILL_CHUNK);
+			atomic_fetch_add(&errors, 1);
+			if(!shared) {
+				disconnectServer();
+			}
+			connected = false;
+			_wait_ms(retryMs);
+			retryMs = _backoff(retryMs);
+			continue;
+		}
+
+		retryMs = PROV_RETRY_MIN_MS;
+		ringTail += PROV_REFILL_CHUNK;
+		pthread_cond_broadcast(&filledCond);
+	}
+
+	if(connected && !shared) {
+		disconnectServer();
+	}
+	connected = false;
+
+	/* Nobody waits for a thread left to end by itself. */
+	if(orphan) {
+		_free_ring();
+		orphan = false;
+	}
+	threadAlive = false;
+	pthread_cond_broadcast(&filledCond);
+
+	pthread_mutex_unlock(&poolMutex);
+
+	return NULL;
+}
+
+/* Locks the buffer, reduced down to two chunks if it is over the limit of
+ * locked memory. Returns the bytes locked, 0 if it can not be locked. */
+static size_t _lock_ring(void) {
+
+	size_t size = ringSize;
+
+	while(mlock(ring, size) != 0) {
+		if(size <= 2 * PROV_REFILL_CHUNK) {
+			return 0;
+		}
+		size = size / 2 / PROV_REFILL_CHUNK * PROV_REFILL_CHUNK;
+		if(size < 2 * PROV_REFILL_CHUNK) {
+			size = 2 * PROV_REFILL_CHUNK;
+		}
+	}
+
+	if(size < ringSize) {
+		munmap(ring + size, ringSize - size);
+		ringSize = size;
+	}
+	return size;
+}
+
+static void _pool_start(const char* server, const uint16_t device, size_t bufferKB, const bool allowUnlocked,
+		const bool sharedMode) {
+
+	pthread_condattr_t attr;
+
+	poolPid = getpid();
+
+	/* The thread of the last start still uses the buffer and the conditions:
+	 * the OS serves the requests. */
+	if(orphan) {
+		return;
+	}
+
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&refillCond, &attr);
+	pthread_cond_init(&filledCond, &attr);
+	pthread_condattr_destroy(&attr);
+
+	if(sharedMode ? combiner_get_random == NULL : server == NULL || server[0] == '\0') {
+		/* Without QRNG all the requests are served by the OS. */
+		return;
+	}
+
+	/* The connection of the library is not taken from the application. */
+	if(!sharedMode && &tcpSocket != NULL && tcpSocket != 0 && tcpSocket != ownSocket) {
+		atomic_fetch_add(&errors, 1);
+		return;
+	}
+
+	ringSize = bufferKB * 1024 / PROV_REFILL_CHUNK * PROV_REFILL_CHUNK;
+	if(ringSize < 2 * PROV_REFILL_CHUNK) {
+		ringSize = 2 * PROV_REFILL_CHUNK;
+	}
+
+	ring = (uint8_t*)mmap(NULL, ringSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if(ring == MAP_FAILED) {
+		ring = NULL;
+		ringSize = 0;
+		return;
+	}
+
+	/* The random numbers are not swapped, dumped or inherited. */
+	lockedBytes = _lock_ring();
+	if(lockedBytes == 0 && !allowUnlocked) {
+		_free_ring();
+		return;
+	}
+#ifdef MADV_DONTDUMP
+	madvise(ring, ringSize, MADV_DONTDUMP);
+#endif
+#ifdef MADV_WIPEONFORK
+	madvise(ring, ringSize, MADV_WIPEONFORK);
+#endif
+
+	strncpy(serverIP, server, sizeof(serverIP) - 1);
+	serverIP[sizeof(serverIP) - 1] = '\0';
+	devIndex = device;
+	shared = sharedMode;
+	ringHead = 0;
+	ringTail = 0;
+	running = true;
+	starting = true;
+	threadAlive = true;
+
+	if(pthread_create(&refill, NULL, _refill_thread, NULL) != 0) {
+		running = false;
+		starting = false;
+		threadAlive = false;
+		_free_ring();
+	}
+}
+
+/******************************************************************************
+** _pool_stop
+**
+** Stops the thread and wipes the buffer. A thread blocked in the library for
+** more than PROV_STOP_WAIT_MS is detached: it frees the buffer when the call
+** returns, and the module is kept loaded for it. poolMutex is held.
+******************************************************************************/
+static void _pool_stop(void) {
+
+	/* The buffer of a thread left to end by itself is freed by it. */
+	if(orphan) {
+		return;
+	}
+
+	if(running) {
+		struct timespec ts;
+
+		running = false;
+		pthread_cond_broadcast(&refillCond);
+
+		_deadline(&ts, PROV_STOP_WAIT_MS);
+		while(threadAlive && pthread_cond_timedwait(&filledCond, &poolMutex, &ts) == 0) {
+			/* Woken by a refill or by the end of the thread. */
+		}
+
+		if(threadAlive) {
+			Dl_info info;
+			if(dladdr((void*)_refill_thread, &info) != 0 && info.dli_fname != NULL) {
+				dlopen(info.dli_fname, RTLD_NOW | RTLD_NOLOAD | RTLD_NODELETE);
+			}
+			pthread_detach(refill);
+			orphan = true;
+			return;
+		}
+
+		pthread_mutex_unlock(&poolMutex);
+		pthread_join(refill, NULL);
+		pthread_mutex_lock(&poolMutex);
+	}
+
+	_free_ring();
+
+	pthread_cond_destroy(&refillCond);
+	pthread_cond_destroy(&filledCond);
+}
+
+static int _os_random(unsigned char* out, size_t n) {
+
+	while(n > 0) {
+		const ssize_t r = getrandom(out, n, 0);
+		if(r < 0 && errno == EINTR) {
+			continue;
+		}
+		if(r <= 0) {
+			return 0;
+		}
+		out += r;
+		n -= (size_t)r;
+	}
+	return 1;
+}
+
+/******************************************************************************
+** _fill
+**
+** Fills out with random numbers of the buffer, or of the OS if the buffer
+** does not have n bytes. If wait is true, it waits up to PROV_SEED_WAIT_MS
+** for the buffer while the QRNG is connected or connecting.
+**
+** @return [int] 1 if it success, otherwise 0.
+******************************************************************************/
+static int _fill(unsigned char* out, const size_t n, const bool wait) {
+
+	/* The mutex is not used in a child: it could be held by a thread of the
+	 * parent that does not exist in the child. */
+	if(n > 0 && getpid() == poolPid) {
+
+		pthread_mutex_lock(&poolMutex);
+
+		if(wait && ring != NULL && n <= ringSize) {
+			struct timespec ts;
+			_deadline(&ts, PROV_SEED_WAIT_MS);
+			while(running && (connected || starting) && ringTail - ringHead < n
+					&& pthread_cond_timedwait(&filledCond, &poolMutex, &ts) == 0) {
+				/* Woken by a refill. */
+			}
+		}
+
+		if(running && ring != NULL && ringTail - ringHead >= n) {
+			const size_t idx = ringHead % ringSize;
+			const size_t first = n < ringSize - idx ? n : ringSize - idx;
+
+			memcpy(out, ring + idx, first);
+			memset(ring + idx, 0, first);
+			if(first < n) {
+				memcpy(out + first, ring, n - first);
+				memset(ring, 0, n - first);
+			}
+			ringHead += n;
+
+			if(ringSize - (size_t)(ringTail - ringHead) >= PROV_REFILL_CHUNK) {
+				pthread_cond_signal(&refillCond);
+			}
+			pthread_mutex_unlock(&poolMutex);
+
+			atomic_fetch_add(&hits, 1);
+			atomic_fetch_add(&qrngBytes, n);
+			return 1;
+		}
+
+		pthread_mutex_unlock(&poolMutex);
+	}
+
+	atomic_fetch_add(&misses, 1);
+	atomic_fetch_add(&osBytes, n);
+	return _os_random(out, n);
+}
+
+/* Sets the counters requested in params. */
+static int _get_counters(OSSL_PARAM params[]) {
+
+	OSSL_PARAM* p;
+	uint64_t available = 0;
+	uint64_t locked = 0;
+	unsigned int isConnected = 0;
+
+	if(getpid() == poolPid) {
+		pthread_mutex_lock(&poolMutex);
+		available = ringTail - ringHead;
+		locked = lockedBytes;
+		isConnected = connected;
+		pthread_mutex_unlock(&poolMutex);
+	}
+
+	if((p = OSSL_PARAM_locate(params, QRNG_PROVIDER_PARAM_HITS)) != NULL
+			&& !OSSL_PARAM_set_uint64(p, atomic_load(&hits))) {
+		return 0;
+	}
+	if((p = OSSL_PARAM_locate(params, QRNG_PROVIDER_PARAM_MISSES)) != NULL
+			&& !OSSL_PARAM_set_uint64(p, atomic_load(&misses))) {
+		return 0;
+	}
+	if((p = OSSL_PARAM_locate(params, QRNG_PROVIDER_PARAM_QRNG_BYTES)) != NULL
+			&& !OSSL_PARAM_set_uint64(p, atomic_load(&qrngBytes))) {
+		return 0;
+	}
+	if((p = OSSL_PARAM_locate(params, QRNG_PROVIDER_PARAM_OS_BYTES)) != NULL
+			&& !OSSL_PARAM_set_uint64(p, atomic_load(&osBytes))) {
+		return 0;
+	}
+	if((p = OSSL_PARAM_locate(params, QRNG_PROVIDER_PARAM_ERRORS)) != NULL
+			&& !OSSL_PARAM_set_uint64(p, atomic_load(&errors))) {
+		return 0;
+	}
+	if((p = OSSL_PARAM_locate(params, QRNG_PROVIDER_PARAM_AVAILABLE)) != NULL
+			&& !OSSL_PARAM_set_uint64(p, available)) {
+		return 0;
+	}
+	if((p = OSSL_PARAM_locate(params, QRNG_PROVIDER_PARAM_CONNECTED)) != NULL
+			&& !OSSL_PARAM_set_uint(p, isConnected)) {
+		return 0;
+	}
+	if((p = OSSL_PARAM_locate(params, QRNG_PROVIDER_PARAM_LOCKED)) != NULL
+			&& !OSSL_PARAM_set_uint64(p, locked)) {
+		return 0;
+	}
+	return 1;
+}
+
+#define PROV_COUNTER_PARAMS \
+	OSSL_PARAM_uint64(QRNG_PROVIDER_PARAM_HITS, NULL), \
+	OSSL_PARAM_uint64(QRNG_PROVIDER_PARAM_MISSES, NULL), \
+	OSSL_PARAM_uint64(QRNG_PROVIDER_PARAM_QRNG_BYTES, NULL), \
+	OSSL_PARAM_uint64(QRNG_PROVIDER_PARAM_OS_BYTES, NULL), \
+	OSSL_PARAM_uint64(QRNG_PROVIDER_PARAM_ERRORS, NULL), \
+	OSSL_PARAM_uint64(QRNG_PROVIDER_PARAM_AVAILABLE, NULL), \
+	OSSL_PARAM_uint(QRNG_PROVIDER_PARAM_CONNECTED, NULL), \
+	OSSL_PARAM_uint64(QRNG_PROVIDER_PARAM_LOCKED, NULL)
+
+/******************************************************************************
+** RAND algorithm.
+******************************************************************************/
+
+static void* _rand_newctx(void* provctx, void* parent, const OSSL_DISPATCH* parentCalls) {
+
+	(void)provctx;
+	(void)parent;
+	(void)parentCalls;
+
+	/* The QRNG does not need a parent: the seed source is ignored. */
+	qrngRand* r = (qrngRand*)OPENSSL_zalloc(sizeof(qrngRand));
+	if(r != NULL) {
+		r->state = EVP_RAND_STATE_UNINITIALISED;
+	}
+	return r;
+}
+
+static void _rand_freectx(void* vctx) {
+	OPENSSL_free(vctx);
+}
+
+static int _rand_instantiate(void* vctx, unsigned int strength, int predictionResistance,
+		const unsigned char* pstr, size_t pstrLen, const OSSL_PARAM params[]) {
+
+	(void)predictionResistance;
+	(void)pstr;
+	(void)pstrLen;
+	(void)params;
+
+	if(strength > PROV_STRENGTH) {
+		return 0;
+	}
+	((qrngRand*)vctx)->state = EVP_RAND_STATE_READY;
+	return 1;
+}
+
+static int _rand_uninstantiate(void* vctx) {
+
+	((qrngRand*)vctx)->state = EVP_RAND_STATE_UNINITIALISED;
+	return 1;
+}
+
+static int _rand_generate(void* vctx, unsigned char* out, size_t outLen, unsigned int strength,
+		int predictionResistance, const unsigned char* adin, size_t adinLen) {
+
+	(void)vctx;
+	(void)predictionResistance;
+	(void)adin;
+	(void)adinLen;
+
+	if(strength > PROV_STRENGTH) {
+		return 0;
+	}
+	return _fill(out, outLen, false);
+}
+
+static int _rand_reseed(void* vctx, int predictionResistance, const unsigned char* ent,
+		size_t entLen, const unsigned char* adin, size_t adinLen) {
+
+	(void)vctx;
+	(void)predictionResistance;
+	(void)ent;
+	(void)entLen;
+	(void)adin;
+	(void)adinLen;
+
+	/* Each request takes new random numbers of the QRNG. */
+	return 1;
+}
+
+static size_t _rand_get_seed(void* vctx, unsigned char** pout, int entropy, size_t minLen,
+		size_t maxLen, int predictionResistance, const unsigned char* adin, size_t adinLen) {
+
+	(void)vctx;
+	(void)predictionResistance;
+	(void)adin;
+	(void)adinLen;
+
+	/* The random numbers of the QRNG are extracted: one bit of entropy per bit. */
+	size_t len = entropy > 0 ? ((size_t)entropy + 7) / 8 : 0;
+	if(len < minLen) {
+		len = minLen;
+	}
+	if(len > maxLen) {
+		return 0;
+	}
+
+	unsigned char* seed = (unsigned char*)OPENSSL_secure_malloc(len);
+	if(seed == NULL) {
+		return 0;
+	}
+	if(!_fill(seed, len, true)) {
+		OPENSSL_secure_clear_free(seed, len);
+		return 0;
+	}
+
+	*pout = seed;
+	return len;
+}
+
+static void _rand_clear_seed(void* vctx, unsigned char* out, size_t outLen) {
+
+	(void)vctx;
+	OPENSSL_secure_clear_free(out, outLen);
+}
+
+static int _rand_enable_locking(void* vctx) {
+
+	(void)vctx;
+	/* The buffer has its own lock. */
+	return 1;
+}
+
+static int _rand_lock(void* vctx) {
+
+	(void)vctx;
+	return 1;
+}
+
+static void _rand_unlock(void* vctx) {
+	(void)vctx;
+}
+
+static const OSSL_PARAM* _rand_gettable_ctx_params(void* vctx, void* provctx) {
+
+	static const OSSL_PARAM gettable[] = {
+		OSSL_PARAM_int(OSSL_RAND_PARAM_STATE, NULL),
+		OSSL_PARAM_uint(OSSL_RAND_PARAM_STRENGTH, NULL),
+		OSSL_PARAM_size_t(OSSL_RAND_PARAM_MAX_REQUEST, NULL),
+		PROV_COUNTER_PARAMS,
+		OSSL_PARAM_END
+	};
+
+	(void)vctx;
+	(void)provctx;
+
+	return gettable;
+}
+
+static int _rand_get_ctx_params(void* vctx, OSSL_PARAM params[]) {
+
+	OSSL_PARAM* p;
+
+	if((p = OSSL_PARAM_locate(params, OSSL_RAND_PARAM_STATE)) != NULL
+			&& !OSSL_PARAM_set_int(p, ((qrngRand*)vctx)->state)) {
+		return 0;
+	}
+	if((p = OSSL_PARAM_locate(params, OSSL_RAND_PARAM_STRENGTH)) != NULL
+			&& !OSSL_PARAM_set_uint(p, PROV_STRENGTH)) {
+		return 0;
+	}
+	if((p = OSSL_PARAM_locate(params, OSSL_RAND_PARAM_MAX_REQUEST)) != NULL
+			&& !OSSL_PARAM_set_size_t(p, PROV_MAX_REQUEST)) {
+		return 0;
+	}
+	return _get_counters(params);
+}
+
+static const OSSL_DISPATCH randFunctions[] = {
+	{ OSSL_FUNC_RAND_NEWCTX, (void (*)(void))_rand_newctx },
+	{ OSSL_FUNC_RAND_FREECTX, (void (*)(void))_rand_freectx },
+	{ OSSL_FUNC_RAND_INSTANTIATE, (void (*)(void))_rand_instantiate },
+	{ OSSL_FUNC_RAND_UNINSTANTIATE, (void (*)(void))_rand_uninstantiate },
+	{ OSSL_FUNC_RAND_GENERATE, (void (*)(void))_rand_generate },
+	{ OSSL_FUNC_RAND_RESEED, (void (*)(void))_rand_reseed },
+	{ OSSL_FUNC_RAND_GET_SEED, (void (*)(void))_rand_get_seed },
+	{ OSSL_FUNC_RAND_CLEAR_SEED, (void (*)(void))_rand_clear_seed },
+	{ OSSL_FUNC_RAND_ENABLE_LOCKING, (void (*)(void))_rand_enable_locking },
+	{ OSSL_FUNC_RAND_LOCK, (void (*)(void))_rand_lock },
+	{ OSSL_FUNC_RAND_UNLOCK, (void (*)(void))_rand_unlock },
+	{ OSSL_FUNC_RAND_GETTABLE_CTX_PARAMS, (void (*)(void))_rand_gettable_ctx_params },
+	{ OSSL_FUNC_RAND_GET_CTX_PARAMS, (void (*)(void))_rand_get_ctx_params },
+	{ 0, NULL }
+};
+
+static const OSSL_ALGORITHM rands[] = {
+	{ QRNG_PROVIDER_RAND, QRNG_PROVIDER_PROPERTIES, randFunctions, "Random numbers of a Quside QRNG" },
+	{ NULL, NULL, NULL, NULL }
+};
+
+/******************************************************************************
+** Provider.
+******************************************************************************/
+
+static const OSSL_PARAM* _gettable_params(void* provctx) {
+
+	static const OSSL_PARAM gettable[] = {
+		OSSL_PARAM_utf8_ptr(OSSL_PROV_PARAM_NAME, NULL, 0),
+		OSSL_PARAM_utf8_ptr(OSSL_PROV_PARAM_VERSION, NULL, 0),
+		OSSL_PARAM_utf8_ptr(OSSL_PROV_PARAM_BUILDINFO, NULL, 0),
+		OSSL_PARAM_uint(OSSL_PROV_PARAM_STATUS, NULL),
+		PROV_COUNTER_PARAMS,
+		OSSL_PARAM_END
+	};
+
+	(void)provctx;
+
+	return gettable;
+}
+
+static int _get_params(void* provctx, OSSL_PARAM params[]) {
+
+	OSSL_PARAM* p;
+
+	(void)provctx;
+
+	if((p = OSSL_PARAM_locate(params, OSSL_PROV_PARAM_NAME)) != NULL
+			&& !OSSL_PARAM_set_utf8_ptr(p, PROV_NAME)) {
+		return 0;
+	}
+	if((p = OSSL_PARAM_locate(params, OSSL_PROV_PARAM_VERSION)) != NULL
+			&& !OSSL_PARAM_set_utf8_ptr(p, PROV_VERSION)) {
+		return 0;
+	}
+	if((p = OSSL_PARAM_locate(params, OSSL_PROV_PARAM_BUILDINFO)) != NULL
+			&& !OSSL_PARAM_set_utf8_ptr(p, PROV_VERSION)) {
+		return 0;
+	}
+	if((p = OSSL_PARAM_locate(params, OSSL_PROV_PARAM_STATUS)) != NULL
+			&& !OSSL_PARAM_set_uint(p, 1)) {
+		return 0;
+	}
+	return _get_counters(params);
+}
+
+static const OSSL_ALGORITHM* _query_operation(void* provctx, int operation, int* noCache) {
+
+	(void)provctx;
+
+	*noCache = 0;
+	return operation == OSSL_OP_RAND ? rands : NULL;
+}
+
+static void _teardown(void* provctx) {
+
+	(void)provctx;
+
+	/* The provider can be loaded in several library contexts. */
+	if(getpid() != poolPid) {
+		return;
+	}
+	pthread_mutex_lock(&poolMutex);
+	if(--instances == 0) {
+		_pool_stop();
+	}
+	pthread_mutex_unlock(&poolMutex);
+}
+
+static const OSSL_DISPATCH providerFunctions[] = {
+	{ OSSL_FUNC_PROVIDER_TEARDOWN, (void (*)(void))_teardown },
+	{ OSSL_FUNC_PROVIDER_GETTABLE_PARAMS, (void (*)(void))_gettable_params },
+	{ OSSL_FUNC_PROVIDER_GET_PARAMS, (void (*)(void))_get_params },
+	{ OSSL_FUNC_PROVIDER_QUERY_OPERATION, (void (*)(void))_query_operation },
+	{ 0, NULL }
+};
+
+int OSSL_provider_init(const OSSL_CORE_HANDLE* handle, const OSSL_DISPATCH* in,
+		const OSSL_DISPATCH** out, void** provctx) {
+
+	OSSL_FUNC_core_get_params_fn* coreGetParams = NULL;
+	char* server = NULL;
+	char* device = NULL;
+	char* buffer = NULL;
+	char* unlocked = NULL;
+	char* sharedParam = NULL;
+
+	for(; in->function_id != 0; ++in) {
+		if(in->function_id == OSSL_FUNC_CORE_GET_PARAMS) {
+			coreGetParams = OSSL_FUNC_core_get_params(in);
+		}
+	}
+
+	/* Values of the configuration section of the provider. */
+	OSSL_PARAM params[] = {
+		OSSL_PARAM_utf8_ptr(QRNG_PROVIDER_PARAM_SERVER, &server, 0),
+		OSSL_PARAM_utf8_ptr(QRNG_PROVIDER_PARAM_DEVICE, &device, 0),
+		OSSL_PARAM_utf8_ptr(QRNG_PROVIDER_PARAM_BUFFER, &buffer, 0),
+		OSSL_PARAM_utf8_ptr(QRNG_PROVIDER_PARAM_UNLOCKED, &unlocked, 0),
+		OSSL_PARAM_utf8_ptr(QRNG_PROVIDER_PARAM_SHARED, &sharedParam, 0),
+		OSSL_PARAM_END
+	};
+	if(coreGetParams != NULL && !coreGetParams(handle, params)) {
+		return 0;
+	}
+	if(server == NULL) {
+		server = getenv(QRNG_PROVIDER_ENV_SERVER);
+	}
+
+	pthread_mutex_lock(&poolMutex);
+	if(instances++ == 0) {
+		_pool_start(server, device != NULL ? (uint16_t)atoi(device) : 0,
+				buffer != NULL && atoi(buffer) > 0 ? (size_t)atoi(buffer) : PROV_DEFAULT_BUFFER_KB,
+				unlocked != NULL && atoi(unlocked) != 0, sharedParam != NULL && atoi(sharedParam) != 0);
+	}
+	pthread_mutex_unlock(&poolMutex);
+
+	*out = providerFunctions;
+	*provctx = (void*)handle;
+
+	return 1;
+}
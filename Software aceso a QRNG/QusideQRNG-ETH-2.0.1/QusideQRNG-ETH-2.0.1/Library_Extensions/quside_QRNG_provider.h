@@ -0,0 +1,67 @@
+/*
+ ============================================================================
+ Name        : quside_QRNG_provider.h
+ Author      : Alvaro Velasco Garcia, Heriberto J. Diaz
+ Created on  : 18 oct. 2022
+ Version     : 0.1
+ Copyright   : Copyright (C) 2022 QUSIDE TECHNOLOGIES - All Rights Reserved.
+               Unauthorized copying of this file, via any medium is
+               strictly prohibited.
+ Description : Names used by the OpenSSL 3 provider libqusideQRNGprovider.so.
+               The provider offers the RAND algorithm QRNG_PROVIDER_RAND,
+               served from a locked buffer of random numbers that a thread
+               refills from the QRNG. When the buffer can not serve a
+               request, the request is served by the seed source of the OS.
+
+               The library keeps one connection per process. The provider
+               does not start if the application already has it open. With
+               shared = 1 the application owns the connection and the
+               provider captures with combiner_get_random, so the
+               application has to be linked with the extensions library and
+               call connectToServer and combiner_init.
+
+               Configuration (openssl.cnf):
+
+                   [provider_sect]
+                   default = default_sect
+                   quside = quside_sect
+
+                   [quside_sect]
+                   module = /usr/lib/libqusideQRNGprovider.so
+                   server = 192.168.1.100
+                   activate = 1
+
+                   [random_sect]
+                   seed = QUSIDE-QRNG
+                   seed_properties = provider=quside
+ ============================================================================
+ */
+
+#ifndef QUSIDE_QRNG_PROVIDER_H
+#define QUSIDE_QRNG_PROVIDER_H
+
+/* Name of the RAND algorithm and property of the provider. */
+#define QRNG_PROVIDER_RAND				"QUSIDE-QRNG"
+#define QRNG_PROVIDER_PROPERTIES		"provider=quside"
+
+/* Parameters of the configuration section of the provider. */
+#define QRNG_PROVIDER_PARAM_SERVER		"server"		/* IP of the QRNG. */
+#define QRNG_PROVIDER_PARAM_DEVICE		"device"		/* Index of the device (default 0). */
+#define QRNG_PROVIDER_PARAM_BUFFER		"buffer_kb"		/* Size of the buffer (default 1024). */
+#define QRNG_PROVIDER_PARAM_UNLOCKED	"allow_unlocked"	/* 1 uses the buffer if it can not be locked. */
+#define QRNG_PROVIDER_PARAM_SHARED		"shared"		/* 1 captures with the combiner of the application. */
+
+/* Environment variable read when the configuration has no server. */
+#define QRNG_PROVIDER_ENV_SERVER		"QUSIDE_QRNG_SERVER"
+
+/* Counters, read with OSSL_PROVIDER_get_params or EVP_RAND_CTX_get_params. */
+#define QRNG_PROVIDER_PARAM_HITS		"qrng_hits"			/* uint64: requests served by the QRNG. */
+#define QRNG_PROVIDER_PARAM_MISSES		"qrng_misses"		/* uint64: requests served by the OS. */
+#define QRNG_PROVIDER_PARAM_QRNG_BYTES	"qrng_bytes"		/* uint64: bytes served by the QRNG. */
+#define QRNG_PROVIDER_PARAM_OS_BYTES	"qrng_os_bytes"		/* uint64: bytes served by the OS. */
+#define QRNG_PROVIDER_PARAM_ERRORS		"qrng_errors"		/* uint64: failed connections and captures. */
+#define QRNG_PROVIDER_PARAM_AVAILABLE	"qrng_available"	/* uint64: bytes in the buffer. */
+#define QRNG_PROVIDER_PARAM_CONNECTED	"qrng_connected"	/* uint: 1 if the QRNG is connected. */
+#define QRNG_PROVIDER_PARAM_LOCKED		"qrng_locked"		/* uint64: bytes of the buffer locked in memory. */
+
+#endif /* QUSIDE_QRNG_PROVIDER_H */
@@ -0,0 +1,265 @@
+/*
+ ============================================================================
+ Name        : quside_QRNG_sha256.c
+ Author      : Alvaro Velasco Garcia, Heriberto J. Diaz
+ Created on  : 18 oct. 2022
+ Version     : 0.1
+ Copyright   : Copyright (C) 2022 QUSIDE TECHNOLOGIES - All Rights Reserved.
+               Unauthorized copying of this file, via any medium is
+               strictly prohibited.
+ Description : SHA-256. On x86 CPUs with the SHA extensions the blocks are
+               compressed with the SHA-NI instructions, otherwise with the
+               portable implementation. The choice is done once, with CPUID.
+ ============================================================================
+ */
+
+#include "quside_QRNG_sha256.h"
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#include <immintrin.h>
+#define SHA256_X86
+#endif
+
+typedef void (*sha256Compress)(uint32_t* state, const uint8_t* data, size_t blocks);
+
+static const uint32_t K[64] = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+static const uint32_t H0[8] = {
+	0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+};
+
+#define ROTR(x, n)		(((x) >> (n)) | ((x) << (32 - (n))))
+
+static void _compress_portable(uint32_t* state, const uint8_t* data, size_t blocks) {
+
+	uint32_t w[64];
+
+	while(blocks-- > 0) {
+
+		for(int i = 0; i < 16; ++i) {
+			w[i] = (uint32_t)data[4 * i] << 24 | (uint32_t)data[4 * i + 1] << 16
+					| (uint32_t)data[4 * i + 2] << 8 | (uint32_t)data[4 * i + 3];
+		}
+		for(int i = 16; i < 64; ++i) {
+			const uint32_t s0 = ROTR(w[i - 15], 7) ^ ROTR(w[i - 15], 18) ^ (w[i - 15] >> 3);
+			const uint32_t s1 = ROTR(w[i - 2], 17) ^ ROTR(w[i - 2], 19) ^ (w[i - 2] >> 10);
+			w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+		}
+
+		uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+		uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+
+		for(int i = 0; i < 64; ++i) {
+			const uint32_t t1 = h + (ROTR(e, 6) ^ ROTR(e, 11) ^ ROTR(e, 25)) + ((e & f) ^ (~e & g)) + K[i] + w[i];
+			const uint32_t t2 = (ROTR(a, 2) ^ ROTR(a, 13) ^ ROTR(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+			h = g;
+			g = f;
+			f = e;
+			e = d + t1;
+			d = c;
+			c = b;
+			b = a;
+			a = t1 + t2;
+		}
+
+		state[0] += a;
+		state[1] += b;
+		state[2] += c;
+		state[3] += d;
+		state[4] += e;
+		state[5] += f;
+		state[6] += g;
+		state[7] += h;
+
+		data += SHA256_BLOCK_SIZE;
+	}
+
+	memset(w, 0, sizeof(w));
+}
+
+#ifdef SHA256_X86
+
+/******************************************************************************
+** _compress_shani
+**
+** Compresses the blocks with the SHA-NI instructions. The state is kept as
+** ABEF and CDGH, as sha256rnds2 expects, and each group of 4 words of the
+** message schedule is computed with sha256msg1 and sha256msg2.
+******************************************************************************/
+__attribute__((target("sha,sse4.1,ssse3")))
+static void _compress_shani(uint32_t* state, const uint8_t* data, size_t blocks) {
+
+	const __m128i mask = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+	__m128i tmp = _mm_loadu_si128((const __m128i*)&state[0]);
+	__m128i state1 = _mm_loadu_si128((const __m128i*)&state[4]);
+
+	tmp = _mm_shuffle_epi32(tmp, 0xB1);
+	state1 = _mm_shuffle_epi32(state1, 0x1B);
+	__m128i state0 = _mm_alignr_epi8(tmp, state1, 8);
+	state1 = _mm_blend_epi16(state1, tmp, 0xF0);
+
+	while(blocks-- > 0) {
+
+		const __m128i abefSave = state0;
+		const __m128i cdghSave = state1;
+		__m128i w[4];
+
+#pragma GCC unroll 16
+		for(int i = 0; i < 16; ++i) {
+			__m128i msg;
+
+			if(i < 4) {
+				w[i] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + 16 * i)), mask);
+			} else {
+				msg = _mm_sha256msg1_epu32(w[i & 3], w[(i + 1) & 3]);
+				msg = _mm_add_epi32(msg, _mm_alignr_epi8(w[(i + 3) & 3], w[(i + 2) & 3], 4));
+				w[i & 3] = _mm_sha256msg2_epu32(msg, w[(i + 3) & 3]);
+			}
+
+			msg = _mm_add_epi32(w[i & 3], _mm_loadu_si128((const __m128i*)&K[4 * i]));
+			state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+			msg = _mm_shuffle_epi32(msg, 0x0E);
+			state0 = _mm_sha256rnds2_epu32(state0, state1, msg);
+		}
+
+		state0 = _mm_add_epi32(state0, abefSave);
+		state1 = _mm_add_epi32(state1, cdghSave);
+
+		data += SHA256_BLOCK_SIZE;
+	}
+
+	tmp = _mm_shuffle_epi32(state0, 0x1B);
+	state1 = _mm_shuffle_epi32(state1, 0xB1);
+	state0 = _mm_blend_epi16(tmp, state1, 0xF0);
+	state1 = _mm_alignr_epi8(state1, tmp, 8);
+
+	_mm_storeu_si128((__m128i*)&state[0], state0);
+	_mm_storeu_si128((__m128i*)&state[4], state1);
+}
+
+static bool _has_shani(void) {
+
+	unsigned int eax, ebx, ecx, edx;
+
+	if(!__get_cpuid(1, &eax, &ebx, &ecx, &edx) || !(ecx & bit_SSE4_1) || !(ecx & bit_SSSE3)) {
+		return false;
+	}
+	if(!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) {
+		return false;
+	}
+	return (ebx & (1u << 29)) != 0;
+}
+
+#endif
+
+static sha256Compress _compress(void) {
+
+	static sha256Compress compress = NULL;
+
+	/* The same value can be stored by several threads. */
+	sha256Compress c = __atomic_load_n(&compress, __ATOMIC_RELAXED);
+	if(c == NULL) {
+		c = _compress_portable;
+#ifdef SHA256_X86
+		if(_has_shani()) {
+			c = _compress_shani;
+		}
+#endif
+		__atomic_store_n(&compress, c, __ATOMIC_RELAXED);
+	}
+	return c;
+}
+
+void sha256_init(sha256Ctx* ctx) {
+
+	memcpy(ctx->state, H0, sizeof(H0));
+	ctx->bytes = 0;
+	ctx->buffered = 0;
+}
+
+void sha256_update(sha256Ctx* ctx, const void* data, size_t len) {
+
+	const uint8_t* p = (const uint8_t*)data;
+	const sha256Compress compress = _compress();
+
+	ctx->bytes += len;
+
+	if(ctx->buffered > 0) {
+		const size_t take = len < SHA256_BLOCK_SIZE - ctx->buffered ? len : SHA256_BLOCK_SIZE - ctx->buffered;
+
+		memcpy(ctx->buffer + ctx->buffered, p, take);
+		ctx->buffered += take;
+		p += take;
+		len -= take;
+
+		if(ctx->buffered < SHA256_BLOCK_SIZE) {
+			return;
+		}
+		compress(ctx->state, ctx->buffer, 1);
+		ctx->buffered = 0;
+	}
+
+	if(len >= SHA256_BLOCK_SIZE) {
+		compress(ctx->state, p, len / SHA256_BLOCK_SIZE);
+		p += len / SHA256_BLOCK_SIZE * SHA256_BLOCK_SIZE;
+		len %= SHA256_BLOCK_SIZE;
+	}
+
+	memcpy(ctx->buffer, p, len);
+	ctx->buffered = len;
+}
+
+void sha256_final(sha256Ctx* ctx, uint8_t* digest) {
+
+	const uint64_t bits = ctx->bytes * 8;
+	const sha256Compress compress = _compress();
+
+	ctx->buffer[ctx->buffered++] = 0x80;
+	if(ctx->buffered > SHA256_BLOCK_SIZE - 8) {
+		memset(ctx->buffer + ctx->buffered, 0, SHA256_BLOCK_SIZE - ctx->buffered);
+		compress(ctx->state, ctx->buffer, 1);
+		ctx->buffered = 0;
+	}
+	memset(ctx->buffer + ctx->buffered, 0, SHA256_BLOCK_SIZE - 8 - ctx->buffered);
+	for(int i = 0; i < 8; ++i) {
+		ctx->buffer[SHA256_BLOCK_SIZE - 1 - i] = (uint8_t)(bits >> (8 * i));
+	}
+	compress(ctx->state, ctx->buffer, 1);
+
+	for(int i = 0; i < 8; ++i) {
+		digest[4 * i] = (uint8_t)(ctx->state[i] >> 24);
+		digest[4 * i + 1] = (uint8_t)(ctx->state[i] >> 16);
+		digest[4 * i + 2] = (uint8_t)(ctx->state[i] >> 8);
+		digest[4 * i + 3] = (uint8_t)ctx->state[i];
+	}
+
+	memset(ctx, 0, sizeof(*ctx));
+}
+
+void sha256(const void* data, const size_t len, uint8_t* digest) {
+
+	sha256Ctx ctx;
+
+	sha256_init(&ctx);
+	sha256_update(&ctx, data, len);
+	sha256_final(&ctx, digest);
+}
+
+bool sha256_accelerated(void) {
+#ifdef SHA256_X86
+	return _compress() == _compress_shani;
+#else
+	return false;
+#endif
+}
@@ -0,0 +1,98 @@
+/*
+ ============================================================================
+ Name        : quside_QRNG_sha256.h
+ Author      : Alvaro Velasco Garcia, Heriberto J. Diaz
+ Created on  : 18 oct. 2022
+ Version     : 0.1
+ Copyright   : Copyright (C) 2022 QUSIDE TECHNOLOGIES - All Rights Reserved.
+               Unauthorized copying of this file, via any medium is
+               strictly prohibited.
+ Description : SHA-256 (FIPS 180-4). The SHA extensions of the CPU are used
+               when they are available.
+ ============================================================================
+ */
+
+#ifndef QUSIDE_QRNG_SHA256_H
+#define QUSIDE_QRNG_SHA256_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#define SHA256_DIGEST_SIZE		32
+#define SHA256_BLOCK_SIZE		64
+
+typedef struct {
+	uint32_t state[8];
+	uint64_t bytes;
+	uint8_t buffer[SHA256_BLOCK_SIZE];
+	size_t buffered;
+} sha256Ctx;
+
+/******************************************************************************
+** sha256_init
+**
+** Starts a hash.
+**
+** @param ctx [sha256Ctx*] Context of the hash.
+**
+** @return void.
+******************************************************************************/
+void sha256_init(sha256Ctx* ctx);
+
+/******************************************************************************
+** sha256_update
+**
+** Adds data to a hash.
+**
+** @param ctx [sha256Ctx*] Context of the hash.
+** @param data [const void*] Data.
+** @param len [size_t] Size of the data in bytes.
+**
+** @return void.
+******************************************************************************/
+void sha256_update(sha256Ctx* ctx, const void* data, size_t len);
+
+/******************************************************************************
+** sha256_final
+**
+** Finishes a hash. The context is wiped.
+**
+** @param ctx [sha256Ctx*] Context of the hash.
+** @param digest [uint8_t*] SHA256_DIGEST_SIZE bytes of the result.
+**
+** @return void.
+******************************************************************************/
+void sha256_final(sha256Ctx* ctx, uint8_t* digest);
+
+/******************************************************************************
+** sha256
+**
+** Hashes a buffer.
+**
+** @param data [const void*] Data.
+** @param len [const size_t] Size of the data in bytes.
+** @param digest [uint8_t*] SHA256_DIGEST_SIZE bytes of the result.
+**
+** @return void.
+******************************************************************************/
+void sha256(const void* data, const size_t len, uint8_t* digest);
+
+/******************************************************************************
+** sha256_accelerated
+**
+** Returns if the SHA extensions of the CPU are used.
+**
+** @return [bool] true if they are used.
+******************************************************************************/
+bool sha256_accelerated(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* QUSIDE_QRNG_SHA256_H */
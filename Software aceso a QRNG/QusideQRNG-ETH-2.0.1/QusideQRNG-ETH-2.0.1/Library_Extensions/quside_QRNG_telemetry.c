@@ -0,0 +1,642 @@
+/*
+ ============================================================================
+ Name        : quside_QRNG_telemetry.c
+ Author      : Alvaro Velasco Garcia, Heriberto J. Diaz
+ Created on  : 18 oct. 2022
+ Version     : 0.1
+ Copyright   : Copyright (C) 2022 QUSIDE TECHNOLOGIES - All Rights Reserved.
+               Unauthorized copying of this file, via any medium is
+               strictly prohibited.
+ Description : Telemetry history of the monitors.
+
+               Each value of a monitor has a fixed size ring of blocks for
+               each resolution. A block keeps up to TELEMETRY_BLOCK_POINTS
+               points as the first value and 16 bit codes for the rest, in
+               units of 1 / TELEMETRY_SCALE. A code is the delta of the next
+               point, one period later. A gap in the samples or a delta that
+               does not fit is written as an escape code followed by the
+               periods skipped and the whole point, so it stays in the same
+               block. A block is closed when it has no room, and the new
+               blocks overwrite the oldest ones.
+
+               The minute and hour resolutions are the means of the samples
+               of each minute and hour.
+ ============================================================================
+ */
+
+#include "quside_QRNG_telemetry.h"
+#include "quside_QRNG_combiner.h"
+#include <quside_QRNG_admin.h>
+#include <math.h>
+
+#define TELEMETRY_BLOCK_POINTS		64
+#define TELEMETRY_BLOCK_CODES		(TELEMETRY_BLOCK_POINTS - 1)
+
+/* Escape: periods skipped before the point and the point, high and low
+ * halves. The delta -32768 is also written as an escape. */
+#define TELEMETRY_ESCAPE			0x8000u
+#define TELEMETRY_ESCAPE_CODES		4
+
+typedef struct {
+	int64_t t0;					/* Time of the first point. */
+	int32_t base;				/* First point. */
+	uint16_t n;					/* Points in the block. */
+	uint16_t codes;				/* Codes used. */
+	uint16_t code[TELEMETRY_BLOCK_CODES];
+} telemetryBlock;
+
+typedef struct {
+	telemetryBlock* blocks;
+	int capacity;
+	int count;					/* Blocks used. */
+	int head;					/* Newest block. */
+	int32_t last;				/* Last point of the newest block. */
+	int64_t lastTime;			/* Time of the last point. */
+	double accSum;				/* Samples of the current period. */
+	int accCount;
+	int64_t accPeriod;
+} telemetryRing;
+
+typedef struct {
+	telemetryRing tiers[TELEMETRY_TIERS];
+} telemetrySeries;
+
+/* Blocks of each resolution. */
+static const int tierBlocks[TELEMETRY_TIERS] = { 64, 32, 16 };
+static int tierPeriod[TELEMETRY_TIERS] = { 1, 60, 3600 };
+
+static telemetrySeries* series[TELEMETRY_MAX_DEVICES][TELEMETRY_METRICS][TELEMETRY_MAX_CHANNELS];
+static int numChannels[TELEMETRY_MAX_DEVICES][TELEMETRY_METRICS];
+static uint16_t devices[TELEMETRY_MAX_DEVICES];
+static int numDevices = 0;
+static double limitLow[TELEMETRY_METRICS] = { NAN, NAN, NAN, NAN, NAN, NAN };
+static double limitHigh[TELEMETRY_METRICS] = { NAN, NAN, NAN, NAN, NAN, NAN };
+
+static pthread_t sampler;
+static bool running = false;
+static pthread_mutex_t telemetryMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t stopCond;
+
+static int _device_slot(const uint16_t devInd) {
+
+	for(int i = 0; i < numDevices; ++i) {
+		if(devices[i] == devInd) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+static telemetrySeries* _series_new(void) {
+
+	telemetrySeries* s = (telemetrySeries*)calloc(1, sizeof(telemetrySeries));
+	if(s == NULL) {
+		return NULL;
+	}
+
+	for(int k = 0; k < TELEMETRY_TIERS; ++k) {
+		s->tiers[k].capacity = tierBlocks[k];
+		s->tiers[k].blocks = (telemetryBlock*)calloc((size_t)tierBlocks[k], sizeof(telemetryBlock));
+		if(s->tiers[k].blocks == NULL) {
+			for(int j = 0; j <= k; ++j) {
+				free(s->tiers[j].blocks);
+			}
+			free(s);
+			return NULL;
+		}
+	}
+
+	return s;
+}
+
+static void _series_free(telemetrySeries* s) {
+
+	if(s != NULL) {
+		for(int k = 0; k < TELEMETRY_TIERS; ++k) {
+			free(s->tiers[k].blocks);
+		}
+		free(s);
+	}
+}
+
+static int32_t _quantize(const double value) {
+
+	const double q = round(value * TELEMETRY_SCALE);
+
+	if(q > (double)INT32_MAX) {
+		return INT32_MAX;
+	}
+	if(q < (double)INT32_MIN) {
+		return INT32_MIN;
+	}
+	return (int32_t)q;
+}
+
+/******************************************************************************
+** _ring_append
+**
+** Adds a point at time t to the newest block, as a delta if it is the next
+** point and the delta fits, otherwise as an escape. It starts a new block if
+** the newest one has no room, the time goes back or is not a whole number of
+** periods later, or more than 65535 periods are skipped.
+******************************************************************************/
+static void _ring_append(telemetryRing* r, const int64_t t, const int32_t q, const int period) {
+
+	if(r->count > 0) {
+		telemetryBlock* b = &r->blocks[r->head];
+		const int64_t delta = (int64_t)q - (int64_t)r->last;
+		const int64_t skipped = (t - r->lastTime) / period - 1;
+
+		if(b->n < TELEMETRY_BLOCK_POINTS && t > r->lastTime && (t - r->lastTime) % period == 0) {
+
+			if(skipped == 0 && delta > INT16_MIN && delta <= INT16_MAX && b->codes < TELEMETRY_BLOCK_CODES) {
+				b->code[b->codes++] = (uint16_t)(int16_t)delta;
+				++b->n;
+				r->last = q;
+				r->lastTime = t;
+				return;
+			}
+
+			if(skipped <= UINT16_MAX && b->codes + TELEMETRY_ESCAPE_CODES <= TELEMETRY_BLOCK_CODES) {
+				b->code[b->codes++] = TELEMETRY_ESCAPE;
+				b->code[b->codes++] = (uint16_t)skipped;
+				b->code[b->codes++] = (uint16_t)((uint32_t)q >> 16);
+				b->code[b->codes++] = (uint16_t)(uint32_t)q;
+				++b->n;
+				r->last = q;
+				r->lastTime = t;
+				return;
+			}
+		}
+	}
+
+	r->head = (r->head + 1) % r->capacity;
+	if(r->count < r->capacity) {
+		++r->count;
+	}
+
+	telemetryBlock* b = &r->blocks[r->head];
+	b->t0 = t;
+	b->base = q;
+	b->n = 1;
+	b->codes = 0;
+	r->last = q;
+	r->lastTime = t;
+}
+
+/* Adds a sample to the series and to the means of the coarser resolutions. */
+static void _series_add(telemetrySeries* s, const int64_t t, const double value) {
+
+	_ring_append(&s->tiers[TELEMETRY_SECOND], t, _quantize(value), tierPeriod[TELEMETRY_SECOND]);
+
+	for(int k = TELEMETRY_MINUTE; k < TELEMETRY_TIERS; ++k) {
+		telemetryRing* r = &s->tiers[k];
+		const int64_t p = t / tierPeriod[k];
+
+		if(r->accCount > 0 && p != r->accPeriod) {
+			_ring_append(r, r->accPeriod * tierPeriod[k], _quantize(r->accSum / r->accCount), tierPeriod[k]);
+			r->accSum = 0.0;
+			r->accCount = 0;
+		}
+
+		r->accPeriod = p;
+		r->accSum += value;
+		++r->accCount;
+	}
+}
+
+static int _ring_points(const telemetryRing* r) {
+
+	int n = 0;
+	for(int i = 0; i < r->count; ++i) {
+		n += r->blocks[(r->head - i + r->capacity) % r->capacity].n;
+	}
+	return n;
+}
+
+/* Decodes the last maxPoints points of a ring, oldest first. */
+static int _ring_read(const telemetryRing* r, const int period, double* values, time_t* times,
+		const int maxPoints) {
+
+	int skip = _ring_points(r) - maxPoints;
+	int out = 0;
+
+	for(int i = r->count - 1; i >= 0; --i) {
+		const telemetryBlock* b = &r->blocks[(r->head - i + r->capacity) % r->capacity];
+		int32_t q = b->base;
+		int64_t t = b->t0;
+		int c = 0;
+
+		for(int k = 0; k < b->n; ++k) {
+			if(k > 0 && b->code[c] == TELEMETRY_ESCAPE) {
+				t += ((int64_t)b->code[c + 1] + 1) * period;
+				q = (int32_t)(((uint32_t)b->code[c + 2] << 16) | b->code[c + 3]);
+				c += TELEMETRY_ESCAPE_CODES;
+			} else if(k > 0) {
+				t += period;
+				q += (int16_t)b->code[c];
+				++c;
+			}
+			if(skip > 0) {
+				--skip;
+				continue;
+			}
+			values[out] = (double)q / TELEMETRY_SCALE;
+			if(times != NULL) {
+				times[out] = (time_t)t;
+			}
+			++out;
+		}
+	}
+
+	return out;
+}
+
+static void _record(const int slot, const telemetryMetric metric, const int64_t t,
+		const float* values, const int n) {
+
+	const int channels = n < TELEMETRY_MAX_CHANNELS ? n : TELEMETRY_MAX_CHANNELS;
+
+	pthread_mutex_lock(&telemetryMutex);
+
+	for(int c = 0; c < channels; ++c) {
+		if(series[slot][metric][c] == NULL) {
+			series[slot][metric][c] = _series_new();
+		}
+		if(series[slot][metric][c] != NULL && isfinite(values[c])) {
+			_series_add(series[slot][metric][c], t, values[c]);
+		}
+	}
+	if(channels > numChannels[slot][metric]) {
+		numChannels[slot][metric] = channels;
+	}
+
+	pthread_mutex_unlock(&telemetryMutex);
+}
+
+/******************************************************************************
+** _sample
+**
+** Reads all the monitors of a device. The library returns the arrays in
+** memory that the caller has to free.
+******************************************************************************/
+static void _sample(const int slot, const int64_t t) {
+
+	const uint16_t devInd = devices[slot];
+	float value = 0.0f;
+	float* array = NULL;
+	int n = 0;
+
+	combiner_lock();
+	const int tempRet = monitor_read_temperature(devInd, &value);
+	combiner_unlock();
+	if(tempRet == 0) {
+		_record(slot, TELEMETRY_TEMPERATURE, t, &value, 1);
+	}
+
+	combiner_lock();
+	n = monitor_read_optical_power(devInd, &array, &n) < 0 ? 0 : n;
+	combiner_unlock();
+	_record(slot, TELEMETRY_OPTICAL_POWER, t, array, array != NULL ? n : 0);
+	free(array);
+	array = NULL;
+
+	combiner_lock();
+	n = monitor_read_bias_monitor(devInd, &array, &n) < 0 ? 0 : n;
+	combiner_unlock();
+	_record(slot, TELEMETRY_BIAS_MONITOR, t, array, array != NULL ? n : 0);
+	free(array);
+	array = NULL;
+
+	combiner_lock();
+	n = get_laser_temperatures(devInd, &array, &n) < 0 ? 0 : n;
+	combiner_unlock();
+	_record(slot, TELEMETRY_LASER_TEMPERATURE, t, array, array != NULL ? n : 0);
+	free(array);
+	array = NULL;
+
+	combiner_lock();
+	const int vcompRet = get_Vcomp(devInd, &value);
+	combiner_unlock();
+	if(vcompRet == 0) {
+		_record(slot, TELEMETRY_VCOMP, t, &value, 1);
+	}
+
+	combiner_lock();
+	const int qRet = quality_Qfactor(devInd, &value);
+	combiner_unlock();
+	if(qRet == 0) {
+		_record(slot, TELEMETRY_QFACTOR, t, &value, 1);
+	}
+}
+
+static void* _sampler_thread(void* arg) {
+
+	(void)arg;
+
+	/* The samples are taken at regular times from the start, and the
+	 * samples that can not be taken in time are skipped. */
+	const int period = tierPeriod[TELEMETRY_SECOND];
+	const int64_t start = (int64_t)time(NULL);
+	int64_t sample = 0;
+	struct timespec next, now;
+
+	clock_gettime(CLOCK_MONOTONIC, &next);
+
+	pthread_mutex_lock(&telemetryMutex);
+
+	while(running) {
+
+		pthread_mutex_unlock(&telemetryMutex);
+
+		for(int i = 0; i < numDevices; ++i) {
+			_sample(i, start + sample * period);
+		}
+
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		do {
+			next.tv_sec += period;
+			++sample;
+		} while(next.tv_sec < now.tv_sec);
+
+		pthread_mutex_lock(&telemetryMutex);
+		while(running && pthread_cond_timedwait(&stopCond, &telemetryMutex, &next) == 0) {
+			/* Spurious wake up. */
+		}
+	}
+
+	pthread_mutex_unlock(&telemetryMutex);
+
+	return NULL;
+}
+
+int telemetry_start(const uint16_t* devInds, const int numDevs, const telemetryOptions* options) {
+
+	pthread_condattr_t attr;
+
+	if(devInds == NULL || numDevs <= 0 || numDevs > TELEMETRY_MAX_DEVICES || running) {
+		return -1;
+	}
+
+	memset(series, 0, sizeof(series));
+	memset(numChannels, 0, sizeof(numChannels));
+	memcpy(devices, devInds, (size_t)numDevs * sizeof(uint16_t));
+	numDevices = numDevs;
+	tierPeriod[TELEMETRY_SECOND] = options != NULL && options->periodSec > 0 ? options->periodSec : 1;
+
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&stopCond, &attr);
+	pthread_condattr_destroy(&attr);
+
+	running = true;
+	if(pthread_create(&sampler, NULL, _sampler_thread, NULL) != 0) {
+		running = false;
+		pthread_cond_destroy(&stopCond);
+		return -1;
+	}
+
+	return 0;
+}
+
+void telemetry_stop(void) {
+
+	pthread_mutex_lock(&telemetryMutex);
+	if(!running) {
+		pthread_mutex_unlock(&telemetryMutex);
+		return;
+	}
+	running = false;
+	pthread_cond_signal(&stopCond);
+	pthread_mutex_unlock(&telemetryMutex);
+
+	pthread_join(sampler, NULL);
+	pthread_cond_destroy(&stopCond);
+
+	pthread_mutex_lock(&telemetryMutex);
+	for(int d = 0; d < numDevices; ++d) {
+		for(int m = 0; m < TELEMETRY_METRICS; ++m) {
+			for(int c = 0; c < TELEMETRY_MAX_CHANNELS; ++c) {
+				_series_free(series[d][m][c]);
+				series[d][m][c] = NULL;
+			}
+			numChannels[d][m] = 0;
+		}
+	}
+	numDevices = 0;
+	pthread_mutex_unlock(&telemetryMutex);
+}
+
+int telemetry_set_limits(const telemetryMetric metric, const double low, const double high) {
+
+	if(metric < 0 || metric >= TELEMETRY_METRICS) {
+		return -1;
+	}
+
+	pthread_mutex_lock(&telemetryMutex);
+	limitLow[metric] = low;
+	limitHigh[metric] = high;
+	pthread_mutex_unlock(&telemetryMutex);
+
+	return 0;
+}
+
+int telemetry_num_channels(const uint16_t devInd, const telemetryMetric metric) {
+
+	int n = -1;
+
+	if(metric < 0 || metric >= TELEMETRY_METRICS) {
+		return -1;
+	}
+
+	pthread_mutex_lock(&telemetryMutex);
+	const int slot = _device_slot(devInd);
+	if(slot >= 0) {
+		n = numChannels[slot][metric];
+	}
+	pthread_mutex_unlock(&telemetryMutex);
+
+	return n;
+}
+
+/* Returns the series, or NULL. The caller holds the mutex while it reads it. */
+static telemetrySeries* _find_series(const uint16_t devInd, const telemetryMetric metric,
+		const int channel, const telemetryTier tier) {
+
+	if(metric < 0 || metric >= TELEMETRY_METRICS || channel < 0 || channel >= TELEMETRY_MAX_CHANNELS
+			|| tier < 0 || tier >= TELEMETRY_TIERS) {
+		return NULL;
+	}
+
+	const int slot = _device_slot(devInd);
+	return slot < 0 ? NULL : series[slot][metric][channel];
+}
+
+int telemetry_get_series(const uint16_t devInd, const telemetryMetric metric, const int channel,
+		const telemetryTier tier, double* values, time_t* times, const int maxPoints) {
+
+	int n = -1;
+
+	if(values == NULL || maxPoints <= 0) {
+		return -1;
+	}
+
+	pthread_mutex_lock(&telemetryMutex);
+	const telemetrySeries* s = _find_series(devInd, metric, channel, tier);
+	if(s != NULL) {
+		n = _ring_read(&s->tiers[tier], tierPeriod[tier], values, times, maxPoints);
+	}
+	pthread_mutex_unlock(&telemetryMutex);
+
+	return n;
+}
+
+/******************************************************************************
+** _summarize
+**
+** Statistics and least squares line of the points. The time until the line
+** crosses a limit is measured from the last point.
+******************************************************************************/
+static void _summarize(const double* values, const time_t* times, const int n,
+		const double low, const double high, telemetrySummary* s) {
+
+	double sumX = 0.0, sumY = 0.0, sumXX = 0.0, sumXY = 0.0, sumYY = 0.0;
+
+	s->count = n;
+	s->lastTime = times[n - 1];
+	s->last = values[n - 1];
+	s->min = values[0];
+	s->max = values[0];
+
+	for(int i = 0; i < n; ++i) {
+		const double x = difftime(times[i], times[n - 1]);
+		const double y = values[i];
+
+		sumX += x;
+		sumY += y;
+		sumXX += x * x;
+		sumXY += x * y;
+		sumYY += y * y;
+		if(y < s->min) {
+			s->min = y;
+		}
+		if(y > s->max) {
+			s->max = y;
+		}
+	}
+
+	s->mean = sumY / n;
+	const double var = sumYY / n - s->mean * s->mean;
+	s->stddev = var > 0.0 ? sqrt(var) : 0.0;
+
+	const double den = n * sumXX - sumX * sumX;
+	s->slope = n > 1 && den > 0.0 ? (n * sumXY - sumX * sumY) / den : 0.0;
+
+	/* Value of the line at the last point. */
+	const double now = (sumY - s->slope * sumX) / n;
+
+	s->secondsToLimit = TELEMETRY_NO_LIMIT;
+	if((!isnan(high) && now >= high) || (!isnan(low) && now <= low)) {
+		s->secondsToLimit = 0.0;
+	} else if(s->slope > 0.0 && !isnan(high)) {
+		s->secondsToLimit = (high - now) / s->slope;
+	} else if(s->slope < 0.0 && !isnan(low)) {
+		s->secondsToLimit = (now - low) / -s->slope;
+	}
+}
+
+int telemetry_get_summary(const uint16_t devInd, const telemetryMetric metric, const int channel,
+		const telemetryTier tier, const int points, telemetrySummary* summary) {
+
+	/* The tier is checked here, it gives the size of the buffers. */
+	if(summary == NULL || tier < 0 || tier >= TELEMETRY_TIERS) {
+		return -1;
+	}
+
+	const int capacity = tierBlocks[tier] * TELEMETRY_BLOCK_POINTS;
+	const int n = points > 0 && points < capacity ? points : capacity;
+	double* values = (double*)malloc((size_t)n * sizeof(double));
+	time_t* times = (time_t*)malloc((size_t)n * sizeof(time_t));
+	int got = -1;
+
+	pthread_mutex_lock(&telemetryMutex);
+	const telemetrySeries* s = _find_series(devInd, metric, channel, tier);
+	if(s != NULL && values != NULL && times != NULL) {
+		got = _ring_read(&s->tiers[tier], tierPeriod[tier], values, times, n);
+		if(got > 0) {
+			_summarize(values, times, got, limitLow[metric], limitHigh[metric], summary);
+		}
+	}
+	pthread_mutex_unlock(&telemetryMutex);
+
+	free(values);
+	free(times);
+
+	return got > 0 ? 0 : -1;
+}
+
+int telemetry_get_warnings(const double horizonSec, telemetryWarning* warnings, const int maxWarnings) {
+
+	int count = 0;
+
+	if(warnings == NULL || maxWarnings <= 0) {
+		return 0;
+	}
+
+	/* The devices are copied, telemetry_stop can clear them meanwhile. */
+	uint16_t devs[TELEMETRY_MAX_DEVICES];
+
+	pthread_mutex_lock(&telemetryMutex);
+	const int numDevs = numDevices;
+	memcpy(devs, devices, (size_t)numDevs * sizeof(uint16_t));
+	const int points = 3600 / tierPeriod[TELEMETRY_SECOND];
+	pthread_mutex_unlock(&telemetryMutex);
+
+	for(int d = 0; d < numDevs; ++d) {
+		for(int m = 0; m < TELEMETRY_METRICS; ++m) {
+			for(int c = 0; c < TELEMETRY_MAX_CHANNELS; ++c) {
+				telemetrySummary s;
+
+				if(telemetry_get_summary(devs[d], (telemetryMetric)m, c, TELEMETRY_SECOND, points, &s) != 0
+						|| s.secondsToLimit < 0.0 || s.secondsToLimit > horizonSec) {
+					continue;
+				}
+
+				/* Insertion sort, the closest first. */
+				int pos = count < maxWarnings ? count : maxWarnings - 1;
+				if(count == maxWarnings && s.secondsToLimit >= warnings[pos].secondsToLimit) {
+					continue;
+				}
+				while(pos > 0 && warnings[pos - 1].secondsToLimit > s.secondsToLimit) {
+					warnings[pos] = warnings[pos - 1];
+					--pos;
+				}
+
+				warnings[pos].devInd = devs[d];
+				warnings[pos].metric = (telemetryMetric)m;
+				warnings[pos].channel = c;
+				warnings[pos].value = s.last;
+				warnings[pos].slope = s.slope;
+				warnings[pos].secondsToLimit = s.secondsToLimit;
+				if(count < maxWarnings) {
+					++count;
+				}
+			}
+		}
+	}
+
+	return count;
+}
+
+const char* telemetry_metric_name(const telemetryMetric metric) {
+
+	switch(metric) {
+	case TELEMETRY_TEMPERATURE:			return "Temperature";
+	case TELEMETRY_OPTICAL_POWER:		return "Optical power";
+	case TELEMETRY_BIAS_MONITOR:		return "Bias monitor";
+	case TELEMETRY_LASER_TEMPERATURE:	return "Laser temperature";
+	case TELEMETRY_VCOMP:				return "Vcomp";
+	case TELEMETRY_QFACTOR:				return "Q factor";
+	default:							return "Unknown";
+	}
+}
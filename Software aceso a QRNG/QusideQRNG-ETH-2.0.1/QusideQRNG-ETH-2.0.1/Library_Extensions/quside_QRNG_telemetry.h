@@ -0,0 +1,203 @@
+/*
+ ============================================================================
+ Name        : quside_QRNG_telemetry.h
+ Author      : Alvaro Velasco Garcia, Heriberto J. Diaz
+ Created on  : 18 oct. 2022
+ Version     : 0.1
+ Copyright   : Copyright (C) 2022 QUSIDE TECHNOLOGIES - All Rights Reserved.
+               Unauthorized copying of this file, via any medium is
+               strictly prohibited.
+ Description : This header defines the telemetry history of the monitors. A
+               background thread reads the monitors of the devices on a
+               schedule and keeps their history in memory with three
+               resolutions, so the history, its statistics and the trends
+               can be queried without asking the QRNG.
+
+               It needs the admin mode library. The monitors are read with
+               the connection of the process, between combiner_lock and
+               combiner_unlock.
+ ============================================================================
+ */
+
+#ifndef QUSIDE_QRNG_TELEMETRY_H
+#define QUSIDE_QRNG_TELEMETRY_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+
+/* Devices and values of a monitor that can be recorded. */
+#define TELEMETRY_MAX_DEVICES		16
+#define TELEMETRY_MAX_CHANNELS		8
+
+/* Resolution of the recorded values. */
+#define TELEMETRY_SCALE				1000.0
+
+/* secondsToLimit when the trend does not reach a limit. */
+#define TELEMETRY_NO_LIMIT			-1.0
+
+/* Recorded monitors. */
+typedef enum {
+	TELEMETRY_TEMPERATURE,			/* monitor_read_temperature */
+	TELEMETRY_OPTICAL_POWER,		/* monitor_read_optical_power */
+	TELEMETRY_BIAS_MONITOR,			/* monitor_read_bias_monitor */
+	TELEMETRY_LASER_TEMPERATURE,	/* get_laser_temperatures */
+	TELEMETRY_VCOMP,				/* get_Vcomp */
+	TELEMETRY_QFACTOR,				/* quality_Qfactor */
+	TELEMETRY_METRICS
+} telemetryMetric;
+
+/* Resolutions of the history. */
+typedef enum {
+	TELEMETRY_SECOND,		/* Each sample, about 68 minutes. */
+	TELEMETRY_MINUTE,		/* Mean of each minute, about 34 hours. */
+	TELEMETRY_HOUR,			/* Mean of each hour, about 42 days. */
+	TELEMETRY_TIERS
+} telemetryTier;
+
+/* Options of the sampler. */
+typedef struct {
+	int periodSec;			/* Seconds between samples. 0 means 1. */
+} telemetryOptions;
+
+/* Statistics of the last points of a monitor. */
+typedef struct {
+	int count;				/* Points used. */
+	time_t lastTime;		/* Time of the last point. */
+	double last;			/* Last value. */
+	double mean;
+	double min;
+	double max;
+	double stddev;
+	double slope;			/* Least squares trend in units per second. */
+	double secondsToLimit;	/* Seconds until the trend crosses a limit. */
+} telemetrySummary;
+
+/* Monitor whose trend crosses a limit soon. */
+typedef struct {
+	uint16_t devInd;
+	telemetryMetric metric;
+	int channel;
+	double value;
+	double slope;
+	double secondsToLimit;
+} telemetryWarning;
+
+/******************************************************************************
+** telemetry_start
+**
+** Starts the thread that reads the monitors of the devices.
+**
+** @param devInds [const uint16_t*] Indexes of the devices.
+** @param numDevs [const int] Number of devices.
+** @param options [const telemetryOptions*] Options. NULL uses the defaults.
+**
+** @return [int] If it success returns 0, otherwise -1.
+******************************************************************************/
+int telemetry_start(const uint16_t* devInds, const int numDevs, const telemetryOptions* options);
+
+/******************************************************************************
+** telemetry_stop
+**
+** Stops the thread and frees the history.
+**
+** @return void.
+******************************************************************************/
+void telemetry_stop(void);
+
+/******************************************************************************
+** telemetry_set_limits
+**
+** Sets the operational limits of a monitor used to predict when the trend
+** crosses them. NAN disables a limit.
+**
+** @param metric [const telemetryMetric] Monitor.
+** @param low [const double] Low limit.
+** @param high [const double] High limit.
+**
+** @return [int] If it success returns 0, otherwise -1.
+******************************************************************************/
+int telemetry_set_limits(const telemetryMetric metric, const double low, const double high);
+
+/******************************************************************************
+** telemetry_num_channels
+**
+** Returns the number of values returned by a monitor of a device (lasers,
+** photodiodes, ...).
+**
+** @param devInd [const uint16_t] Index of the device.
+** @param metric [const telemetryMetric] Monitor.
+**
+** @return [int] Number of values, 0 if the monitor was not read yet, or -1.
+******************************************************************************/
+int telemetry_num_channels(const uint16_t devInd, const telemetryMetric metric);
+
+/******************************************************************************
+** telemetry_get_series
+**
+** Copies the last points of the history of a monitor, oldest first.
+**
+** @param devInd [const uint16_t] Index of the device.
+** @param metric [const telemetryMetric] Monitor.
+** @param channel [const int] Value of the monitor.
+** @param tier [const telemetryTier] Resolution.
+** @param values [double*] Values of the points.
+** @param times [time_t*] Times of the points. It can be NULL.
+** @param maxPoints [const int] Size of values and times.
+**
+** @return [int] Number of points copied, or -1.
+******************************************************************************/
+int telemetry_get_series(const uint16_t devInd, const telemetryMetric metric, const int channel,
+		const telemetryTier tier, double* values, time_t* times, const int maxPoints);
+
+/******************************************************************************
+** telemetry_get_summary
+**
+** Computes the statistics and the trend of the last points of a monitor.
+**
+** @param devInd [const uint16_t] Index of the device.
+** @param metric [const telemetryMetric] Monitor.
+** @param channel [const int] Value of the monitor.
+** @param tier [const telemetryTier] Resolution.
+** @param points [const int] Points used. 0 means all the history.
+** @param summary [telemetrySummary*] Variable that will contain the result.
+**
+** @return [int] If there are points returns 0, otherwise -1.
+******************************************************************************/
+int telemetry_get_summary(const uint16_t devInd, const telemetryMetric metric, const int channel,
+		const telemetryTier tier, const int points, telemetrySummary* summary);
+
+/******************************************************************************
+** telemetry_get_warnings
+**
+** Returns the monitors whose trend of the last hour crosses their limits
+** within the horizon.
+**
+** @param horizonSec [const double] Horizon in seconds.
+** @param warnings [telemetryWarning*] Warnings, the closest first.
+** @param maxWarnings [const int] Size of warnings.
+**
+** @return [int] Number of warnings.
+******************************************************************************/
+int telemetry_get_warnings(const double horizonSec, telemetryWarning* warnings, const int maxWarnings);
+
+/******************************************************************************
+** telemetry_metric_name
+**
+** Returns the name of a monitor.
+**
+** @param metric [const telemetryMetric] Monitor.
+**
+** @return [const char*] Name of the monitor.
+******************************************************************************/
+const char* telemetry_metric_name(const telemetryMetric metric);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* QUSIDE_QRNG_TELEMETRY_H */
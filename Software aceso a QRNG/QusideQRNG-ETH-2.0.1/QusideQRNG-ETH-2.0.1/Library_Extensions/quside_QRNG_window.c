@@ -0,0 +1,1409 @@
+/*
+ ============================================================================
+ Name        : quside_QRNG_window.c
+ Author      : Alvaro Velasco Garcia, Heriberto J. Diaz
+ Created on  : 18 oct. 2022
+ Version     : 0.1
+ Copyright   : Copyright (C) 2022 QUSIDE TECHNOLOGIES - All Rights Reserved.
+               Unauthorized copying of this file, via any medium is
+               strictly prohibited.
+ Description : Sliding window capture engine.
+
+               Each CPT of the library is answered with CPR/CPF before the
+               next one can be sent, so one session gives at most one chunk
+               per round trip. The engine keeps several sessions, one per
+               worker process, and sends chunks to the idle ones while the
+               bytes in flight are below the window (the credit). Every
+               completed chunk returns its credit and the next chunk is sent
+               without waiting for the rest.
+
+               The window is 1.25 * bandwidth * latency of a chunk + chunk.
+               The bandwidth is the maximum of the recent delivery rates of
+               all the sessions together: the bytes delivered while a chunk
+               is in flight over its time in flight. The latency of a chunk
+               is RTT + chunk / rate of one session, with the RTT of the
+               recent probes of 4 bytes. The gain of 1.25 lets the window
+               grow a chunk more while the bandwidth grows with it.
+
+               Each chunk goes to the idle session not tried yet, otherwise
+               to the one with the best recent rate. A session whose chunk
+               takes longer than its RTT budget gets no chunks for the next
+               WINDOW_PROBE_PERIOD captures while other sessions capture.
+
+               A device can be taken out of rotation (for example, while it
+               is calibrated). The sessions with its QRNG send the chunks to
+               the next device of the QRNG in rotation, and the sessions of
+               a QRNG without devices in rotation stay idle.
+
+               The latency of each chunk is compared with the expected one,
+               RTT + size / bandwidth. A chunk that takes longer than the
+               hedge percentile of the recent ratios is sent again to
+               another QRNG, device or session. The library calls can not
+               be cancelled, so the copy that arrives second is wiped and
+               counted in discardedBytes. Its session stays busy until then.
+
+               The autotuner sizes the chunks so the RTT is a fifth of the
+               time of a chunk in one session, raises the socket buffers of
+               the sessions to their bandwidth delay product and sets
+               TCP_NODELAY and TCP_QUICKACK. The sessions in use are found
+               by hill climbing: every epoch of captures one session is added
+               or removed, and the change is kept only if the throughput
+               grows (or does not drop when a session is removed). A jump of
+               the demand of the callers adds a session at once.
+ ============================================================================
+ */
+
+#include "quside_QRNG_window.h"
+#include <quside_QRNG_user.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <poll.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdatomic.h>
+
+#define WINDOW_MAX_STREAMS		256
+#define WINDOW_PROBE_BYTES		4
+#define WINDOW_PROBE_PERIOD		64		/* Captures between RTT probes. */
+#define WINDOW_SAMPLES			8		/* Samples of the min/max filters. */
+#define WINDOW_LATENCY_SAMPLES	256		/* Samples of the hedge percentile. */
+#define WINDOW_LATENCY_MIN_SAMPLES	32
+#define WINDOW_TUNE_RTT_CHUNKS	4		/* Time of a chunk over the RTT. */
+#define WINDOW_TUNE_EPOCH		16		/* Captures measured for each number of sessions, */
+#define WINDOW_TUNE_EPOCH_NS	1000000000ULL	/* during this time at least. */
+#define WINDOW_TUNE_HOLD		8		/* Epochs without changes after undoing one. */
+#define WINDOW_TUNE_GAIN		1.05	/* Throughput change that counts. */
+#define WINDOW_TUNE_DEMAND_JUMP	1.5		/* Demand change that adds a session. */
+#define WINDOW_DEMAND_PERIOD_NS	1000000000ULL
+#define WINDOW_MIN_SOCKET_BUFFER	65536
+#define WINDOW_PROBE_GAIN		1.25	/* Window over the bandwidth delay product. */
+#define WINDOW_RTT_BUDGET		4.0		/* Latency of a chunk over the expected one, per chunk in flight. */
+
+/* Socket of the connection of the library. It is not in quside_QRNG_user.h,
+ * so it is only used when the library exports it and no sessionSocket hook
+ * is given. Without both, the socket options are not tuned. */
+extern int tcpSocket __attribute__((weak));
+
+typedef enum {
+	WINDOW_CMD_RANDOM,
+	WINDOW_CMD_RAW,
+	WINDOW_CMD_TUNE,
+	WINDOW_CMD_QUIT
+} windowCmdType;
+
+/* Message sent to a worker. */
+typedef struct {
+	uint32_t op;
+	uint32_t devInd;
+	uint64_t nBytes;
+} windowCmd;
+
+/* Message returned by a worker. */
+typedef struct {
+	int32_t status;
+	uint32_t reserved;
+	uint64_t elapsedNs;
+} windowReply;
+
+/* Session with a QRNG and the chunk it has in flight. */
+typedef struct {
+	pid_t pid;
+	int fd;
+	int server;
+	bool alive;
+	bool busy;
+	bool discard;			/* The chunk in flight is wiped when it arrives. */
+	int twin;				/* Session with the other copy of the chunk, or -1. */
+	int dev;
+	int socketBuffer;		/* Socket buffer sent to the worker. */
+	uint8_t* slot;
+	size_t offset;
+	size_t nBytes;
+	uint64_t sentNs;
+	uint64_t deliveredAtSend;
+	size_t chunksAtSend;	/* Chunks in flight with this one when it was sent. */
+	double rate;			/* Recent bytes per ns of its chunks, 0 if not tried. */
+	uint64_t slowUntil;		/* Capture until which it gets no chunks. */
+} windowStream;
+
+static windowStream streams[WINDOW_MAX_STREAMS];
+static int nStreams = 0;
+static int nServers = 0;
+static uint16_t serverDevices[WINDOW_MAX_STREAMS];
+static bool deviceDisabled[WINDOW_MAX_STREAMS][WINDOW_MAX_DEVICES];
+static uint16_t deviceNext[WINDOW_MAX_STREAMS];
+static uint8_t* shared = NULL;
+static size_t sharedBytes = 0;
+static size_t slotBytes = 0;
+static size_t maxChunk = 0;
+static size_t maxWindow = 0;
+static pthread_mutex_t windowMutex = PTHREAD_MUTEX_INITIALIZER;
+
+static uint64_t rttSamples[WINDOW_SAMPLES];
+static double bwSamples[WINDOW_SAMPLES];
+static double chunkSamples[WINDOW_SAMPLES];
+static int rttNext = 0;
+static int bwNext = 0;
+static uint64_t rttMinNs = 0;
+static double btlBw = 0.0;			/* Bytes per ns of all the sessions. */
+static double chunkBw = 0.0;		/* Bytes per ns of one chunk. */
+static size_t windowChunk = 0;		/* Chunk of the last capture. */
+static size_t windowBytes = 0;
+static uint64_t delivered = 0;
+static uint64_t captures = 0;
+static double latencySamples[WINDOW_LATENCY_SAMPLES];
+static int latencyCount = 0;
+static double hedgePercentile = WINDOW_DEFAULT_HEDGE;
+static double hedgeRatio = 0.0;
+static windowStats stats;
+static atomic_uint_fast64_t lockMisses;	/* Deadlines reached waiting for the mutex. */
+static bool probePending = false;
+
+static bool tuneEnabled = true;
+static size_t minChunk = WINDOW_MIN_CHUNK;
+static int maxSocketBuffer = WINDOW_DEFAULT_SOCKET_BUFFER;
+static int (*sessionSocket)(void) = NULL;
+static size_t tunedChunk = 0;
+static int activeStreams = 0;
+static int socketBuffer = 0;
+static double streamRate = 0.0;		/* Bytes per ns of one session. */
+static double demandRate = 0.0;		/* Bytes per ns requested. */
+static double tunedDemand = 0.0;	/* Demand of the last epoch. */
+static uint64_t demandBytes = 0;
+static uint64_t demandStartNs = 0;
+static uint64_t epochBytes = 0;
+static uint64_t epochNs = 0;
+static int epochCaptures = 0;
+static double captureRate = 0.0;	/* Bytes per ns of the last epoch. */
+static double baseRate = 0.0;		/* Best rate before the change being measured. */
+static int probeStep = 0;			/* Change of sessions being measured, 0 if none. */
+static int probeDirection = -1;
+static int holdEpochs = 0;
+static uint64_t tuneDecisions = 0;
+static windowTuneDecision lastDecision = WINDOW_TUNE_NONE;
+
+static uint64_t _now_ns(void) {
+
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static int _send_all(const int fd, const void* buf, const size_t len) {
+
+	const uint8_t* p = (const uint8_t*)buf;
+	size_t done = 0;
+
+	while(done < len) {
+		const ssize_t n = send(fd, p + done, len - done, MSG_NOSIGNAL);
+		if(n < 0 && errno == EINTR) {
+			continue;
+		}
+		if(n <= 0) {
+			return -1;
+		}
+		done += (size_t)n;
+	}
+	return 0;
+}
+
+static int _recv_all(const int fd, void* buf, const size_t len) {
+
+	uint8_t* p = (uint8_t*)buf;
+	size_t done = 0;
+
+	while(done < len) {
+		const ssize_t n = recv(fd, p + done, len - done, 0);
+		if(n < 0 && errno == EINTR) {
+			continue;
+		}
+		if(n <= 0) {
+			return -1;
+		}
+		done += (size_t)n;
+	}
+	return 0;
+}
+
+/******************************************************************************
+** _raise_socket_buffer
+**
+** Raises SO_RCVBUF and SO_SNDBUF of the connection of the library of the
+** worker. They are never lowered, so the autotuning of the kernel is not
+** limited when it already gives more.
+**
+** @return [int] 0 if the buffer has at least bytes, otherwise -1.
+******************************************************************************/
+static int _raise_socket_buffer(const int sock, const int bytes) {
+
+	int current = 0;
+	socklen_t len = sizeof(current);
+
+	if(getsockopt(sock, SOL_SOCKET, SO_RCVBUF, &current, &len) != 0) {
+		return -1;
+	}
+	if(current >= bytes) {
+		return 0;
+	}
+
+	/* The kernel doubles the value set for its own overhead. */
+	if(setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &bytes, sizeof(bytes)) != 0
+			|| setsockopt(sock, SOL_SOCKET, SO_SNDBUF, &bytes, sizeof(bytes)) != 0) {
+		return -1;
+	}
+	return 0;
+}
+
+/* Socket of the session of the worker, or -1 if it can not be tuned. */
+static int _session_socket(void) {
+
+	if(sessionSocket != NULL) {
+		return sessionSocket();
+	}
+	return &tcpSocket != NULL ? tcpSocket : -1;
+}
+
+/******************************************************************************
+** _worker_main
+**
+** Body of a worker process. It owns one connection with the QRNG and
+** captures into its slot of the shared memory.
+******************************************************************************/
+static void _worker_main(const int fd, char* serverIP, uint8_t* slot) {
+
+	const int one = 1;
+	int sock = -1;
+	windowReply reply;
+	windowCmd cmd;
+
+	memset(&reply, 0, sizeof(reply));
+	reply.status = connectToServer(serverIP) == 0 ? 0 : -1;
+	if(reply.status == 0) {
+		reply.reserved = find_boards();
+		sock = tuneEnabled ? _session_socket() : -1;
+		if(sock >= 0) {
+			/* The CPT commands are small and each one waits for its answer. */
+			setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+		}
+	}
+
+	if(_send_all(fd, &reply, sizeof(reply)) != 0 || reply.status != 0) {
+		_exit(1);
+	}
+
+	while(_recv_all(fd, &cmd, sizeof(cmd)) == 0 && cmd.op != WINDOW_CMD_QUIT) {
+
+		if(cmd.op == WINDOW_CMD_TUNE) {
+			reply.status = sock >= 0 ? _raise_socket_buffer(sock, (int)cmd.nBytes) : -1;
+			reply.elapsedNs = 0;
+			if(_send_all(fd, &reply, sizeof(reply)) != 0) {
+				break;
+			}
+			continue;
+		}
+
+		if(sock >= 0) {
+			/* The kernel clears it, so it is set before each capture. */
+			setsockopt(sock, IPPROTO_TCP, TCP_QUICKACK, &one, sizeof(one));
+		}
+
+		const uint64_t t0 = _now_ns();
+
+		if(cmd.op == WINDOW_CMD_RAW) {
+			reply.status = get_raw((uint32_t*)slot, (size_t)cmd.nBytes, (uint16_t)cmd.devInd);
+		} else {
+			reply.status = get_random((uint32_t*)slot, (size_t)cmd.nBytes, (uint16_t)cmd.devInd);
+		}
+		reply.elapsedNs = _now_ns() - t0;
+
+		if(_send_all(fd, &reply, sizeof(reply)) != 0) {
+			break;
+		}
+	}
+
+	disconnectServer();
+	_exit(0);
+}
+
+static void _kill_stream(windowStream* s) {
+
+	if(s->fd >= 0) {
+		close(s->fd);
+		s->fd = -1;
+	}
+	if(s->pid > 0) {
+		waitpid(s->pid, NULL, 0);
+		s->pid = 0;
+	}
+	s->alive = false;
+	s->busy = false;
+}
+
+/* Expected latency of a chunk of len bytes in one session. */
+static double _expected_ns(const size_t len) {
+	return (double)rttMinNs + (double)len / chunkBw;
+}
+
+static void _update_window(void) {
+
+	rttMinNs = 0;
+	for(int i = 0; i < WINDOW_SAMPLES; ++i) {
+		if(rttSamples[i] != 0 && (rttMinNs == 0 || rttSamples[i] < rttMinNs)) {
+			rttMinNs = rttSamples[i];
+		}
+	}
+
+	btlBw = 0.0;
+	chunkBw = 0.0;
+	for(int i = 0; i < WINDOW_SAMPLES; ++i) {
+		if(bwSamples[i] > btlBw) {
+			btlBw = bwSamples[i];
+		}
+		if(chunkSamples[i] > chunkBw) {
+			chunkBw = chunkSamples[i];
+		}
+	}
+
+	/* Bandwidth delay product with the latency of a whole chunk: with one
+	 * chunk in flight the window still has room for the next one, and the
+	 * bandwidth measured with both raises it again. */
+	size_t w = 2 * maxChunk;
+	if(btlBw > 0.0 && chunkBw > 0.0) {
+		w = (size_t)(WINDOW_PROBE_GAIN * btlBw * _expected_ns(windowChunk)) + maxChunk;
+	}
+	if(w < maxChunk) {
+		w = maxChunk;
+	}
+	if(w > maxWindow) {
+		w = maxWindow;
+	}
+	windowBytes = w;
+}
+
+/******************************************************************************
+** _pick_device
+**
+** Returns the device of the QRNG of a session that has to capture a chunk
+** for devInd: devInd if it is in rotation, otherwise the next device in
+** rotation. Returns -1 if the QRNG has no device in rotation.
+******************************************************************************/
+static int _pick_device(const int server, const uint16_t devInd) {
+
+	const uint16_t n = serverDevices[server];
+
+	if(devInd >= n || devInd >= WINDOW_MAX_DEVICES || !deviceDisabled[server][devInd]) {
+		/* Devices out of the list are checked by the QRNG. */
+		return devInd;
+	}
+
+	for(uint16_t k = 0; k < n; ++k) {
+		const uint16_t d = (uint16_t)((deviceNext[server] + k) % n);
+		if(!deviceDisabled[server][d]) {
+			deviceNext[server] = (uint16_t)((d + 1) % n);
+			++stats.rerouted;
+			return d;
+		}
+	}
+
+	return -1;
+}
+
+/* True if session a takes the next chunk before session b. */
+static bool _before(const windowStream* a, const windowStream* b) {
+
+	if(a->rate == 0.0) {
+		return b->rate != 0.0;
+	}
+	return b->rate != 0.0 && a->rate > b->rate;
+}
+
+/******************************************************************************
+** _order_streams
+**
+** Writes the idle sessions in the order they take chunks: first the ones not
+** tried yet, then the others from the best recent rate. If skipSlow is true
+** the sessions past their RTT budget are left out.
+**
+** @return [int] Number of sessions written in order.
+******************************************************************************/
+static int _order_streams(int* order, const bool skipSlow) {
+
+	int n = 0;
+
+	for(int i = 0; i < nStreams; ++i) {
+		const windowStream* s = &streams[i];
+
+		if(!s->alive || s->busy || (skipSlow && s->slowUntil > captures)) {
+			continue;
+		}
+
+		int k = n++;
+		while(k > 0 && _before(s, &streams[order[k - 1]])) {
+			order[k] = order[k - 1];
+			--k;
+		}
+		order[k] = i;
+	}
+	return n;
+}
+
+/* Measures the round trip time with a small capture in an idle session. */
+static void _probe(const uint16_t devInd) {
+
+	int order[WINDOW_MAX_STREAMS];
+	int n = _order_streams(order, true);
+
+	if(n == 0) {
+		n = _order_streams(order, false);
+	}
+
+	for(int k = 0; k < n; ++k) {
+		windowStream* s = &streams[order[k]];
+		const int dev = _pick_device(s->server, devInd);
+		windowCmd cmd = { WINDOW_CMD_RANDOM, (uint32_t)dev, WINDOW_PROBE_BYTES };
+		windowReply reply;
+
+		if(dev < 0) {
+			continue;
+		}
+
+		if(_send_all(s->fd, &cmd, sizeof(cmd)) != 0
+				|| _recv_all(s->fd, &reply, sizeof(reply)) != 0) {
+			_kill_stream(s);
+			continue;
+		}
+
+		memset(s->slot, 0, WINDOW_PROBE_BYTES);
+		if(reply.status == 0) {
+			rttSamples[rttNext] = reply.elapsedNs;
+			rttNext = (rttNext + 1) % WINDOW_SAMPLES;
+			_update_window();
+		}
+		return;
+	}
+}
+
+static size_t _alive_streams(void) {
+
+	size_t n = 0;
+	for(int i = 0; i < nStreams; ++i) {
+		n += streams[i].alive;
+	}
+	return n;
+}
+
+/* Wipes the chunk of a session whose result is not used anymore. */
+static void _discard(windowStream* s) {
+
+	memset(s->slot, 0, s->nBytes);
+	stats.discardedBytes += s->nBytes;
+	s->busy = false;
+	s->discard = false;
+	s->twin = -1;
+}
+
+/* Waits for the discarded chunks in flight in a device. */
+static void _drain_discards(const int server, const int dev) {
+
+	for(int i = 0; i < nStreams; ++i) {
+		windowStream* s = &streams[i];
+		windowReply reply;
+
+		if(!s->busy || s->server != server || (dev >= 0 && s->dev != dev)) {
+			continue;
+		}
+
+		if(_recv_all(s->fd, &reply, sizeof(reply)) != 0) {
+			_kill_stream(s);
+		}
+		_discard(s);
+	}
+}
+
+static int _cmp_double(const void* a, const void* b) {
+
+	const double x = *(const double*)a;
+	const double y = *(const double*)b;
+	return (x > y) - (x < y);
+}
+
+/* Updates the ratio of the expected latency that triggers a hedge. */
+static void _update_hedge(void) {
+
+	double sorted[WINDOW_LATENCY_SAMPLES];
+	const int n = latencyCount < WINDOW_LATENCY_SAMPLES ? latencyCount : WINDOW_LATENCY_SAMPLES;
+
+	hedgeRatio = 0.0;
+	if(hedgePercentile <= 0.0 || n < WINDOW_LATENCY_MIN_SAMPLES) {
+		return;
+	}
+
+	memcpy(sorted, latencySamples, (size_t)n * sizeof(double));
+	qsort(sorted, (size_t)n, sizeof(double), _cmp_double);
+
+	int k = (int)(hedgePercentile * (double)n);
+	if(k >= n) {
+		k = n - 1;
+	}
+	hedgeRatio = sorted[k];
+}
+
+/******************************************************************************
+** _hedge_stream
+**
+** Returns an idle session for the copy of the chunk of s: a session with
+** another QRNG, otherwise with another device of the same QRNG, otherwise
+** another session with the same device. Returns -1 if all are busy.
+******************************************************************************/
+static int _hedge_stream(const windowStream* s, const uint16_t devInd, int* dev) {
+
+	int sameDevice = -1;
+	int otherDevice = -1;
+	int otherDev = -1;
+
+	for(int i = 0; i < nStreams; ++i) {
+		const windowStream* h = &streams[i];
+
+		if(!h->alive || h->busy || h->slowUntil > captures) {
+			continue;
+		}
+
+		if(h->server != s->server) {
+			const int d = _pick_device(h->server, devInd);
+			if(d >= 0) {
+				*dev = d;
+				return i;
+			}
+			continue;
+		}
+
+		if(otherDevice < 0) {
+			for(uint16_t k = 1; k < serverDevices[s->server] && k < WINDOW_MAX_DEVICES; ++k) {
+				const uint16_t d = (uint16_t)((s->dev + k) % serverDevices[s->server]);
+				if(!deviceDisabled[s->server][d]) {
+					otherDevice = i;
+					otherDev = d;
+					break;
+				}
+			}
+		}
+		if(sameDevice < 0) {
+			sameDevice = i;
+		}
+	}
+
+	if(otherDevice >= 0) {
+		*dev = otherDev;
+		return otherDevice;
+	}
+
+	*dev = s->dev;
+	return sameDevice;
+}
+
+static void _decide(const windowTuneDecision decision) {
+
+	++tuneDecisions;
+	lastDecision = decision;
+}
+
+/* Sends the socket buffer chosen by the autotuner to an idle session. */
+static void _tune_stream(windowStream* s) {
+
+	windowCmd cmd = { WINDOW_CMD_TUNE, 0, (uint64_t)socketBuffer };
+	windowReply reply;
+
+	if(_send_all(s->fd, &cmd, sizeof(cmd)) != 0
+			|| _recv_all(s->fd, &reply, sizeof(reply)) != 0) {
+		_kill_stream(s);
+		return;
+	}
+	s->socketBuffer = socketBuffer;
+}
+
+/******************************************************************************
+** _tune_chunk
+**
+** Sizes the chunk so the RTT is 1 / (WINDOW_TUNE_RTT_CHUNKS + 1) of the time
+** of a chunk in one session, and the socket buffers to the bandwidth delay
+** product of a session. Small changes are ignored.
+******************************************************************************/
+static void _tune_chunk(void) {
+
+	if(!tuneEnabled || rttMinNs == 0 || streamRate <= 0.0) {
+		return;
+	}
+
+	size_t chunk = (size_t)(WINDOW_TUNE_RTT_CHUNKS * streamRate * (double)rttMinNs);
+	chunk = (chunk + 4095) & ~(size_t)4095;
+	if(chunk < minChunk) {
+		chunk = minChunk;
+	}
+	if(chunk > maxChunk) {
+		chunk = maxChunk;
+	}
+	if(4 * chunk < 3 * tunedChunk || 3 * chunk > 4 * tunedChunk) {
+		tunedChunk = chunk;
+		_decide(WINDOW_TUNE_CHUNK);
+	}
+
+	/* A session has one chunk in flight, so it never needs more than that. */
+	double bdp = 2.0 * streamRate * (double)rttMinNs;
+	if(bdp > (double)tunedChunk) {
+		bdp = (double)tunedChunk;
+	}
+	int buffer = bdp > (double)maxSocketBuffer ? maxSocketBuffer : (int)bdp;
+	if(buffer < WINDOW_MIN_SOCKET_BUFFER) {
+		buffer = WINDOW_MIN_SOCKET_BUFFER;
+	}
+	if(4 * (int64_t)buffer > 5 * (int64_t)socketBuffer) {
+		socketBuffer = buffer;
+		_decide(WINDOW_TUNE_SOCKET);
+	}
+}
+
+/******************************************************************************
+** _tune_streams
+**
+** Called at the end of each epoch of captures. It keeps or undoes the last
+** change of the sessions in use and tries the next one.
+******************************************************************************/
+static void _tune_streams(const int alive) {
+
+	const int step = alive >= 16 ? alive / 8 : 1;
+
+	captureRate = (double)epochBytes / (double)epochNs;
+	epochBytes = 0;
+	epochNs = 0;
+	epochCaptures = 0;
+
+	if(activeStreams > alive) {
+		activeStreams = alive;
+	}
+
+	if(probeStep != 0) {
+		const bool better = captureRate > baseRate * WINDOW_TUNE_GAIN;
+		const bool same = captureRate * WINDOW_TUNE_GAIN >= baseRate;
+
+		if(better || (probeStep < 0 && same)) {
+			/* The best rate is kept, so the small losses do not add up. */
+			_decide(probeStep > 0 ? WINDOW_TUNE_STREAMS_UP : WINDOW_TUNE_STREAMS_DOWN);
+			if(captureRate > baseRate) {
+				baseRate = captureRate;
+			}
+		} else {
+			activeStreams -= probeStep;
+			probeDirection = -probeDirection;
+			holdEpochs = WINDOW_TUNE_HOLD;
+			_decide(WINDOW_TUNE_STREAMS_BACK);
+		}
+		probeStep = 0;
+
+	} else {
+		baseRate = captureRate;
+	}
+
+	/* More demand: one session more now, and the next ones are tried. */
+	if(tunedDemand > 0.0 && demandRate > WINDOW_TUNE_DEMAND_JUMP * tunedDemand && activeStreams < alive) {
+		activeStreams = activeStreams + step < alive ? activeStreams + step : alive;
+		probeDirection = 1;
+		holdEpochs = 0;
+		baseRate = 0.0;
+		tunedDemand = demandRate;
+		_decide(WINDOW_TUNE_STREAMS_DEMAND);
+		return;
+	}
+	tunedDemand = demandRate;
+
+	if(holdEpochs > 0) {
+		--holdEpochs;
+		return;
+	}
+
+	const int next = activeStreams + probeDirection * step;
+	if(next < 1 || next > alive) {
+		probeDirection = -probeDirection;
+		holdEpochs = WINDOW_TUNE_HOLD;
+		return;
+	}
+	probeStep = next - activeStreams;
+	activeStreams = next;
+}
+
+static int _send_chunk(windowStream* s, const uint32_t op, const int dev, const size_t off,
+		const size_t len) {
+
+	windowCmd cmd = { op, (uint32_t)dev, len };
+
+	if(_send_all(s->fd, &cmd, sizeof(cmd)) != 0) {
+		_kill_stream(s);
+		return -1;
+	}
+
+	s->busy = true;
+	s->discard = false;
+	s->twin = -1;
+	s->dev = dev;
+	s->offset = off;
+	s->nBytes = len;
+	s->sentNs = _now_ns();
+	s->deliveredAtSend = delivered;
+	s->chunksAtSend = 1;
+
+	return 0;
+}
+
+/******************************************************************************
+** _capture
+**
+** Moves n bytes from the sessions to dst keeping the window full. A chunk
+** that takes longer than the hedge percentile of the recent latencies is
+** sent again to another session, the first copy that arrives is used and
+** the other one is wiped when it arrives.
+**
+** @return [int] 0, -1 on error or WINDOW_TIMEOUT if deadlineNs is reached.
+******************************************************************************/
+static int _capture(uint8_t* dst, const size_t n, const uint16_t devInd, const uint32_t op,
+		const uint64_t deadlineNs) {
+
+	/* Chunks that failed and have to be sent again. */
+	size_t retryOffset[2 * WINDOW_MAX_STREAMS + 1];
+	size_t retryBytes[2 * WINDOW_MAX_STREAMS + 1];
+	int nRetries = 0;
+	int failures = 0;
+	int ret = 0;
+
+	struct pollfd pfd[WINDOW_MAX_STREAMS];
+	int pfdStream[WINDOW_MAX_STREAMS];
+	int order[WINDOW_MAX_STREAMS];
+
+	if(deadlineNs != 0 && _now_ns() >= deadlineNs) {
+		++stats.deadlineMisses;
+		return WINDOW_TIMEOUT;
+	}
+
+	/* The probe waits for its answer without limit, so a capture with a
+	 * deadline leaves it to the next capture without deadline. */
+	if(captures++ % WINDOW_PROBE_PERIOD == 0) {
+		probePending = true;
+	}
+	if(probePending && deadlineNs == 0) {
+		probePending = false;
+		_probe(devInd);
+		_update_hedge();
+		_tune_chunk();
+	}
+
+	const size_t alive = _alive_streams();
+	if(alive == 0) {
+		return -1;
+	}
+
+	const uint64_t startNs = _now_ns();
+	if(demandStartNs == 0) {
+		demandStartNs = startNs;
+	}
+	demandBytes += n;
+	if(startNs - demandStartNs >= WINDOW_DEMAND_PERIOD_NS) {
+		demandRate = (double)demandBytes / (double)(startNs - demandStartNs);
+		demandBytes = 0;
+		demandStartNs = startNs;
+	}
+
+	const size_t active = tuneEnabled && activeStreams > 0 && (size_t)activeStreams < alive ?
+			(size_t)activeStreams : alive;
+
+	/* Small captures are split between the sessions too. */
+	size_t chunk = (n + active - 1) / active;
+	chunk = (chunk + 3) & ~(size_t)3;
+	if(chunk < minChunk) {
+		chunk = minChunk;
+	}
+	if(chunk > tunedChunk) {
+		chunk = tunedChunk;
+	}
+	windowChunk = chunk;
+
+	size_t offset = 0, completed = 0, inFlight = 0;
+	size_t chunksInFlight = 0;
+	double bestRate = 0.0;
+	double bestChunkRate = 0.0;
+
+	while(completed < n) {
+
+		/* No chunk is sent after the deadline. */
+		if(deadlineNs != 0 && _now_ns() >= deadlineNs) {
+			++stats.deadlineMisses;
+			ret = WINDOW_TIMEOUT;
+			break;
+		}
+
+		/* Use the credit of the window. The slow sessions are only used
+		 * when nothing else is in flight. */
+		int nOrder = _order_streams(order, true);
+		if(nOrder == 0 && chunksInFlight == 0) {
+			nOrder = _order_streams(order, false);
+		}
+
+		for(int k = 0; k < nOrder; ++k) {
+			windowStream* s = &streams[order[k]];
+			size_t off, len;
+
+			if(chunksInFlight >= active) {
+				break;
+			}
+
+			if(nRetries > 0) {
+				off = retryOffset[nRetries - 1];
+				len = retryBytes[nRetries - 1];
+			} else if(offset < n) {
+				off = offset;
+				len = n - offset < chunk ? n - offset : chunk;
+			} else {
+				break;
+			}
+
+			if(inFlight > 0 && inFlight + len > windowBytes) {
+				break;
+			}
+
+			if(s->socketBuffer < socketBuffer && deadlineNs == 0) {
+				_tune_stream(s);
+				if(!s->alive) {
+					continue;
+				}
+			}
+
+			const int dev = _pick_device(s->server, devInd);
+			if(dev < 0 || _send_chunk(s, op, dev, off, len) != 0) {
+				continue;
+			}
+
+			if(nRetries > 0) {
+				--nRetries;
+			} else {
+				offset += len;
+			}
+			inFlight += len;
+			s->chunksAtSend = ++chunksInFlight;
+		}
+
+		if(inFlight > stats.maxInFlight) {
+			stats.maxInFlight = inFlight;
+		}
+
+		const uint64_t now = _now_ns();
+		uint64_t wakeNs = deadlineNs;
+
+		if(deadlineNs != 0 && now >= deadlineNs) {
+			++stats.deadlineMisses;
+			ret = WINDOW_TIMEOUT;
+			break;
+		}
+
+		/* Hedge the late chunks and find the next one that can be late. */
+		for(int i = 0; i < nStreams && hedgeRatio > 0.0 && chunkBw > 0.0; ++i) {
+			windowStream* s = &streams[i];
+
+			if(!s->busy || s->discard || s->twin >= 0) {
+				continue;
+			}
+
+			const uint64_t dueNs = s->sentNs + (uint64_t)(hedgeRatio * _expected_ns(s->nBytes));
+
+			if(dueNs > now) {
+				if(wakeNs == 0 || dueNs < wakeNs) {
+					wakeNs = dueNs;
+				}
+				continue;
+			}
+
+			int dev;
+			const int h = _hedge_stream(s, devInd, &dev);
+			if(h < 0 || _send_chunk(&streams[h], op, dev, s->offset, s->nBytes) != 0) {
+				continue;
+			}
+
+			s->twin = h;
+			streams[h].twin = i;
+			inFlight += s->nBytes;
+			++stats.hedges;
+		}
+
+		int nfds = 0;
+		for(int i = 0; i < nStreams; ++i) {
+			if(streams[i].busy) {
+				pfd[nfds].fd = streams[i].fd;
+				pfd[nfds].events = POLLIN;
+				pfdStream[nfds] = i;
+				++nfds;
+			}
+		}
+
+		if(nfds == 0) {
+			ret = -1;
+			break;
+		}
+
+		/* Rounded up, so the late chunk is late when poll returns. */
+		const int timeoutMs = wakeNs == 0 ? -1 :
+				wakeNs <= now ? 0 : (int)((wakeNs - now + 999999) / 1000000);
+
+		const int ready = poll(pfd, (nfds_t)nfds, timeoutMs);
+		if(ready < 0) {
+			if(errno == EINTR) {
+				continue;
+			}
+			ret = -1;
+			break;
+		}
+
+		/* Each completed chunk returns its credit. */
+		for(int k = 0; k < nfds && ready > 0; ++k) {
+			windowStream* s = &streams[pfdStream[k]];
+			windowReply reply;
+
+			if(pfd[k].revents == 0) {
+				continue;
+			}
+
+			const bool lost = _recv_all(s->fd, &reply, sizeof(reply)) != 0;
+			if(lost) {
+				_kill_stream(s);
+			}
+
+			/* Chunk of a previous capture or copy that arrived second. */
+			if(s->discard) {
+				_discard(s);
+				continue;
+			}
+
+			inFlight -= s->nBytes;
+			s->busy = false;
+
+			windowStream* twin = s->twin >= 0 ? &streams[s->twin] : NULL;
+			s->twin = -1;
+
+			if(lost || reply.status != 0) {
+				++stats.errors;
+
+				if(twin != NULL) {
+					/* The other copy is still in flight. */
+					twin->twin = -1;
+				} else {
+					retryOffset[nRetries] = s->offset;
+					retryBytes[nRetries] = s->nBytes;
+					++nRetries;
+					--chunksInFlight;
+				}
+
+				if(++failures > 2 * nStreams) {
+					ret = -1;
+					break;
+				}
+				continue;
+			}
+
+			if(twin != NULL) {
+				/* The other copy is wiped when it arrives. */
+				twin->discard = true;
+				twin->twin = -1;
+				inFlight -= twin->nBytes;
+				stats.hedgeWins += s->sentNs > twin->sentNs;
+			}
+
+			memcpy(dst + s->offset, s->slot, s->nBytes);
+			memset(s->slot, 0, s->nBytes);
+
+			completed += s->nBytes;
+			delivered += s->nBytes;
+			--chunksInFlight;
+			++stats.chunks;
+
+			/* Rate of the session without the round trip of the command. */
+			if(tuneEnabled && rttMinNs > 0 && reply.elapsedNs > rttMinNs && s->nBytes >= minChunk) {
+				const double rate = (double)s->nBytes / (double)(reply.elapsedNs - rttMinNs);
+				streamRate = streamRate == 0.0 ? rate : streamRate + (rate - streamRate) / 8.0;
+			}
+
+			/* Delivery rate of all the sessions while the chunk was in
+			 * flight, and rate of the chunk alone. */
+			const uint64_t elapsed = _now_ns() - s->sentNs;
+			if(elapsed > 0) {
+				const double rate = (double)(delivered - s->deliveredAtSend) / (double)elapsed;
+				const double own = (double)s->nBytes / (double)elapsed;
+				if(rate > bestRate) {
+					bestRate = rate;
+				}
+				if(own > bestChunkRate) {
+					bestChunkRate = own;
+				}
+				/* The late chunks of this capture are judged with it too. */
+				if(own > chunkBw) {
+					chunkBw = own;
+				}
+				s->rate = s->rate == 0.0 ? own : s->rate + (own - s->rate) / 4.0;
+			}
+
+			if(chunkBw > 0.0) {
+				const double ratio = (double)elapsed / _expected_ns(s->nBytes);
+				latencySamples[latencyCount++ % WINDOW_LATENCY_SAMPLES] = ratio;
+
+				/* Each chunk in flight with it can delay it once more. */
+				if(ratio > WINDOW_RTT_BUDGET * (double)s->chunksAtSend) {
+					s->slowUntil = captures + WINDOW_PROBE_PERIOD;
+				}
+			}
+		}
+
+		if(ret != 0) {
+			break;
+		}
+	}
+
+	if(ret != 0) {
+		/* The chunks in flight are not used and the partial capture is wiped. */
+		for(int i = 0; i < nStreams; ++i) {
+			if(streams[i].busy) {
+				streams[i].discard = true;
+				streams[i].twin = -1;
+			}
+		}
+		memset(dst, 0, n);
+		return ret;
+	}
+
+	bwSamples[bwNext] = bestRate;
+	chunkSamples[bwNext] = bestChunkRate;
+	bwNext = (bwNext + 1) % WINDOW_SAMPLES;
+	_update_window();
+
+	stats.bytes += n;
+
+	if(tuneEnabled && n >= minChunk) {
+		epochBytes += n;
+		epochNs += _now_ns() - startNs;
+		if(++epochCaptures >= WINDOW_TUNE_EPOCH && epochNs >= WINDOW_TUNE_EPOCH_NS) {
+			_tune_streams((int)alive);
+		}
+	}
+
+	return 0;
+}
+
+static int _get(uint32_t* mem_slot, const size_t nBytes, const uint16_t devInd, const uint32_t op,
+		const uint64_t deadlineNs) {
+
+	if(mem_slot == NULL || shared == NULL) {
+		return -1;
+	}
+	if(nBytes == 0) {
+		return 0;
+	}
+
+	if(deadlineNs == 0) {
+		pthread_mutex_lock(&windowMutex);
+	} else {
+		/* The capture in progress of another thread is not waited for
+		 * beyond the deadline. timedlock takes a CLOCK_REALTIME time. */
+		struct timespec abs;
+		const uint64_t now = _now_ns();
+		const uint64_t left = deadlineNs > now ? deadlineNs - now : 0;
+
+		clock_gettime(CLOCK_REALTIME, &abs);
+		abs.tv_sec += (time_t)(left / 1000000000ULL);
+		abs.tv_nsec += (long)(left % 1000000000ULL);
+		if(abs.tv_nsec >= 1000000000L) {
+			abs.tv_nsec -= 1000000000L;
+			++abs.tv_sec;
+		}
+
+		int locked;
+		do {
+			locked = pthread_mutex_timedlock(&windowMutex, &abs);
+		} while(locked == EINTR);
+
+		if(locked != 0) {
+			atomic_fetch_add(&lockMisses, 1);
+			return locked == ETIMEDOUT ? WINDOW_TIMEOUT : -1;
+		}
+	}
+
+	const int ret = _capture((uint8_t*)mem_slot, nBytes, devInd, op, deadlineNs);
+	pthread_mutex_unlock(&windowMutex);
+
+	return ret;
+}
+
+int window_init(char** serverIPs, const int numServers, const windowOptions* options) {
+
+	const int perServer = options != NULL && options->streamsPerServer > 0 ?
+			options->streamsPerServer : WINDOW_DEFAULT_STREAMS;
+
+	if(serverIPs == NULL || numServers <= 0 || shared != NULL) {
+		return -1;
+	}
+
+	maxChunk = options != NULL && options->chunkBytes > 0 ? options->chunkBytes : WINDOW_DEFAULT_CHUNK;
+	maxChunk = (maxChunk + 3) & ~(size_t)3;
+	if(maxChunk < WINDOW_MIN_CHUNK) {
+		maxChunk = WINDOW_MIN_CHUNK;
+	}
+
+	tuneEnabled = options == NULL || !options->fixedTuning;
+	minChunk = options != NULL && options->minChunkBytes > 0 ? options->minChunkBytes : WINDOW_MIN_CHUNK;
+	minChunk = (minChunk + 3) & ~(size_t)3;
+	if(minChunk < WINDOW_MIN_CHUNK) {
+		minChunk = WINDOW_MIN_CHUNK;
+	}
+	if(minChunk > maxChunk) {
+		minChunk = maxChunk;
+	}
+	maxSocketBuffer = options != NULL && options->maxSocketBuffer > 0 ?
+			options->maxSocketBuffer : WINDOW_DEFAULT_SOCKET_BUFFER;
+	sessionSocket = options != NULL ? options->sessionSocket : NULL;
+
+	nStreams = perServer * numServers;
+	if(nStreams > WINDOW_MAX_STREAMS) {
+		nStreams = WINDOW_MAX_STREAMS;
+	}
+	nServers = numServers < nStreams ? numServers : nStreams;
+
+	hedgePercentile = options == NULL || options->hedgePercentile == 0.0 ? WINDOW_DEFAULT_HEDGE :
+			options->hedgePercentile < 0.0 ? 0.0 : options->hedgePercentile;
+
+	maxWindow = options != NULL && options->maxWindowBytes > 0 ?
+			options->maxWindowBytes : (size_t)nStreams * maxChunk;
+
+	slotBytes = (maxChunk + 63) & ~(size_t)63;
+	sharedBytes = slotBytes * (size_t)nStreams;
+	shared = (uint8_t*)mmap(NULL, sharedBytes, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if(shared == MAP_FAILED) {
+		shared = NULL;
+		return -1;
+	}
+
+	memset(streams, 0, sizeof(streams));
+	memset(rttSamples, 0, sizeof(rttSamples));
+	memset(bwSamples, 0, sizeof(bwSamples));
+	memset(chunkSamples, 0, sizeof(chunkSamples));
+	memset(&stats, 0, sizeof(stats));
+	memset(serverDevices, 0, sizeof(serverDevices));
+	memset(deviceDisabled, 0, sizeof(deviceDisabled));
+	memset(deviceNext, 0, sizeof(deviceNext));
+	atomic_store(&lockMisses, 0);
+	probePending = false;
+	latencyCount = 0;
+	hedgeRatio = 0.0;
+	rttNext = 0;
+	bwNext = 0;
+	delivered = 0;
+	captures = 0;
+
+	/* The autotuner starts with the biggest chunk and all the sessions. */
+	tunedChunk = maxChunk;
+	windowChunk = maxChunk;
+	activeStreams = 0;
+	socketBuffer = 0;
+	streamRate = 0.0;
+	demandRate = 0.0;
+	tunedDemand = 0.0;
+	demandBytes = 0;
+	demandStartNs = 0;
+	epochBytes = 0;
+	epochNs = 0;
+	epochCaptures = 0;
+	captureRate = 0.0;
+	baseRate = 0.0;
+	probeStep = 0;
+	probeDirection = -1;
+	holdEpochs = 0;
+	tuneDecisions = 0;
+	lastDecision = WINDOW_TUNE_NONE;
+
+	for(int i = 0; i < nStreams; ++i) {
+		windowStream* s = &streams[i];
+		int sv[2];
+
+		s->fd = -1;
+		s->twin = -1;
+		s->server = i % numServers;
+		s->slot = shared + (size_t)i * slotBytes;
+
+		if(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) != 0) {
+			continue;
+		}
+
+		s->pid = fork();
+
+		if(s->pid == 0) {
+			/* The worker only keeps its own end. */
+			for(int j = 0; j < i; ++j) {
+				if(streams[j].fd >= 0) {
+					close(streams[j].fd);
+				}
+			}
+			close(sv[0]);
+			_worker_main(sv[1], serverIPs[s->server], s->slot);
+		}
+
+		close(sv[1]);
+
+		if(s->pid < 0) {
+			close(sv[0]);
+			s->pid = 0;
+			continue;
+		}
+
+		s->fd = sv[0];
+		s->alive = true;
+	}
+
+	/* Wait for the connection result of each worker. */
+	for(int i = 0; i < nStreams; ++i) {
+		windowReply reply;
+
+		if(streams[i].alive && (_recv_all(streams[i].fd, &reply, sizeof(reply)) != 0
+				|| reply.status != 0)) {
+			_kill_stream(&streams[i]);
+		} else if(streams[i].alive) {
+			const uint16_t found = reply.reserved > 0 ? (uint16_t)reply.reserved : 1;
+			if(found > serverDevices[streams[i].server]) {
+				serverDevices[streams[i].server] = found;
+			}
+		}
+	}
+
+	_update_window();
+
+	activeStreams = (int)_alive_streams();
+	if(activeStreams == 0) {
+		window_release();
+		return -1;
+	}
+
+	return 0;
+}
+
+void window_release(void) {
+
+	pthread_mutex_lock(&windowMutex);
+
+	for(int i = 0; i < nStreams; ++i) {
+		windowCmd cmd = { WINDOW_CMD_QUIT, 0, 0 };
+
+		if(streams[i].alive) {
+			_send_all(streams[i].fd, &cmd, sizeof(cmd));
+		}
+		_kill_stream(&streams[i]);
+	}
+	nStreams = 0;
+	nServers = 0;
+
+	if(shared != NULL) {
+		memset(shared, 0, sharedBytes);
+		munmap(shared, sharedBytes);
+		shared = NULL;
+	}
+
+	pthread_mutex_unlock(&windowMutex);
+}
+
+int window_get_random(uint32_t* mem_slot, const size_t Nuint32, const uint16_t devInd) {
+	return _get(mem_slot, Nuint32, devInd, WINDOW_CMD_RANDOM, 0);
+}
+
+int window_get_raw(uint32_t* mem_slot, const size_t Nuint32, const uint16_t devInd) {
+	return _get(mem_slot, Nuint32, devInd, WINDOW_CMD_RAW, 0);
+}
+
+int window_get_random_deadline(uint32_t* mem_slot, const size_t Nuint32, const uint16_t devInd,
+		const uint64_t timeoutUs) {
+	return _get(mem_slot, Nuint32, devInd, WINDOW_CMD_RANDOM, _now_ns() + (timeoutUs > 0 ? timeoutUs : 1) * 1000);
+}
+
+int window_num_devices(const int server) {
+
+	int n = -1;
+
+	pthread_mutex_lock(&windowMutex);
+	if(server >= 0 && server < nServers && serverDevices[server] > 0) {
+		n = serverDevices[server];
+	}
+	pthread_mutex_unlock(&windowMutex);
+
+	return n;
+}
+
+int window_set_device_enabled(const int server, const uint16_t devInd, const bool enabled) {
+
+	int ret = -1;
+
+	/* The captures hold the mutex until all their chunks are completed, so
+	 * the device is drained when the mutex is taken. */
+	pthread_mutex_lock(&windowMutex);
+	if(server >= 0 && server < nServers && devInd < serverDevices[server]
+			&& devInd < WINDOW_MAX_DEVICES) {
+		deviceDisabled[server][devInd] = !enabled;
+		if(!enabled) {
+			_drain_discards(server, devInd);
+		}
+		ret = 0;
+	}
+	pthread_mutex_unlock(&windowMutex);
+
+	return ret;
+}
+
+void window_get_stats(windowStats* s) {
+
+	pthread_mutex_lock(&windowMutex);
+
+	*s = stats;
+	s->deadlineMisses += atomic_load(&lockMisses);
+	s->devices = 0;
+	for(int i = 0; i < nServers; ++i) {
+		for(uint16_t d = 0; d < serverDevices[i] && d < WINDOW_MAX_DEVICES; ++d) {
+			s->devices += !deviceDisabled[i][d];
+		}
+	}
+	s->streams = (int)_alive_streams();
+	s->rttUs = (double)rttMinNs / 1000.0;
+	s->bandwidth = btlBw * 1e9;
+	s->windowBytes = windowBytes;
+
+	pthread_mutex_unlock(&windowMutex);
+}
+
+void window_get_tuning(windowTuning* t) {
+
+	pthread_mutex_lock(&windowMutex);
+
+	t->enabled = tuneEnabled;
+	t->chunkBytes = tunedChunk;
+	t->activeStreams = activeStreams;
+	t->socketBuffer = socketBuffer;
+	t->streamRate = streamRate * 1e9;
+	t->captureRate = captureRate * 1e9;
+	t->demand = demandRate * 1e9;
+	t->decisions = tuneDecisions;
+	t->lastDecision = lastDecision;
+
+	pthread_mutex_unlock(&windowMutex);
+}
+
+const char* window_tune_decision_name(const windowTuneDecision decision) {
+
+	switch(decision) {
+	case WINDOW_TUNE_NONE:				return "NONE";
+	case WINDOW_TUNE_CHUNK:				return "CHUNK";
+	case WINDOW_TUNE_STREAMS_UP:		return "STREAMS_UP";
+	case WINDOW_TUNE_STREAMS_DOWN:		return "STREAMS_DOWN";
+	case WINDOW_TUNE_STREAMS_BACK:		return "STREAMS_BACK";
+	case WINDOW_TUNE_STREAMS_DEMAND:	return "STREAMS_DEMAND";
+	case WINDOW_TUNE_SOCKET:			return "SOCKET";
+	default:							return "UNKNOWN";
+	}
+}
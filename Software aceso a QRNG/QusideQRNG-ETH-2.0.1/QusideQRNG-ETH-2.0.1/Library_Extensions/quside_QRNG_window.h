@@ -0,0 +1,241 @@
+/*
+ ============================================================================
+ Name        : quside_QRNG_window.h
+ Author      : Alvaro Velasco Garcia, Heriberto J. Diaz
+ Created on  : 18 oct. 2022
+ Version     : 0.1
+ Copyright   : Copyright (C) 2022 QUSIDE TECHNOLOGIES - All Rights Reserved.
+               Unauthorized copying of this file, via any medium is
+               strictly prohibited.
+ Description : This header defines a sliding window capture engine. A big
+               capture is split in chunks that are kept in flight in several
+               sessions with the QRNGs, up to a window of bytes sized from
+               the measured RTT and bandwidth. The size of the chunks, the
+               sessions in use and the socket buffers are tuned at run time.
+ ============================================================================
+ */
+
+#ifndef QUSIDE_QRNG_WINDOW_H
+#define QUSIDE_QRNG_WINDOW_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/* Default sessions opened with each QRNG. */
+#define WINDOW_DEFAULT_STREAMS		4
+
+/* Default and minimum size of a chunk in bytes. */
+#define WINDOW_DEFAULT_CHUNK		262144
+#define WINDOW_MIN_CHUNK			4096
+
+/* Default percentile of the latency that sends a copy of a late chunk. */
+#define WINDOW_DEFAULT_HEDGE		0.99
+
+/* Returned when a capture does not finish before its deadline. */
+#define WINDOW_TIMEOUT				-2
+
+/* Devices of each QRNG that the engine can use. */
+#define WINDOW_MAX_DEVICES			16
+
+/* Default biggest SO_RCVBUF/SO_SNDBUF set by the autotuner. */
+#define WINDOW_DEFAULT_SOCKET_BUFFER	4194304
+
+/* Decisions of the autotuner. */
+typedef enum {
+	WINDOW_TUNE_NONE,
+	WINDOW_TUNE_CHUNK,			/* Chunk resized from the RTT and the session rate. */
+	WINDOW_TUNE_STREAMS_UP,		/* One more session gave more throughput. */
+	WINDOW_TUNE_STREAMS_DOWN,	/* One less session gave the same throughput. */
+	WINDOW_TUNE_STREAMS_BACK,	/* The last change of sessions was undone. */
+	WINDOW_TUNE_STREAMS_DEMAND,	/* Sessions raised to follow the demand. */
+	WINDOW_TUNE_SOCKET			/* Socket buffers raised to the bandwidth delay product. */
+} windowTuneDecision;
+
+/* Options of the window engine. */
+typedef struct {
+	int streamsPerServer;	/* Sessions with each QRNG. 0 means WINDOW_DEFAULT_STREAMS. */
+	size_t chunkBytes;		/* Biggest chunk. 0 means WINDOW_DEFAULT_CHUNK. */
+	size_t maxWindowBytes;	/* Biggest window. 0 means all the sessions busy. */
+	double hedgePercentile;	/* 0 means WINDOW_DEFAULT_HEDGE, negative disables it. */
+	bool fixedTuning;		/* Disables the autotuner: chunkBytes and all the sessions are used. */
+	size_t minChunkBytes;	/* Smallest chunk of the autotuner. 0 means WINDOW_MIN_CHUNK. */
+	int maxSocketBuffer;	/* Biggest socket buffer. 0 means WINDOW_DEFAULT_SOCKET_BUFFER. */
+	/* Returns the socket of the connection of the library, called in each
+	 * worker after connectToServer. NULL uses the variable tcpSocket when the
+	 * library exports it. If there is no socket (-1) the socket options and
+	 * buffers are not tuned, the rest of the autotuner works the same. */
+	int (*sessionSocket)(void);
+} windowOptions;
+
+/* Statistics of the window engine. */
+typedef struct {
+	int streams;			/* Sessions alive. */
+	double rttUs;			/* Minimum round trip time measured. */
+	double bandwidth;		/* Bottleneck bandwidth estimate in bytes/s. */
+	size_t windowBytes;		/* Current window. */
+	size_t maxInFlight;		/* Most bytes in flight at the same time. */
+	uint64_t chunks;		/* Chunks completed. */
+	uint64_t bytes;			/* Bytes delivered. */
+	uint64_t errors;		/* Chunks that failed and were sent again. */
+	int devices;			/* Devices in rotation in all the QRNGs. */
+	uint64_t rerouted;		/* Chunks sent to another device of the QRNG. */
+	uint64_t hedges;		/* Late chunks sent again to another session. */
+	uint64_t hedgeWins;		/* Copies that arrived first. */
+	uint64_t discardedBytes;	/* Bytes of the copies that arrived second, wiped. */
+	uint64_t deadlineMisses;	/* Captures that reached their deadline. */
+} windowStats;
+
+/* State of the autotuner. */
+typedef struct {
+	bool enabled;
+	size_t chunkBytes;		/* Biggest chunk in use. */
+	int activeStreams;		/* Sessions with a chunk in flight at most (hedges apart). */
+	int socketBuffer;		/* SO_RCVBUF of the sessions, 0 if not changed. */
+	double streamRate;		/* Bytes/s of one session while it captures. */
+	double captureRate;		/* Bytes/s of the recent big captures. */
+	double demand;			/* Bytes/s requested by the callers. */
+	uint64_t decisions;		/* Changes done by the autotuner. */
+	windowTuneDecision lastDecision;
+} windowTuning;
+
+/******************************************************************************
+** window_init
+**
+** Starts the sessions with the QRNGs. Each session lives in its own worker
+** process because the library keeps one connection per process. It has to
+** be called before connectToServer and before creating any thread.
+**
+** @param serverIPs [char**] IPs of the QRNGs.
+** @param numServers [const int] Number of IPs.
+** @param options [const windowOptions*] Options. NULL uses the defaults.
+**
+** @return [int] If at least one session is connected returns 0, otherwise -1.
+******************************************************************************/
+int window_init(char** serverIPs, const int numServers, const windowOptions* options);
+
+/******************************************************************************
+** window_release
+**
+** Disconnects all the sessions and stops the worker processes.
+**
+** @return void.
+******************************************************************************/
+void window_release(void);
+
+/******************************************************************************
+** window_get_random
+**
+** Captures Nuint32 bytes of extracted random numbers using all the sessions.
+** If the device is out of rotation in a QRNG, the sessions with that QRNG
+** use another of its devices.
+**
+** @param mem_slot [uint32_t *] pointer to region where save the numbers.
+** @param Nuint32 [const size_t] count of random numbers in bytes.
+** @param devInd [uint16_t] Index of the device to use from the list.
+**
+** @return [int] If it success returns 0, otherwise -1.
+******************************************************************************/
+int window_get_random(uint32_t* mem_slot, const size_t Nuint32, const uint16_t devInd);
+
+/******************************************************************************
+** window_get_raw
+**
+** Captures Nuint32 bytes of raw random numbers using all the sessions.
+**
+** @param mem_slot [uint32_t *] pointer to region where save the numbers.
+** @param Nuint32 [const size_t] count of random numbers in bytes.
+** @param devInd [uint16_t] Index of the device to use from the list.
+**
+** @return [int] If it success returns 0, otherwise -1.
+******************************************************************************/
+int window_get_raw(uint32_t* mem_slot, const size_t Nuint32, const uint16_t devInd);
+
+/******************************************************************************
+** window_get_random_deadline
+**
+** Like window_get_random, but it gives up when the capture does not finish
+** in timeoutUs. The random numbers captured are wiped in that case, and the
+** chunks still in flight are wiped when they arrive. The wait for the
+** capture of another thread counts in the time limit, no chunk is sent after
+** it, and the periodic RTT probe is left to the next capture without limit.
+**
+** @param mem_slot [uint32_t *] pointer to region where save the numbers.
+** @param Nuint32 [const size_t] count of random numbers in bytes.
+** @param devInd [uint16_t] Index of the device to use from the list.
+** @param timeoutUs [const uint64_t] Time limit in microseconds.
+**
+** @return [int] If it success returns 0, WINDOW_TIMEOUT if the time limit is
+**               reached, otherwise -1.
+******************************************************************************/
+int window_get_random_deadline(uint32_t* mem_slot, const size_t Nuint32, const uint16_t devInd,
+		const uint64_t timeoutUs);
+
+/******************************************************************************
+** window_num_devices
+**
+** Returns the number of devices found in a QRNG with find_boards.
+**
+** @param server [const int] Index of the QRNG in the serverIPs of window_init.
+**
+** @return [int] Number of devices, or -1 if the QRNG has no session.
+******************************************************************************/
+int window_num_devices(const int server);
+
+/******************************************************************************
+** window_set_device_enabled
+**
+** Takes a device out of rotation or brings it back. When the device is taken
+** out, the function returns after the chunks in flight in it are completed,
+** and the next captures go to the other devices.
+**
+** @param server [const int] Index of the QRNG in the serverIPs of window_init.
+** @param devInd [const uint16_t] Index of the device in the QRNG.
+** @param enabled [const bool] true to use the device, false to drain it.
+**
+** @return [int] If it success returns 0, otherwise -1.
+******************************************************************************/
+int window_set_device_enabled(const int server, const uint16_t devInd, const bool enabled);
+
+/******************************************************************************
+** window_get_stats
+**
+** Returns the statistics of the window engine.
+**
+** @param stats [windowStats*] Variable that will contain the statistics.
+**
+** @return void.
+******************************************************************************/
+void window_get_stats(windowStats* stats);
+
+/******************************************************************************
+** window_get_tuning
+**
+** Returns the values chosen by the autotuner and its last decision.
+**
+** @param tuning [windowTuning*] Variable that will contain the state.
+**
+** @return void.
+******************************************************************************/
+void window_get_tuning(windowTuning* tuning);
+
+/******************************************************************************
+** window_tune_decision_name
+**
+** Returns the name of a decision of the autotuner.
+**
+** @param decision [const windowTuneDecision] Decision.
+**
+** @return [const char*] Name of the decision.
+******************************************************************************/
+const char* window_tune_decision_name(const windowTuneDecision decision);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* QUSIDE_QRNG_WINDOW_H */